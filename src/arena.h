@@ -0,0 +1,76 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ERROR_NONE 0
+#define ARENA_ERROR_NULL -1
+#define ARENA_ERROR_MEMORY -2
+
+enum {
+  /* Every allocation is aligned to this */
+  ARENA_ALIGN = 16,
+  /* Arenas this big or bigger are mapped on their own and asked to be
+   * backed by transparent huge pages */
+  ARENA_HUGE_PAGE = 2 * 1024 * 1024
+};
+
+#ifdef PLATFORM_LINUX
+
+struct arena_os_details {
+  int mapped;
+};
+
+#else
+
+struct arena_os_details {
+  int dummy;
+};
+
+#endif  /* PLATFORM_LINUX */
+
+/* Linear allocator. Allocations are a pointer bump and are only given
+ * back all at once, by arena_reset or by arena_release to an earlier
+ * mark. An arena is for one thread at a time */
+struct arena {
+  unsigned char *base;
+  size_t size;
+  size_t used;
+  /* High water mark, for sizing */
+  size_t peak;
+  /* Allocations that didn't fit */
+  unsigned long failed;
+  struct arena_os_details os;
+};
+
+/* **************************************** */
+/* arena_<platform>.c */
+int arena_init(struct arena *a, size_t size);
+void arena_deinit(struct arena *a);
+/* NULL once full, never falls back to the heap */
+void *arena_alloc(struct arena *a, size_t size);
+size_t arena_mark(struct arena *a);
+/* Frees everything allocated since mark was taken */
+void arena_release(struct arena *a, size_t mark);
+void arena_reset(struct arena *a);
+/* **************************************** */
+
+#endif
@@ -0,0 +1,109 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* MAP_ANONYMOUS, MADV_HUGEPAGE */
+#define _DEFAULT_SOURCE
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Huge pages only back 2MB aligned ranges, so map a page extra and trim
+ * whatever sits outside an aligned run of size bytes */
+static unsigned char *map_huge(size_t size) {
+  unsigned char *raw, *base;
+  size_t head, tail;
+
+  raw = mmap(
+    NULL,
+    size + ARENA_HUGE_PAGE,
+    PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS,
+    -1,
+    0
+  );
+  if (raw == MAP_FAILED) return NULL;
+  head = (ARENA_HUGE_PAGE - (size_t) raw % ARENA_HUGE_PAGE)
+    % ARENA_HUGE_PAGE;
+  tail = ARENA_HUGE_PAGE - head;
+  base = raw + head;
+  if (head) munmap(raw, head);
+  if (tail) munmap(base + size, tail);
+  /* Only a hint, kernels without THP or with it disabled ignore it */
+  madvise(base, size, MADV_HUGEPAGE);
+  return base;
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int arena_init(struct arena *a, size_t size) {
+  if (!a) return ARENA_ERROR_NULL;
+  memset(a, 0, sizeof(struct arena));
+  if (size >= ARENA_HUGE_PAGE) {
+    /* Whole huge pages, a partial one at the end would be small pages */
+    size = (size + ARENA_HUGE_PAGE - 1) & ~(size_t) (ARENA_HUGE_PAGE - 1);
+    a->base = map_huge(size);
+    a->os.mapped = 1;
+  } else {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    a->base = malloc(size);
+  }
+  if (!a->base) return ARENA_ERROR_MEMORY;
+  a->size = size;
+  return ARENA_ERROR_NONE;
+}
+
+void arena_deinit(struct arena *a) {
+  if (!a || !a->base) return;
+  if (a->os.mapped) munmap(a->base, a->size);
+  else free(a->base);
+  memset(a, 0, sizeof(struct arena));
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+  /* no null check */
+  size_t offset;
+
+  /* used stays at most size, and size is a multiple of ARENA_ALIGN */
+  offset = (a->used + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+  if (size > a->size - offset) {
+    ++a->failed;
+    return NULL;
+  }
+  a->used = offset + size;
+  if (a->used > a->peak) a->peak = a->used;
+  return a->base + offset;
+}
+
+size_t arena_mark(struct arena *a) {
+  /* no null check */
+  return a->used;
+}
+
+void arena_release(struct arena *a, size_t mark) {
+  /* no null check */
+  if (mark < a->used) a->used = mark;
+}
+
+void arena_reset(struct arena *a) {
+  /* no null check */
+  a->used = 0;
+}
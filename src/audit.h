@@ -0,0 +1,67 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include "sized_types.h"
+#include <stdio.h>
+
+#define AUDIT_ERROR_NONE 0
+/* Something allocated after warm-up */
+#define AUDIT_ERROR_STEADY -1
+
+enum {
+  /* Phases past this are counted under the last one */
+  AUDIT_MAX_PHASES = 16
+};
+
+struct audit_counts {
+  unsigned long mallocs;
+  unsigned long callocs;
+  unsigned long reallocs;
+  unsigned long frees;
+  uint64_t bytes;
+};
+
+/* Heap allocation audit. The audit-tortuga build interposes malloc,
+ * calloc, realloc and free and counts every call by frame and by phase.
+ * Once warm-up is over any allocation is a bug: the first one logs a
+ * backtrace and all of them are counted as steady state. In other builds
+ * everything here does nothing and the counts stay zero */
+
+/* **************************************** */
+/* audit_<platform>.c */
+/* 1 when the allocator is interposed */
+int audit_enabled(void);
+/* Frames up to and including this one are warm-up */
+void audit_set_warmup(unsigned long frames);
+/* Call from the main loop at the start of every frame */
+void audit_frame(void);
+/* Call once the main loop is done. Calls after it are still counted but
+ * never as steady state */
+void audit_end(void);
+/* Names what the calling thread does next, until its next call. Threads
+ * that never name a phase share one. name has to stay valid */
+void audit_phase(const char *name);
+/* Allocator calls made after warm-up */
+unsigned long audit_steady_allocations(void);
+void audit_print(FILE *out);
+/* **************************************** */
+
+#endif
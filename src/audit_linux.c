@@ -0,0 +1,298 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* fileno */
+#define _DEFAULT_SOURCE
+
+#include "audit.h"
+
+#ifdef AUDIT_ALLOC
+
+#include <execinfo.h>
+#include <string.h>
+
+enum {
+  AUDIT_BACKTRACE_DEPTH = 32
+};
+
+enum audit_call {
+  AUDIT_MALLOC,
+  AUDIT_CALLOC,
+  AUDIT_REALLOC,
+  AUDIT_FREE
+};
+
+struct audit_phase_counts {
+  const char *name;
+  struct audit_counts counts;
+};
+
+/* glibc's own entry points, what the interposers below forward to */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static struct audit_phase_counts phases[AUDIT_MAX_PHASES] = {
+  { "unnamed threads" }
+};
+static size_t n_phases = 1;
+static int phases_lock;
+static struct audit_counts totals;
+static struct audit_counts steady;
+static unsigned long frame;
+static unsigned long warmup_frames;
+static unsigned long frame_calls;
+static unsigned long worst_calls;
+static unsigned long worst_frame;
+static int reported;
+static int ended;
+static __thread size_t current_phase;
+/* Set while the audit itself runs. backtrace and stdio may allocate, and
+ * those calls go straight through */
+static __thread int inside;
+
+static void add_call(
+  struct audit_counts *c,
+  enum audit_call call,
+  size_t bytes
+) {
+  unsigned long *n;
+
+  switch (call) {
+  case AUDIT_MALLOC:
+    n = &c->mallocs;
+    break;
+  case AUDIT_CALLOC:
+    n = &c->callocs;
+    break;
+  case AUDIT_REALLOC:
+    n = &c->reallocs;
+    break;
+  default:
+    n = &c->frees;
+    break;
+  }
+  __atomic_add_fetch(n, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&c->bytes, (uint64_t) bytes, __ATOMIC_RELAXED);
+}
+
+static void report_steady(enum audit_call call, size_t bytes, unsigned long f) {
+  static const char *call_names[] = { "malloc", "calloc", "realloc", "free" };
+  void *frames[AUDIT_BACKTRACE_DEPTH];
+  int n;
+
+  fprintf(
+    stderr,
+    "audit: %s of %lu bytes in frame %lu after warm-up, phase %s\n",
+    call_names[call],
+    (unsigned long) bytes,
+    f,
+    phases[current_phase].name
+  );
+  n = backtrace(frames, AUDIT_BACKTRACE_DEPTH);
+  backtrace_symbols_fd(frames, n, fileno(stderr));
+}
+
+static void count(enum audit_call call, size_t bytes) {
+  unsigned long f;
+
+  if (inside) return;
+  inside = 1;
+  add_call(&totals, call, bytes);
+  add_call(&phases[current_phase].counts, call, bytes);
+  __atomic_add_fetch(&frame_calls, 1, __ATOMIC_RELAXED);
+  f = __atomic_load_n(&frame, __ATOMIC_RELAXED);
+  if (
+    warmup_frames
+    && f > warmup_frames
+    && !__atomic_load_n(&ended, __ATOMIC_RELAXED)
+  ) {
+    add_call(&steady, call, bytes);
+    if (!__atomic_exchange_n(&reported, 1, __ATOMIC_RELAXED)) {
+      report_steady(call, bytes, f);
+    }
+  }
+  inside = 0;
+}
+
+static void print_counts(struct audit_counts *c, const char *name, FILE *out) {
+  fprintf(
+    out,
+    "  %-20s %8lu malloc %8lu calloc %8lu realloc %8lu free %10lu bytes\n",
+    name,
+    c->mallocs,
+    c->callocs,
+    c->reallocs,
+    c->frees,
+    (unsigned long) c->bytes
+  );
+}
+
+/* **************************************** */
+/* Interposers */
+/* **************************************** */
+
+void *malloc(size_t size) {
+  count(AUDIT_MALLOC, size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  count(AUDIT_CALLOC, n * size);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count(AUDIT_REALLOC, size);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  if (ptr) count(AUDIT_FREE, 0);
+  __libc_free(ptr);
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int audit_enabled(void) {
+  return 1;
+}
+
+void audit_set_warmup(unsigned long frames) {
+  void *frames_buf[1];
+
+  /* The first backtrace loads libgcc, get that out of the way now */
+  inside = 1;
+  backtrace(frames_buf, 1);
+  inside = 0;
+  warmup_frames = frames;
+}
+
+void audit_frame(void) {
+  unsigned long calls;
+
+  calls = __atomic_exchange_n(&frame_calls, 0, __ATOMIC_RELAXED);
+  /* Frame 0 is everything before the loop, it doesn't count */
+  if (frame && calls > worst_calls) {
+    worst_calls = calls;
+    worst_frame = frame;
+  }
+  __atomic_add_fetch(&frame, 1, __ATOMIC_RELAXED);
+}
+
+void audit_end(void) {
+  unsigned long calls;
+
+  /* The last frame never saw another audit_frame to close it */
+  calls = __atomic_exchange_n(&frame_calls, 0, __ATOMIC_RELAXED);
+  if (frame && calls > worst_calls) {
+    worst_calls = calls;
+    worst_frame = frame;
+  }
+  __atomic_store_n(&ended, 1, __ATOMIC_RELAXED);
+}
+
+void audit_phase(const char *name) {
+  size_t i, n;
+
+  n = __atomic_load_n(&n_phases, __ATOMIC_ACQUIRE);
+  for (i = 0; i < n; ++i) {
+    if (!strcmp(phases[i].name, name)) {
+      current_phase = i;
+      return;
+    }
+  }
+  while (__atomic_exchange_n(&phases_lock, 1, __ATOMIC_ACQUIRE));
+  /* Someone may have added it while we looked */
+  for (n = n_phases; i < n; ++i) {
+    if (!strcmp(phases[i].name, name)) break;
+  }
+  if (i == n) {
+    if (n < AUDIT_MAX_PHASES) {
+      phases[n].name = name;
+      __atomic_store_n(&n_phases, n + 1, __ATOMIC_RELEASE);
+    } else {
+      i = AUDIT_MAX_PHASES - 1;
+    }
+  }
+  __atomic_store_n(&phases_lock, 0, __ATOMIC_RELEASE);
+  current_phase = i;
+}
+
+unsigned long audit_steady_allocations(void) {
+  return __atomic_load_n(&steady.mallocs, __ATOMIC_RELAXED)
+    + __atomic_load_n(&steady.callocs, __ATOMIC_RELAXED)
+    + __atomic_load_n(&steady.reallocs, __ATOMIC_RELAXED)
+    + __atomic_load_n(&steady.frees, __ATOMIC_RELAXED);
+}
+
+void audit_print(FILE *out) {
+  size_t i, n;
+
+  inside = 1;
+  n = __atomic_load_n(&n_phases, __ATOMIC_ACQUIRE);
+  fprintf(
+    out,
+    "allocation audit: %lu frames, %lu warm-up, worst frame %lu with %lu "
+    "calls\n",
+    frame,
+    warmup_frames,
+    worst_frame,
+    worst_calls
+  );
+  print_counts(&totals, "total", out);
+  for (i = 0; i < n; ++i) {
+    print_counts(&phases[i].counts, phases[i].name, out);
+  }
+  print_counts(&steady, "after warm-up", out);
+  inside = 0;
+}
+
+#else
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int audit_enabled(void) {
+  return 0;
+}
+
+void audit_set_warmup(unsigned long frames) {
+}
+
+void audit_frame(void) {
+}
+
+void audit_end(void) {
+}
+
+void audit_phase(const char *name) {
+}
+
+unsigned long audit_steady_allocations(void) {
+  return 0;
+}
+
+void audit_print(FILE *out) {
+}
+
+#endif  /* AUDIT_ALLOC */
@@ -0,0 +1,456 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "cull.h"
+#include "sized_types.h"
+#include "trig.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CULL_X86
+#include <immintrin.h>
+#endif
+
+enum {
+  N_STREAMS = 10
+};
+
+static size_t spheres_scalar(
+  struct cull_objects *co,
+  struct cull_planes *p,
+  size_t begin,
+  uint32_t *out_visible,
+  size_t n_visible
+) {
+  size_t i, j;
+
+  for (i = begin; i < co->n; ++i) {
+    int inside = 1;
+
+    for (j = 0; j < CULL_N_PLANES; ++j) {
+      float dist;
+
+      dist = p->a[j] * co->x[i] + p->b[j] * co->y[i] + p->c[j] * co->z[i]
+        + p->d[j];
+      inside &= dist >= -co->r[i];
+    }
+    if (inside) out_visible[n_visible++] = (uint32_t) i;
+  }
+  return n_visible;
+}
+
+static size_t aabbs_scalar(
+  struct cull_objects *co,
+  struct cull_planes *p,
+  size_t begin,
+  uint32_t *out_visible,
+  size_t n_visible
+) {
+  size_t i, j;
+
+  for (i = begin; i < co->n; ++i) {
+    int inside = 1;
+
+    for (j = 0; j < CULL_N_PLANES; ++j) {
+      float dist, radius;
+
+      /* Project the half extents onto the plane normal to get the
+       * distance from the center to the box's most positive corner */
+      dist = p->a[j] * co->box_x[i] + p->b[j] * co->box_y[i]
+        + p->c[j] * co->box_z[i] + p->d[j];
+      radius = (float) fabs(p->a[j]) * co->ext_x[i]
+        + (float) fabs(p->b[j]) * co->ext_y[i]
+        + (float) fabs(p->c[j]) * co->ext_z[i];
+      inside &= dist + radius >= 0.0f;
+    }
+    if (inside) out_visible[n_visible++] = (uint32_t) i;
+  }
+  return n_visible;
+}
+
+#ifdef CULL_X86
+
+/* Appends base plus the index of every set bit in a lane mask */
+static size_t emit_visible(
+  unsigned int mask,
+  size_t base,
+  uint32_t *out_visible,
+  size_t n_visible
+) {
+  while (mask) {
+    out_visible[n_visible++] =
+      (uint32_t) (base + (size_t) __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+  return n_visible;
+}
+
+static int have_avx2(void) {
+  static int cached = -1;
+
+  if (cached < 0) {
+    __builtin_cpu_init();
+    cached =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  }
+  return cached;
+}
+
+static size_t spheres_sse(
+  struct cull_objects *co,
+  struct cull_planes *p,
+  size_t *out_end,
+  uint32_t *out_visible
+) {
+  size_t i, j, n_visible = 0;
+  __m128 a[CULL_N_PLANES], b[CULL_N_PLANES];
+  __m128 c[CULL_N_PLANES], d[CULL_N_PLANES];
+
+  for (j = 0; j < CULL_N_PLANES; ++j) {
+    a[j] = _mm_set1_ps(p->a[j]);
+    b[j] = _mm_set1_ps(p->b[j]);
+    c[j] = _mm_set1_ps(p->c[j]);
+    d[j] = _mm_set1_ps(p->d[j]);
+  }
+  for (i = 0; i + 4 <= co->n; i += 4) {
+    __m128 x, y, z, neg_r, inside;
+
+    x = _mm_loadu_ps(co->x + i);
+    y = _mm_loadu_ps(co->y + i);
+    z = _mm_loadu_ps(co->z + i);
+    neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(co->r + i));
+    inside = _mm_cmpeq_ps(x, x);
+    for (j = 0; j < CULL_N_PLANES; ++j) {
+      __m128 dist;
+
+      dist = _mm_add_ps(_mm_mul_ps(a[j], x), _mm_mul_ps(b[j], y));
+      dist = _mm_add_ps(dist, _mm_mul_ps(c[j], z));
+      dist = _mm_add_ps(dist, d[j]);
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_r));
+    }
+    n_visible = emit_visible(
+      (unsigned int) _mm_movemask_ps(inside),
+      i,
+      out_visible,
+      n_visible
+    );
+  }
+  *out_end = i;
+  return n_visible;
+}
+
+static size_t aabbs_sse(
+  struct cull_objects *co,
+  struct cull_planes *p,
+  size_t *out_end,
+  uint32_t *out_visible
+) {
+  size_t i, j, n_visible = 0;
+  __m128 a[CULL_N_PLANES], b[CULL_N_PLANES];
+  __m128 c[CULL_N_PLANES], d[CULL_N_PLANES];
+  __m128 abs_a[CULL_N_PLANES], abs_b[CULL_N_PLANES], abs_c[CULL_N_PLANES];
+
+  for (j = 0; j < CULL_N_PLANES; ++j) {
+    a[j] = _mm_set1_ps(p->a[j]);
+    b[j] = _mm_set1_ps(p->b[j]);
+    c[j] = _mm_set1_ps(p->c[j]);
+    d[j] = _mm_set1_ps(p->d[j]);
+    abs_a[j] = _mm_set1_ps((float) fabs(p->a[j]));
+    abs_b[j] = _mm_set1_ps((float) fabs(p->b[j]));
+    abs_c[j] = _mm_set1_ps((float) fabs(p->c[j]));
+  }
+  for (i = 0; i + 4 <= co->n; i += 4) {
+    __m128 x, y, z, ex, ey, ez, inside;
+
+    x = _mm_loadu_ps(co->box_x + i);
+    y = _mm_loadu_ps(co->box_y + i);
+    z = _mm_loadu_ps(co->box_z + i);
+    ex = _mm_loadu_ps(co->ext_x + i);
+    ey = _mm_loadu_ps(co->ext_y + i);
+    ez = _mm_loadu_ps(co->ext_z + i);
+    inside = _mm_cmpeq_ps(x, x);
+    for (j = 0; j < CULL_N_PLANES; ++j) {
+      __m128 dist, radius;
+
+      dist = _mm_add_ps(_mm_mul_ps(a[j], x), _mm_mul_ps(b[j], y));
+      dist = _mm_add_ps(dist, _mm_mul_ps(c[j], z));
+      dist = _mm_add_ps(dist, d[j]);
+      radius = _mm_add_ps(_mm_mul_ps(abs_a[j], ex), _mm_mul_ps(abs_b[j], ey));
+      radius = _mm_add_ps(radius, _mm_mul_ps(abs_c[j], ez));
+      inside = _mm_and_ps(
+        inside,
+        _mm_cmpge_ps(_mm_add_ps(dist, radius), _mm_setzero_ps())
+      );
+    }
+    n_visible = emit_visible(
+      (unsigned int) _mm_movemask_ps(inside),
+      i,
+      out_visible,
+      n_visible
+    );
+  }
+  *out_end = i;
+  return n_visible;
+}
+
+__attribute__((target("avx2,fma")))
+static size_t spheres_avx2(
+  struct cull_objects *co,
+  struct cull_planes *p,
+  size_t *out_end,
+  uint32_t *out_visible
+) {
+  size_t i, j, n_visible = 0;
+  __m256 a[CULL_N_PLANES], b[CULL_N_PLANES];
+  __m256 c[CULL_N_PLANES], d[CULL_N_PLANES];
+
+  for (j = 0; j < CULL_N_PLANES; ++j) {
+    a[j] = _mm256_set1_ps(p->a[j]);
+    b[j] = _mm256_set1_ps(p->b[j]);
+    c[j] = _mm256_set1_ps(p->c[j]);
+    d[j] = _mm256_set1_ps(p->d[j]);
+  }
+  for (i = 0; i + 8 <= co->n; i += 8) {
+    __m256 x, y, z, neg_r, inside;
+
+    x = _mm256_loadu_ps(co->x + i);
+    y = _mm256_loadu_ps(co->y + i);
+    z = _mm256_loadu_ps(co->z + i);
+    neg_r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(co->r + i));
+    inside = _mm256_cmp_ps(x, x, _CMP_EQ_OQ);
+    for (j = 0; j < CULL_N_PLANES; ++j) {
+      __m256 dist;
+
+      dist = _mm256_fmadd_ps(a[j], x, d[j]);
+      dist = _mm256_fmadd_ps(b[j], y, dist);
+      dist = _mm256_fmadd_ps(c[j], z, dist);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, neg_r, _CMP_GE_OQ));
+    }
+    n_visible = emit_visible(
+      (unsigned int) _mm256_movemask_ps(inside),
+      i,
+      out_visible,
+      n_visible
+    );
+  }
+  *out_end = i;
+  return n_visible;
+}
+
+__attribute__((target("avx2,fma")))
+static size_t aabbs_avx2(
+  struct cull_objects *co,
+  struct cull_planes *p,
+  size_t *out_end,
+  uint32_t *out_visible
+) {
+  size_t i, j, n_visible = 0;
+  __m256 a[CULL_N_PLANES], b[CULL_N_PLANES];
+  __m256 c[CULL_N_PLANES], d[CULL_N_PLANES];
+  __m256 abs_a[CULL_N_PLANES], abs_b[CULL_N_PLANES], abs_c[CULL_N_PLANES];
+
+  for (j = 0; j < CULL_N_PLANES; ++j) {
+    a[j] = _mm256_set1_ps(p->a[j]);
+    b[j] = _mm256_set1_ps(p->b[j]);
+    c[j] = _mm256_set1_ps(p->c[j]);
+    d[j] = _mm256_set1_ps(p->d[j]);
+    abs_a[j] = _mm256_set1_ps((float) fabs(p->a[j]));
+    abs_b[j] = _mm256_set1_ps((float) fabs(p->b[j]));
+    abs_c[j] = _mm256_set1_ps((float) fabs(p->c[j]));
+  }
+  for (i = 0; i + 8 <= co->n; i += 8) {
+    __m256 x, y, z, ex, ey, ez, inside;
+
+    x = _mm256_loadu_ps(co->box_x + i);
+    y = _mm256_loadu_ps(co->box_y + i);
+    z = _mm256_loadu_ps(co->box_z + i);
+    ex = _mm256_loadu_ps(co->ext_x + i);
+    ey = _mm256_loadu_ps(co->ext_y + i);
+    ez = _mm256_loadu_ps(co->ext_z + i);
+    inside = _mm256_cmp_ps(x, x, _CMP_EQ_OQ);
+    for (j = 0; j < CULL_N_PLANES; ++j) {
+      __m256 dist;
+
+      /* dist + radius folded into a single chain */
+      dist = _mm256_fmadd_ps(a[j], x, d[j]);
+      dist = _mm256_fmadd_ps(b[j], y, dist);
+      dist = _mm256_fmadd_ps(c[j], z, dist);
+      dist = _mm256_fmadd_ps(abs_a[j], ex, dist);
+      dist = _mm256_fmadd_ps(abs_b[j], ey, dist);
+      dist = _mm256_fmadd_ps(abs_c[j], ez, dist);
+      inside = _mm256_and_ps(
+        inside,
+        _mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_GE_OQ)
+      );
+    }
+    n_visible = emit_visible(
+      (unsigned int) _mm256_movemask_ps(inside),
+      i,
+      out_visible,
+      n_visible
+    );
+  }
+  *out_end = i;
+  return n_visible;
+}
+
+#endif  /* CULL_X86 */
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int cull_init(struct cull_objects *co, size_t capacity) {
+  float *streams;
+
+  if (!co) return CULL_ERROR_NULL;
+  memset(co, 0, sizeof(struct cull_objects));
+  /* One allocation backs every stream */
+  streams = malloc(sizeof(float) * N_STREAMS * (capacity ? capacity : 1));
+  if (!streams) return CULL_ERROR_MEMORY;
+  co->capacity = capacity;
+  co->x = streams;
+  co->y = streams + capacity;
+  co->z = streams + capacity * 2;
+  co->r = streams + capacity * 3;
+  co->box_x = streams + capacity * 4;
+  co->box_y = streams + capacity * 5;
+  co->box_z = streams + capacity * 6;
+  co->ext_x = streams + capacity * 7;
+  co->ext_y = streams + capacity * 8;
+  co->ext_z = streams + capacity * 9;
+  return CULL_ERROR_NONE;
+}
+
+void cull_deinit(struct cull_objects *co) {
+  if (!co) return;
+  free(co->x);
+  memset(co, 0, sizeof(struct cull_objects));
+}
+
+int cull_set_sphere(
+  struct cull_objects *co,
+  size_t i,
+  struct vec3 *center,
+  float radius
+) {
+  if (!co) return CULL_ERROR_NULL;
+  if (!center) return CULL_ERROR_NULL;
+  if (i >= co->capacity) return CULL_ERROR_INDEX;
+  co->x[i] = center->x;
+  co->y[i] = center->y;
+  co->z[i] = center->z;
+  co->r[i] = radius;
+  if (i >= co->n) co->n = i + 1;
+  return CULL_ERROR_NONE;
+}
+
+int cull_set_aabb(
+  struct cull_objects *co,
+  size_t i,
+  struct vec3 *min,
+  struct vec3 *max
+) {
+  if (!co) return CULL_ERROR_NULL;
+  if (!min || !max) return CULL_ERROR_NULL;
+  if (i >= co->capacity) return CULL_ERROR_INDEX;
+  co->box_x[i] = (min->x + max->x) * 0.5f;
+  co->box_y[i] = (min->y + max->y) * 0.5f;
+  co->box_z[i] = (min->z + max->z) * 0.5f;
+  co->ext_x[i] = (max->x - min->x) * 0.5f;
+  co->ext_y[i] = (max->y - min->y) * 0.5f;
+  co->ext_z[i] = (max->z - min->z) * 0.5f;
+  if (i >= co->n) co->n = i + 1;
+  return CULL_ERROR_NONE;
+}
+
+void cull_extract_planes(struct mat4 *view_proj, struct cull_planes *out) {
+  /* Gribb/Hartmann: each plane is the last row of the matrix plus or minus
+   * one of the other rows. The matrix is column major, so row r is
+   * data[r], data[4 + r], data[8 + r], data[12 + r]. Clip space depth is
+   * [0, w] as in Vulkan, which makes the near plane just row 2 */
+  static const int rows[CULL_N_PLANES] = { 0, 0, 1, 1, 2, 2 };
+  static const float signs[CULL_N_PLANES] = {
+    1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f
+  };
+  float *m;
+  size_t i;
+
+  m = view_proj->data;
+  for (i = 0; i < CULL_N_PLANES; ++i) {
+    int r = rows[i];
+    float s = signs[i];
+    float w = (i == 4) ? 0.0f : 1.0f;
+    float a, b, c, d, len;
+
+    a = w * m[3] + s * m[r];
+    b = w * m[7] + s * m[4 + r];
+    c = w * m[11] + s * m[8 + r];
+    d = w * m[15] + s * m[12 + r];
+    len = (float) sqrt(a * a + b * b + c * c);
+    if (len > 0.0f) {
+      a /= len;
+      b /= len;
+      c /= len;
+      d /= len;
+    }
+    out->a[i] = a;
+    out->b[i] = b;
+    out->c[i] = c;
+    out->d[i] = d;
+  }
+}
+
+size_t cull_spheres(
+  struct cull_objects *co,
+  struct cull_planes *planes,
+  uint32_t *out_visible
+) {
+  size_t end = 0, n_visible = 0;
+
+  /* no null check */
+#ifdef CULL_X86
+  if (have_avx2()) {
+    n_visible = spheres_avx2(co, planes, &end, out_visible);
+  } else {
+    n_visible = spheres_sse(co, planes, &end, out_visible);
+  }
+#endif
+  return spheres_scalar(co, planes, end, out_visible, n_visible);
+}
+
+size_t cull_aabbs(
+  struct cull_objects *co,
+  struct cull_planes *planes,
+  uint32_t *out_visible
+) {
+  size_t end = 0, n_visible = 0;
+
+  /* no null check */
+#ifdef CULL_X86
+  if (have_avx2()) {
+    n_visible = aabbs_avx2(co, planes, &end, out_visible);
+  } else {
+    n_visible = aabbs_sse(co, planes, &end, out_visible);
+  }
+#endif
+  return aabbs_scalar(co, planes, end, out_visible, n_visible);
+}
@@ -0,0 +1,92 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CULL_H
+#define CULL_H
+
+#include "sized_types.h"
+#include "trig.h"
+#include <stddef.h>
+
+#define CULL_ERROR_NONE 0
+#define CULL_ERROR_NULL -1
+#define CULL_ERROR_MEMORY -2
+#define CULL_ERROR_INDEX -3
+
+enum {
+  CULL_N_PLANES = 6
+};
+
+/* Plane coefficients (ax + by + cz + d = 0) stored per component so each
+ * plane can be broadcast across SIMD lanes. Order: left, right, bottom,
+ * top, near, far */
+struct cull_planes {
+  float a[CULL_N_PLANES];
+  float b[CULL_N_PLANES];
+  float c[CULL_N_PLANES];
+  float d[CULL_N_PLANES];
+};
+
+/* Bounding volumes in structure-of-arrays form. Boxes are kept as center
+ * and half extents since that is what the plane test wants */
+struct cull_objects {
+  size_t n;
+  size_t capacity;
+  /* spheres */
+  float *x;
+  float *y;
+  float *z;
+  float *r;
+  /* axis aligned boxes */
+  float *box_x;
+  float *box_y;
+  float *box_z;
+  float *ext_x;
+  float *ext_y;
+  float *ext_z;
+};
+
+int cull_init(struct cull_objects *co, size_t capacity);
+void cull_deinit(struct cull_objects *co);
+int cull_set_sphere(
+  struct cull_objects *co,
+  size_t i,
+  struct vec3 *center,
+  float radius
+);
+int cull_set_aabb(
+  struct cull_objects *co,
+  size_t i,
+  struct vec3 *min,
+  struct vec3 *max
+);
+void cull_extract_planes(struct mat4 *view_proj, struct cull_planes *out);
+/* Both write the indices of visible objects to out_visible, which must
+ * hold co->n entries, and return how many were written */
+size_t cull_spheres(
+  struct cull_objects *co,
+  struct cull_planes *planes,
+  uint32_t *out_visible
+);
+size_t cull_aabbs(
+  struct cull_objects *co,
+  struct cull_planes *planes,
+  uint32_t *out_visible
+);
+
+#endif
@@ -0,0 +1,76 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "frame.h"
+#include "timer.h"
+#include <string.h>
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int frame_init(
+  struct frame_clock *fc,
+  uint64_t step_ns,
+  unsigned int max_steps
+) {
+  if (!fc) return FRAME_ERROR_NULL;
+  if (!step_ns || !max_steps) return FRAME_ERROR_STEP;
+  memset(fc, 0, sizeof(struct frame_clock));
+  fc->step_ns = step_ns;
+  fc->max_steps = max_steps;
+  fc->last_ns = timer_now_ns();
+  return FRAME_ERROR_NONE;
+}
+
+unsigned int frame_begin(struct frame_clock *fc) {
+  /* no null check */
+  uint64_t now, limit;
+  unsigned int n;
+
+  now = timer_now_ns();
+  fc->accumulator_ns += now - fc->last_ns;
+  fc->last_ns = now;
+  /* Spiral of death: steps that take longer than step_ns make the next
+   * frame owe even more. Cap the debt so a slow stretch only slows the
+   * simulation down */
+  limit = fc->step_ns * fc->max_steps;
+  if (fc->accumulator_ns > limit) {
+    fc->dropped_ns += fc->accumulator_ns - limit;
+    fc->accumulator_ns = limit;
+  }
+  n = (unsigned int) (fc->accumulator_ns / fc->step_ns);
+  fc->accumulator_ns -= n * fc->step_ns;
+  fc->steps += n;
+  return n;
+}
+
+float frame_alpha(struct frame_clock *fc) {
+  /* no null check */
+  return (float) fc->accumulator_ns / (float) fc->step_ns;
+}
+
+uint64_t frame_until_step_ns(struct frame_clock *fc) {
+  /* no null check */
+  return fc->step_ns - fc->accumulator_ns;
+}
+
+void frame_reset(struct frame_clock *fc) {
+  /* no null check */
+  fc->last_ns = timer_now_ns();
+}
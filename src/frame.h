@@ -0,0 +1,60 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "sized_types.h"
+
+#define FRAME_ERROR_NONE 0
+#define FRAME_ERROR_NULL -1
+#define FRAME_ERROR_STEP -2
+
+/* Fixed timestep clock. Each frame adds the elapsed time to an
+ * accumulator and the simulation runs one step per step_ns it holds, so
+ * its cost does not depend on how fast frames come in. What is left over
+ * becomes the alpha to interpolate rendered state with */
+struct frame_clock {
+  uint64_t step_ns;
+  uint64_t accumulator_ns;
+  uint64_t last_ns;
+  /* Steps allowed per frame. When the simulation can't keep up, the
+   * backlog past this is dropped instead of growing every frame */
+  unsigned int max_steps;
+  /* Totals since frame_init */
+  unsigned long steps;
+  uint64_t dropped_ns;
+};
+
+int frame_init(
+  struct frame_clock *fc,
+  uint64_t step_ns,
+  unsigned int max_steps
+);
+/* Samples the clock and returns how many steps to simulate this frame */
+unsigned int frame_begin(struct frame_clock *fc);
+/* How far between the last two simulated states the frame is, [0, 1) */
+float frame_alpha(struct frame_clock *fc);
+/* Time from the last frame_begin until another step is due, for loops
+ * that would otherwise spin waiting for one */
+uint64_t frame_until_step_ns(struct frame_clock *fc);
+/* Restarts the measurement from now, for after the loop slept and the
+ * time in between should not be simulated */
+void frame_reset(struct frame_clock *fc);
+
+#endif
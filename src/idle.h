@@ -0,0 +1,57 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#define IDLE_ERROR_NONE 0
+#define IDLE_ERROR_NULL -1
+#define IDLE_ERROR_CREATE -2
+#define IDLE_ERROR_ADD -3
+
+#ifdef PLATFORM_LINUX
+
+struct idle_os_details {
+  int epfd;
+};
+
+#else
+
+struct idle_os_details {
+  int dummy;
+};
+
+#endif  /* PLATFORM_LINUX */
+
+/* Sleeps the main loop until one of a set of fds has something for it */
+struct idle_ctx {
+  struct idle_os_details os;
+};
+
+/* **************************************** */
+/* idle_<platform>.c */
+int idle_init(struct idle_ctx *ic);
+void idle_deinit(struct idle_ctx *ic);
+int idle_add_fd(struct idle_ctx *ic, int fd);
+void idle_remove_fd(struct idle_ctx *ic, int fd);
+/* Blocks until an fd is readable or timeout_ms passes, -1 waits forever.
+ * Returns 0 on timeout. Nothing is read, the owners of the fds do that */
+int idle_wait(struct idle_ctx *ic, int timeout_ms);
+/* **************************************** */
+
+#endif
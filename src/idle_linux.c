@@ -0,0 +1,69 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "idle.h"
+#include <sys/epoll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int idle_init(struct idle_ctx *ic) {
+  if (!ic) return IDLE_ERROR_NULL;
+  memset(ic, 0, sizeof(struct idle_ctx));
+  ic->os.epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (ic->os.epfd < 0) return IDLE_ERROR_CREATE;
+  return IDLE_ERROR_NONE;
+}
+
+void idle_deinit(struct idle_ctx *ic) {
+  if (!ic || ic->os.epfd < 0) return;
+  close(ic->os.epfd);
+  ic->os.epfd = -1;
+}
+
+int idle_add_fd(struct idle_ctx *ic, int fd) {
+  struct epoll_event ev = { 0 };
+
+  if (!ic) return IDLE_ERROR_NULL;
+  /* Level triggered, so an fd nobody drained keeps waking us */
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(ic->os.epfd, EPOLL_CTL_ADD, fd, &ev)) return IDLE_ERROR_ADD;
+  return IDLE_ERROR_NONE;
+}
+
+void idle_remove_fd(struct idle_ctx *ic, int fd) {
+  if (!ic) return;
+  epoll_ctl(ic->os.epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int idle_wait(struct idle_ctx *ic, int timeout_ms) {
+  /* no null check */
+  int n;
+  struct epoll_event ev;
+
+  /* Which fd woke us doesn't matter, the caller polls all of them */
+  do {
+    n = epoll_wait(ic->os.epfd, &ev, 1, timeout_ms);
+  } while (n < 0 && errno == EINTR);
+  return n > 0;
+}
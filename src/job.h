@@ -0,0 +1,125 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include "sized_types.h"
+#include "xrand.h"
+#include <stddef.h>
+
+#define JOB_ERROR_NONE 0
+#define JOB_ERROR_NULL -1
+#define JOB_ERROR_MEMORY -2
+#define JOB_ERROR_THREAD -3
+
+enum {
+  JOB_CACHE_LINE = 64,
+  JOB_MAX_WORKERS = 64,
+  /* Per worker, must be a power of two. A full deque runs the job inline */
+  JOB_DEQUE_SIZE = 4096,
+  /* parallel_for never splits into more jobs than this */
+  JOB_MAX_CHUNKS = 256
+};
+
+typedef void (*job_fn)(void *arg);
+typedef void (*job_range_fn)(void *arg, size_t begin, size_t end);
+
+/* Counts jobs that have not finished. Zero it before first use, it can
+ * be reused once job_wait returns */
+struct job_counter {
+  long pending;
+};
+
+struct job {
+  job_fn fn;
+  void *arg;
+  struct job_counter *counter;
+};
+
+struct job_system;
+
+/* Chase-Lev deque. The owner pushes and takes at bottom, everyone else
+ * steals from top. Both indices only grow */
+struct job_worker {
+  struct {
+    long top;
+    unsigned char pad[JOB_CACHE_LINE - sizeof(long)];
+  } steal;
+  struct {
+    long bottom;
+    unsigned char pad[JOB_CACHE_LINE - sizeof(long)];
+  } own;
+  struct job ring[JOB_DEQUE_SIZE];
+  struct job_system *js;
+  struct xrand_state rand;
+  size_t index;
+  /* Totals since job_init, only touched by the owner */
+  unsigned long executed;
+  unsigned long stolen;
+};
+
+#ifdef PLATFORM_LINUX
+
+#include <pthread.h>
+
+struct job_os_details {
+  pthread_t threads[JOB_MAX_WORKERS];
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+#else
+
+struct job_os_details {
+  int dummy;
+};
+
+#endif  /* PLATFORM_LINUX */
+
+/* Worker 0 is the thread that called job_init. It runs jobs whenever it
+ * waits on a counter. Only it and the jobs themselves may submit work */
+struct job_system {
+  size_t n_workers;
+  struct job_worker *workers;
+  int shutdown;
+  int n_sleeping;
+  struct job_os_details os;
+};
+
+/* **************************************** */
+/* job_<platform>.c */
+/* n_threads counts the calling thread, 0 picks one per online core */
+int job_init(struct job_system *js, size_t n_threads);
+void job_deinit(struct job_system *js);
+/* Queues n jobs, each adds one to its counter. jobs is copied */
+void job_run(struct job_system *js, struct job *jobs, size_t n);
+/* Runs other jobs until counter drops to zero. Jobs may wait too, which
+ * is how one job depends on others */
+void job_wait(struct job_system *js, struct job_counter *counter);
+/* Calls fn over [0, n) split in ranges of at least grain and waits */
+void job_parallel_for(
+  struct job_system *js,
+  size_t n,
+  size_t grain,
+  job_range_fn fn,
+  void *arg
+);
+/* **************************************** */
+
+#endif
@@ -0,0 +1,183 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Standalone timings of the job system, built by `make job-bench`. How
+ * much running an empty job costs, how long a round of nested jobs
+ * takes, and how a parallel_for over real work compares to the same
+ * loop on one thread. See job_stress.c for the correctness checks */
+
+#include "job.h"
+#include "timer.h"
+#include "trig.h"
+#include "xrand.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+  N_EMPTY = 1000,
+  EMPTY_REPS = 1000,
+  N_OUTER = 100,
+  N_INNER = 50,
+  NESTED_REPS = 100,
+  N_ELEMENTS = 1000000,
+  GRAIN = 1024,
+  FOR_REPS = 50
+};
+
+struct sincos {
+  float *x;
+  float *s;
+  float *c;
+};
+
+/* Timed results are summed in here so the loops aren't optimized out */
+static volatile float sink;
+
+static void empty_job(void *arg) {
+  (void) arg;
+}
+
+static void outer_job(void *arg) {
+  struct job_system *js = arg;
+  struct job jobs[N_INNER];
+  struct job_counter counter = { 0 };
+  size_t i;
+
+  for (i = 0; i < N_INNER; ++i) {
+    jobs[i].fn = empty_job;
+    jobs[i].arg = NULL;
+    jobs[i].counter = &counter;
+  }
+  job_run(js, jobs, N_INNER);
+  job_wait(js, &counter);
+}
+
+static void sincos_range(void *arg, size_t begin, size_t end) {
+  struct sincos *sc = arg;
+
+  fsincos_n(sc->x + begin, sc->s + begin, sc->c + begin, end - begin);
+}
+
+static double time_empty(struct job_system *js) {
+  struct job jobs[N_EMPTY];
+  struct job_counter counter = { 0 };
+  size_t i, r;
+  uint64_t start;
+
+  for (i = 0; i < N_EMPTY; ++i) {
+    jobs[i].fn = empty_job;
+    jobs[i].arg = NULL;
+    jobs[i].counter = &counter;
+  }
+  start = timer_now_ns();
+  for (r = 0; r < EMPTY_REPS; ++r) {
+    job_run(js, jobs, N_EMPTY);
+    job_wait(js, &counter);
+  }
+  return (double) (timer_now_ns() - start)
+    / ((double) EMPTY_REPS * (double) N_EMPTY);
+}
+
+static double time_nested(struct job_system *js) {
+  struct job jobs[N_OUTER];
+  struct job_counter counter = { 0 };
+  size_t i, r;
+  uint64_t start;
+
+  for (i = 0; i < N_OUTER; ++i) {
+    jobs[i].fn = outer_job;
+    jobs[i].arg = js;
+    jobs[i].counter = &counter;
+  }
+  start = timer_now_ns();
+  for (r = 0; r < NESTED_REPS; ++r) {
+    job_run(js, jobs, N_OUTER);
+    job_wait(js, &counter);
+  }
+  return (double) (timer_now_ns() - start) / (double) NESTED_REPS;
+}
+
+static void time_for(
+  struct job_system *js,
+  struct sincos *sc,
+  double *out_serial,
+  double *out_parallel
+) {
+  size_t r;
+  uint64_t start;
+
+  start = timer_now_ns();
+  for (r = 0; r < FOR_REPS; ++r) {
+    sincos_range(sc, 0, N_ELEMENTS);
+    sink += sc->s[r] + sc->c[r];
+  }
+  *out_serial = (double) (timer_now_ns() - start) / (double) FOR_REPS;
+  start = timer_now_ns();
+  for (r = 0; r < FOR_REPS; ++r) {
+    job_parallel_for(js, N_ELEMENTS, GRAIN, sincos_range, sc);
+    sink += sc->s[r] + sc->c[r];
+  }
+  *out_parallel = (double) (timer_now_ns() - start) / (double) FOR_REPS;
+}
+
+/* Takes the number of threads, one per core by default */
+int main(int argc, char **argv) {
+  struct job_system js;
+  struct xrand_state state;
+  struct xrand_wide wide;
+  struct sincos sc;
+  size_t n_threads = 0;
+  double serial, parallel;
+
+  if (argc > 1) n_threads = (size_t) strtoul(argv[1], NULL, 10);
+  sc.x = malloc(sizeof(float) * N_ELEMENTS);
+  sc.s = malloc(sizeof(float) * N_ELEMENTS);
+  sc.c = malloc(sizeof(float) * N_ELEMENTS);
+  if (!sc.x || !sc.s || !sc.c) {
+    fprintf(stderr, "job-bench: out of memory\n");
+    return 1;
+  }
+  if (job_init(&js, n_threads)) {
+    fprintf(stderr, "job-bench: job_init failed\n");
+    return 1;
+  }
+  xrand_seed(&state, 1);
+  xrand_wide_init(&wide, &state);
+  xrand_fill_range(&wide, -8192.0f, 8192.0f, sc.x, N_ELEMENTS);
+  printf("%lu workers:\n", (unsigned long) js.n_workers);
+  printf("  empty job          %10.1f ns\n", time_empty(&js));
+  printf(
+    "  %d x %d nested   %10.1f us\n",
+    N_OUTER,
+    N_INNER,
+    time_nested(&js) / 1000.0
+  );
+  time_for(&js, &sc, &serial, &parallel);
+  printf(
+    "  sincos over %d  %8.2f ms serial %8.2f ms parallel_for, %.2fx\n",
+    N_ELEMENTS,
+    serial / 1e6,
+    parallel / 1e6,
+    serial / parallel
+  );
+  job_deinit(&js);
+  free(sc.x);
+  free(sc.s);
+  free(sc.c);
+  return 0;
+}
@@ -0,0 +1,349 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* sysconf(_SC_NPROCESSORS_ONLN) */
+#define _DEFAULT_SOURCE
+
+#include "job.h"
+#include "error.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+  /* Failed searches before a worker goes to sleep */
+  JOB_SPINS = 64,
+  /* parallel_for aims for this many ranges per thread */
+  JOB_CHUNKS_PER_THREAD = 4
+};
+
+struct job_range {
+  job_range_fn fn;
+  void *arg;
+  size_t begin;
+  size_t end;
+};
+
+static __thread struct job_worker *current_worker;
+
+/* Slots are copied field by field with relaxed atomics. A thief can read
+ * a slot the owner is rewriting, but then its CAS on top fails and the
+ * copy is thrown away */
+static void load_job(struct job *slot, struct job *out) {
+  out->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+  out->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+  out->counter = __atomic_load_n(&slot->counter, __ATOMIC_RELAXED);
+}
+
+static void store_job(struct job *slot, struct job *job) {
+  __atomic_store_n(&slot->fn, job->fn, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->arg, job->arg, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->counter, job->counter, __ATOMIC_RELAXED);
+}
+
+static int deque_push(struct job_worker *w, struct job *job) {
+  long b, t;
+
+  b = __atomic_load_n(&w->own.bottom, __ATOMIC_RELAXED);
+  t = __atomic_load_n(&w->steal.top, __ATOMIC_ACQUIRE);
+  if (b - t >= JOB_DEQUE_SIZE) return 0;
+  store_job(w->ring + (b & (JOB_DEQUE_SIZE - 1)), job);
+  __atomic_store_n(&w->own.bottom, b + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static int deque_take(struct job_worker *w, struct job *out) {
+  long b, t;
+  int taken = 1;
+
+  b = __atomic_load_n(&w->own.bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&w->own.bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&w->steal.top, __ATOMIC_RELAXED);
+  if (t > b) {
+    __atomic_store_n(&w->own.bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  load_job(w->ring + (b & (JOB_DEQUE_SIZE - 1)), out);
+  if (t == b) {
+    /* Last one, race the thieves for it */
+    taken = __atomic_compare_exchange_n(
+      &w->steal.top,
+      &t,
+      t + 1,
+      0,
+      __ATOMIC_SEQ_CST,
+      __ATOMIC_RELAXED
+    );
+    __atomic_store_n(&w->own.bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return taken;
+}
+
+static int deque_steal(struct job_worker *w, struct job *out) {
+  long b, t;
+
+  t = __atomic_load_n(&w->steal.top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&w->own.bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) return 0;
+  load_job(w->ring + (t & (JOB_DEQUE_SIZE - 1)), out);
+  return __atomic_compare_exchange_n(
+    &w->steal.top,
+    &t,
+    t + 1,
+    0,
+    __ATOMIC_SEQ_CST,
+    __ATOMIC_RELAXED
+  );
+}
+
+static int work_available(struct job_system *js) {
+  size_t i;
+
+  for (i = 0; i < js->n_workers; ++i) {
+    struct job_worker *v = js->workers + i;
+
+    if (
+      __atomic_load_n(&v->steal.top, __ATOMIC_ACQUIRE)
+      < __atomic_load_n(&v->own.bottom, __ATOMIC_ACQUIRE)
+    ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int find_job(struct job_worker *w, struct job *out) {
+  size_t i, n, start;
+  struct job_system *js = w->js;
+
+  if (deque_take(w, out)) return 1;
+  n = js->n_workers;
+  if (n < 2) return 0;
+  /* Random start so thieves don't all pile onto worker 0 */
+  start = (size_t) (xrand_next(&w->rand) % n);
+  for (i = 0; i < n; ++i) {
+    struct job_worker *victim = js->workers + (start + i) % n;
+
+    if (victim == w) continue;
+    if (deque_steal(victim, out)) {
+      ++w->stolen;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void run_job(struct job_worker *w, struct job *job) {
+  job->fn(job->arg);
+  ++w->executed;
+  if (job->counter) {
+    __atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void wake_workers(struct job_system *js, size_t n_jobs) {
+  /* Pairs with the increment of n_sleeping in worker_main. Either the
+   * sleeper sees the new jobs or we see the sleeper */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&js->n_sleeping, __ATOMIC_RELAXED)) return;
+  pthread_mutex_lock(&js->os.lock);
+  if (n_jobs > 1) pthread_cond_broadcast(&js->os.wake);
+  else pthread_cond_signal(&js->os.wake);
+  pthread_mutex_unlock(&js->os.lock);
+}
+
+static void *worker_main(void *arg) {
+  struct job_worker *w = arg;
+  struct job_system *js = w->js;
+  struct job job;
+  int spins = 0;
+
+  current_worker = w;
+  for (;;) {
+    if (find_job(w, &job)) {
+      run_job(w, &job);
+      spins = 0;
+      continue;
+    }
+    if (++spins < JOB_SPINS) {
+      sched_yield();
+      continue;
+    }
+    spins = 0;
+    pthread_mutex_lock(&js->os.lock);
+    __atomic_add_fetch(&js->n_sleeping, 1, __ATOMIC_SEQ_CST);
+    while (
+      !__atomic_load_n(&js->shutdown, __ATOMIC_ACQUIRE)
+      && !work_available(js)
+    ) {
+      pthread_cond_wait(&js->os.wake, &js->os.lock);
+    }
+    __atomic_sub_fetch(&js->n_sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&js->os.lock);
+    if (__atomic_load_n(&js->shutdown, __ATOMIC_ACQUIRE)) return NULL;
+  }
+}
+
+static void stop_threads(struct job_system *js, size_t n_started) {
+  size_t i;
+
+  pthread_mutex_lock(&js->os.lock);
+  __atomic_store_n(&js->shutdown, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&js->os.wake);
+  pthread_mutex_unlock(&js->os.lock);
+  for (i = 1; i < n_started; ++i) pthread_join(js->os.threads[i], NULL);
+}
+
+static void run_range(void *arg) {
+  struct job_range *r = arg;
+
+  r->fn(r->arg, r->begin, r->end);
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int job_init(struct job_system *js, size_t n_threads) {
+  int err = JOB_ERROR_THREAD;
+  size_t i;
+
+  if (!js) return JOB_ERROR_NULL;
+  memset(js, 0, sizeof(struct job_system));
+  if (!n_threads) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    n_threads = (n > 0) ? (size_t) n : 1;
+  }
+  if (n_threads > JOB_MAX_WORKERS) n_threads = JOB_MAX_WORKERS;
+  js->workers = calloc(n_threads, sizeof(struct job_worker));
+  if (!js->workers) return JOB_ERROR_MEMORY;
+  for (i = 0; i < n_threads; ++i) {
+    js->workers[i].js = js;
+    js->workers[i].index = i;
+    xrand_split(&XRAND_DEFAULT, &js->workers[i].rand);
+  }
+  chkerrg(pthread_mutex_init(&js->os.lock, NULL), err_lock);
+  chkerrg(pthread_cond_init(&js->os.wake, NULL), err_cond);
+  /* Set before any thread starts, thieves may look at a worker whose
+   * thread isn't running yet but its deque is just empty */
+  js->n_workers = n_threads;
+  for (i = 1; i < n_threads; ++i) {
+    if (pthread_create(
+      js->os.threads + i,
+      NULL,
+      worker_main,
+      js->workers + i
+    )) {
+      goto err_thread;
+    }
+  }
+  /* Worker 0 has no thread of its own, the caller plays it */
+  current_worker = js->workers;
+  return JOB_ERROR_NONE;
+
+ err_thread:
+  stop_threads(js, i);
+  pthread_cond_destroy(&js->os.wake);
+ err_cond:
+  pthread_mutex_destroy(&js->os.lock);
+ err_lock:
+  free(js->workers);
+  js->workers = NULL;
+  return err;
+}
+
+void job_deinit(struct job_system *js) {
+  if (!js || !js->workers) return;
+  stop_threads(js, js->n_workers);
+  pthread_cond_destroy(&js->os.wake);
+  pthread_mutex_destroy(&js->os.lock);
+  if (current_worker && current_worker->js == js) current_worker = NULL;
+  free(js->workers);
+  js->workers = NULL;
+  js->n_workers = 0;
+}
+
+void job_run(struct job_system *js, struct job *jobs, size_t n) {
+  /* no null check */
+  size_t i;
+  struct job_worker *w = current_worker;
+
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].counter) {
+      __atomic_add_fetch(&jobs[i].counter->pending, 1, __ATOMIC_RELAXED);
+    }
+    /* Running it here is the only way forward with a full deque */
+    if (!deque_push(w, jobs + i)) run_job(w, jobs + i);
+  }
+  wake_workers(js, n);
+}
+
+void job_wait(struct job_system *js, struct job_counter *counter) {
+  /* no null check */
+  struct job_worker *w = current_worker;
+  struct job job;
+
+  (void) js;
+  while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0) {
+    if (find_job(w, &job)) run_job(w, &job);
+    else sched_yield();
+  }
+}
+
+void job_parallel_for(
+  struct job_system *js,
+  size_t n,
+  size_t grain,
+  job_range_fn fn,
+  void *arg
+) {
+  /* no null check */
+  size_t i, n_chunks, chunk, target;
+  struct job_range ranges[JOB_MAX_CHUNKS];
+  struct job jobs[JOB_MAX_CHUNKS];
+  struct job_counter counter = { 0 };
+
+  if (!n) return;
+  if (!grain) grain = 1;
+  /* A few ranges per thread is enough to even out uneven work, more
+   * only adds overhead */
+  target = js->n_workers * JOB_CHUNKS_PER_THREAD;
+  if (target > JOB_MAX_CHUNKS) target = JOB_MAX_CHUNKS;
+  chunk = (n + target - 1) / target;
+  if (chunk < grain) chunk = grain;
+  n_chunks = (n + chunk - 1) / chunk;
+  if (n_chunks < 2) {
+    fn(arg, 0, n);
+    return;
+  }
+  for (i = 0; i < n_chunks; ++i) {
+    ranges[i].fn = fn;
+    ranges[i].arg = arg;
+    ranges[i].begin = i * chunk;
+    ranges[i].end = (i + 1 == n_chunks) ? n : (i + 1) * chunk;
+    jobs[i].fn = run_range;
+    jobs[i].arg = ranges + i;
+    jobs[i].counter = &counter;
+  }
+  job_run(js, jobs, n_chunks);
+  job_wait(js, &counter);
+}
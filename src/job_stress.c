@@ -0,0 +1,167 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Standalone check of the job system, built by `make job-stress`. Every
+ * round runs a parallel_for that must touch each element exactly once,
+ * then jobs that each spawn more jobs and wait on them, and checks the
+ * counts come out exact. Also worth running under ThreadSanitizer and
+ * with more threads than cores */
+
+#include "job.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  ROUNDS = 200,
+  N_ELEMENTS = 1000000,
+  GRAIN = 1024,
+  N_OUTER = 100,
+  N_INNER = 50
+};
+
+struct stress {
+  struct job_system *js;
+  unsigned char *visits;
+  long elements;
+  long outer;
+  long inner;
+};
+
+static void visit(void *arg, size_t begin, size_t end) {
+  struct stress *s = arg;
+  size_t i;
+
+  for (i = begin; i < end; ++i) ++s->visits[i];
+  __atomic_add_fetch(&s->elements, (long) (end - begin), __ATOMIC_RELAXED);
+}
+
+/* One per outer job, lives on its stack while the inner jobs run */
+struct nested {
+  struct stress *s;
+  long done;
+};
+
+static void inner_job(void *arg) {
+  struct nested *n = arg;
+
+  __atomic_add_fetch(&n->done, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&n->s->inner, 1, __ATOMIC_RELAXED);
+}
+
+static void outer_job(void *arg) {
+  struct stress *s = arg;
+  struct nested n;
+  struct job jobs[N_INNER];
+  struct job_counter counter = { 0 };
+  size_t i;
+
+  n.s = s;
+  n.done = 0;
+  for (i = 0; i < N_INNER; ++i) {
+    jobs[i].fn = inner_job;
+    jobs[i].arg = &n;
+    jobs[i].counter = &counter;
+  }
+  job_run(s->js, jobs, N_INNER);
+  job_wait(s->js, &counter);
+  /* Only counts when the wait really waited for all of its jobs */
+  if (__atomic_load_n(&n.done, __ATOMIC_RELAXED) == N_INNER) {
+    __atomic_add_fetch(&s->outer, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/* Returns the number of mismatches */
+static int run_round(struct stress *s) {
+  struct job jobs[N_OUTER];
+  struct job_counter counter = { 0 };
+  size_t i;
+  int failures = 0;
+
+  memset(s->visits, 0, N_ELEMENTS);
+  s->elements = 0;
+  s->outer = 0;
+  s->inner = 0;
+  job_parallel_for(s->js, N_ELEMENTS, GRAIN, visit, s);
+  if (s->elements != N_ELEMENTS) ++failures;
+  for (i = 0; i < N_ELEMENTS; ++i) {
+    if (s->visits[i] != 1) {
+      ++failures;
+      break;
+    }
+  }
+  for (i = 0; i < N_OUTER; ++i) {
+    jobs[i].fn = outer_job;
+    jobs[i].arg = s;
+    jobs[i].counter = &counter;
+  }
+  job_run(s->js, jobs, N_OUTER);
+  job_wait(s->js, &counter);
+  if (counter.pending != 0) ++failures;
+  if (s->outer != N_OUTER) ++failures;
+  if (s->inner != (long) N_OUTER * N_INNER) ++failures;
+  if (failures) {
+    fprintf(
+      stderr,
+      "elements %ld of %d, outer %ld of %d, inner %ld of %d\n",
+      s->elements,
+      N_ELEMENTS,
+      s->outer,
+      N_OUTER,
+      s->inner,
+      N_OUTER * N_INNER
+    );
+  }
+  return failures;
+}
+
+/* Takes the number of threads, one per core by default */
+int main(int argc, char **argv) {
+  struct job_system js;
+  struct stress s;
+  size_t n_threads = 0;
+  int round, failures = 0;
+
+  if (argc > 1) n_threads = (size_t) strtoul(argv[1], NULL, 10);
+  if (job_init(&js, n_threads)) {
+    fprintf(stderr, "job-stress: job_init failed\n");
+    return 1;
+  }
+  s.js = &js;
+  s.visits = malloc(N_ELEMENTS);
+  if (!s.visits) {
+    fprintf(stderr, "job-stress: out of memory\n");
+    job_deinit(&js);
+    return 1;
+  }
+  for (round = 0; round < ROUNDS; ++round) {
+    if (run_round(&s)) {
+      fprintf(stderr, "job-stress: round %d FAIL\n", round);
+      ++failures;
+    }
+  }
+  printf(
+    "%d rounds on %lu workers: %s\n",
+    ROUNDS,
+    (unsigned long) js.n_workers,
+    failures ? "FAIL" : "ok"
+  );
+  free(s.visits);
+  job_deinit(&js);
+  return failures ? 1 : 0;
+}
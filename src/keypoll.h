@@ -20,21 +20,40 @@
 #define KEYPOLL_H
 
 #include "sized_types.h"
+#include "thread.h"
 #include <stddef.h>
+#include <stdio.h>
 
-#define kp_getkey(ctx, k) ((ctx).keymap[(k)])
-#define kp_getkey_press(ctx, k) ((ctx).keymap[(k)] == KP_STATE_PRESSED)
+#define kp_keybit(set, k) (((set)[(k) / 32] >> ((k) % 32)) & 1u)
+#define kp_getkey(ctx, k) \
+  (kp_keybit((ctx).keys.pressed, (k)) ? KP_STATE_PRESSED \
+   : kp_keybit((ctx).keys.down, (k)) ? KP_STATE_HELD \
+   : KP_STATE_UP)
+#define kp_getkey_press(ctx, k) kp_keybit((ctx).keys.pressed, (k))
+#define kp_getkey_release(ctx, k) kp_keybit((ctx).keys.released, (k))
 
 #define KEYPOLL_ERROR_NONE 0
 #define KEYPOLL_ERROR_NULL -1
 #define KEYPOLL_ERROR_INVALID_DIR -2
+#define KEYPOLL_ERROR_EPOLL -3
+#define KEYPOLL_ERROR_THREAD -4
+#define KEYPOLL_ERROR_FILE -5
+#define KEYPOLL_ERROR_FORMAT -6
 
 enum {
   KEYPOLL_MAX_DEVICES = 32,
-  KEYPOLL_MAX_MT_SLOTS = 12
+  KEYPOLL_MAX_MT_SLOTS = 12,
+  KEYPOLL_MAX_NAME = 256,
+  /* Events the input thread can queue between two kp_updates, must be a
+   * power of two */
+  KEYPOLL_RING_SIZE = 1024,
+  /* Key and button timestamps kept per frame for latency measurement */
+  KEYPOLL_MAX_STAMPS = 64
 };
 
 struct kp_ctx;
+struct kp_thread;
+struct kp_record;
 
 enum kp_key_state {
   KP_STATE_UP = 0,
@@ -190,10 +209,34 @@ enum kp_key {
   KP_MAX_KEYS
 };
 
+enum {
+  KP_KEY_WORDS = (KP_MAX_KEYS + 31) / 32
+};
+
 #if PLATFORM_LINUX
 
 struct kp_os_details {
   int fds[KEYPOLL_MAX_DEVICES];
+  char names[KEYPOLL_MAX_DEVICES][KEYPOLL_MAX_NAME];
+  int epfd;
+  int inotify_fd;
+  /* Devices that appeared but could not be opened yet. udev usually fixes
+   * up permissions just after the node shows up, so these are retried */
+  struct {
+    char name[KEYPOLL_MAX_NAME];
+    unsigned int tries;
+  } pending[KEYPOLL_MAX_DEVICES];
+  size_t n_pending;
+  struct kp_thread *thread;
+  /* Recording */
+  FILE *record;
+  unsigned long record_base;
+  /* Replay, records point into the mapping */
+  void *replay_map;
+  size_t replay_map_size;
+  const struct kp_record *replay;
+  size_t replay_len;
+  size_t replay_pos;
 };
 
 #else
@@ -206,7 +249,23 @@ struct kp_os_details {
 
 struct kp_ctx {
   size_t n_devices;
-  unsigned char keymap[KP_MAX_KEYS];
+  /* Number of kp_update calls so far */
+  unsigned long frame;
+  /* One bit per enum kp_key. pressed and released only hold for the
+   * frame the change happened in, changed lists the keys to clear */
+  struct {
+    uint32_t down[KP_KEY_WORDS];
+    uint32_t pressed[KP_KEY_WORDS];
+    uint32_t released[KP_KEY_WORDS];
+    size_t n_changed;
+    unsigned char changed[KP_MAX_KEYS];
+    /* Edges seen by kp_latch, moved over by the next kp_update */
+    int latching;
+    uint32_t late_pressed[KP_KEY_WORDS];
+    uint32_t late_released[KP_KEY_WORDS];
+    size_t n_late;
+    unsigned char late[KP_MAX_KEYS];
+  } keys;
   struct {
     long active_slot;
     struct {
@@ -217,9 +276,12 @@ struct kp_ctx {
       int32_t prev_y;
     } slots[KEYPOLL_MAX_MT_SLOTS];
   } mt;
+  /* dx and dy are this frame's motion, x and y the sum of all motion */
   struct {
     int32_t dx;
     int32_t dy;
+    long x;
+    long y;
   } mouse;
   struct {
     int32_t stick_x;
@@ -231,6 +293,21 @@ struct kp_ctx {
     int32_t stick_y;
     int32_t trigger;
   } right;
+  /* Reset by every kp_update */
+  struct {
+    size_t syscalls;
+    size_t events;
+    /* Events the input thread had no room for */
+    size_t dropped;
+  } stats;
+  /* Kernel timestamps, in timer_now_ns time, of the key and button presses
+   * and releases consumed this frame. Reset by every kp_update */
+  struct {
+    size_t n;
+    uint64_t ns[KEYPOLL_MAX_STAMPS];
+  } stamps;
+  /* The input thread's totals, filled in by kp_stop_thread */
+  struct thread_stats thread_stats;
   struct kp_os_details os;
 };
 
@@ -238,5 +315,26 @@ struct kp_ctx {
 int kp_init(struct kp_ctx *kp);
 void kp_deinit(struct kp_ctx *kp);
 void kp_update(struct kp_ctx *kp);
+/* Picks up events that arrived since kp_update without starting a new
+ * frame. Meant to run right before submitting, key edges it sees are
+ * still reported by the next kp_update */
+void kp_latch(struct kp_ctx *kp);
+/* Moves device reads to a thread that blocks on the devices and queues
+ * events for kp_update, so input is collected even while a frame stalls.
+ * config can be NULL */
+int kp_start_thread(struct kp_ctx *kp, struct thread_config *config);
+void kp_stop_thread(struct kp_ctx *kp);
+/* Readable whenever kp_update has input to pick up, for sleeping until
+ * something happens. Changes when the input thread starts or stops, -1
+ * while replaying */
+int kp_fd(struct kp_ctx *kp);
+/* Logs every event kp_update processes, tagged with its frame relative to
+ * the start of the recording */
+int kp_record_start(struct kp_ctx *kp, char *path);
+void kp_record_stop(struct kp_ctx *kp);
+/* Initializes kp to play a recording back instead of opening devices.
+ * Each kp_update applies the events recorded for that frame */
+int kp_replay_init(struct kp_ctx *kp, char *path);
+int kp_replay_finished(struct kp_ctx *kp);
 
 #endif
@@ -16,161 +16,279 @@
  * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+/* madvise */
+#define _DEFAULT_SOURCE
+
 #include "keypoll.h"
 #include "error.h"
 #include "sized_types.h"
 #include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-size_t get_key_index(int code) {
-  switch (code) {
-  case KEY_RESERVED: return KP_KEY_RESERVED;
-  case KEY_ESC: return KP_KEY_ESC;
-  case KEY_1: return KP_KEY_1;
-  case KEY_2: return KP_KEY_2;
-  case KEY_3: return KP_KEY_3;
-  case KEY_4: return KP_KEY_4;
-  case KEY_5: return KP_KEY_5;
-  case KEY_6: return KP_KEY_6;
-  case KEY_7: return KP_KEY_7;
-  case KEY_8: return KP_KEY_8;
-  case KEY_9: return KP_KEY_9;
-  case KEY_0: return KP_KEY_0;
-  case KEY_MINUS: return KP_KEY_MINUS;
-  case KEY_EQUAL: return KP_KEY_EQUAL;
-  case KEY_BACKSPACE: return KP_KEY_BACKSPACE;
-  case KEY_TAB: return KP_KEY_TAB;
-  case KEY_Q: return KP_KEY_Q;
-  case KEY_W: return KP_KEY_W;
-  case KEY_E: return KP_KEY_E;
-  case KEY_R: return KP_KEY_R;
-  case KEY_T: return KP_KEY_T;
-  case KEY_Y: return KP_KEY_Y;
-  case KEY_U: return KP_KEY_U;
-  case KEY_I: return KP_KEY_I;
-  case KEY_O: return KP_KEY_O;
-  case KEY_P: return KP_KEY_P;
-  case KEY_LEFTBRACE: return KP_KEY_LEFTBRACE;
-  case KEY_RIGHTBRACE: return KP_KEY_RIGHTBRACE;
-  case KEY_ENTER: return KP_KEY_ENTER;
-  case KEY_LEFTCTRL: return KP_KEY_LEFTCTRL;
-  case KEY_A: return KP_KEY_A;
-  case KEY_S: return KP_KEY_S;
-  case KEY_D: return KP_KEY_D;
-  case KEY_F: return KP_KEY_F;
-  case KEY_G: return KP_KEY_G;
-  case KEY_H: return KP_KEY_H;
-  case KEY_J: return KP_KEY_J;
-  case KEY_K: return KP_KEY_K;
-  case KEY_L: return KP_KEY_L;
-  case KEY_SEMICOLON: return KP_KEY_SEMICOLON;
-  case KEY_APOSTROPHE: return KP_KEY_APOSTROPHE;
-  case KEY_GRAVE: return KP_KEY_GRAVE;
-  case KEY_LEFTSHIFT: return KP_KEY_LEFTSHIFT;
-  case KEY_BACKSLASH: return KP_KEY_BACKSLASH;
-  case KEY_Z: return KP_KEY_Z;
-  case KEY_X: return KP_KEY_X;
-  case KEY_C: return KP_KEY_C;
-  case KEY_V: return KP_KEY_V;
-  case KEY_B: return KP_KEY_B;
-  case KEY_N: return KP_KEY_N;
-  case KEY_M: return KP_KEY_M;
-  case KEY_COMMA: return KP_KEY_COMMA;
-  case KEY_DOT: return KP_KEY_DOT;
-  case KEY_SLASH: return KP_KEY_SLASH;
-  case KEY_RIGHTSHIFT: return KP_KEY_RIGHTSHIFT;
-  case KEY_KPASTERISK: return KP_KEY_KPASTERISK;
-  case KEY_LEFTALT: return KP_KEY_LEFTALT;
-  case KEY_SPACE: return KP_KEY_SPACE;
-  case KEY_CAPSLOCK: return KP_KEY_CAPSLOCK;
-  case KEY_F1: return KP_KEY_F1;
-  case KEY_F2: return KP_KEY_F2;
-  case KEY_F3: return KP_KEY_F3;
-  case KEY_F4: return KP_KEY_F4;
-  case KEY_F5: return KP_KEY_F5;
-  case KEY_F6: return KP_KEY_F6;
-  case KEY_F7: return KP_KEY_F7;
-  case KEY_F8: return KP_KEY_F8;
-  case KEY_F9: return KP_KEY_F9;
-  case KEY_F10: return KP_KEY_F10;
-  case KEY_NUMLOCK: return KP_KEY_NUMLOCK;
-  case KEY_SCROLLLOCK: return KP_KEY_SCROLLLOCK;
-  case KEY_KP7: return KP_KEY_KP7;
-  case KEY_KP8: return KP_KEY_KP8;
-  case KEY_KP9: return KP_KEY_KP9;
-  case KEY_KPMINUS: return KP_KEY_KPMINUS;
-  case KEY_KP4: return KP_KEY_KP4;
-  case KEY_KP5: return KP_KEY_KP5;
-  case KEY_KP6: return KP_KEY_KP6;
-  case KEY_KPPLUS: return KP_KEY_KPPLUS;
-  case KEY_KP1: return KP_KEY_KP1;
-  case KEY_KP2: return KP_KEY_KP2;
-  case KEY_KP3: return KP_KEY_KP3;
-  case KEY_KP0: return KP_KEY_KP0;
-  case KEY_KPDOT: return KP_KEY_KPDOT;
-  case KEY_F11: return KP_KEY_F11;
-  case KEY_F12: return KP_KEY_F12;
-  case KEY_KPENTER: return KP_KEY_KPENTER;
-  case KEY_RIGHTCTRL: return KP_KEY_RIGHTCTRL;
-  case KEY_KPSLASH: return KP_KEY_KPSLASH;
-  case KEY_RIGHTALT: return KP_KEY_RIGHTALT;
-  case KEY_LINEFEED: return KP_KEY_LINEFEED;
-  case KEY_HOME: return KP_KEY_HOME;
-  case KEY_UP: return KP_KEY_UP;
-  case KEY_PAGEUP: return KP_KEY_PAGEUP;
-  case KEY_LEFT: return KP_KEY_LEFT;
-  case KEY_RIGHT: return KP_KEY_RIGHT;
-  case KEY_END: return KP_KEY_END;
-  case KEY_DOWN: return KP_KEY_DOWN;
-  case KEY_PAGEDOWN: return KP_KEY_PAGEDOWN;
-  case KEY_INSERT: return KP_KEY_INSERT;
-  case KEY_DELETE: return KP_KEY_DELETE;
-  case KEY_KPEQUAL: return KP_KEY_KPEQUAL;
-  case KEY_PAUSE: return KP_KEY_PAUSE;
-  case BTN_LEFT: return KP_BTN_LEFT;
-  case BTN_RIGHT: return KP_BTN_RIGHT;
-  case BTN_MIDDLE: return KP_BTN_MIDDLE;
-  case BTN_SIDE: return KP_BTN_SIDE;
-  case BTN_EXTRA: return KP_BTN_EXTRA;
-  case BTN_FORWARD: return KP_BTN_FORWARD;
-  case BTN_BACK: return KP_BTN_BACK;
-  case BTN_TASK: return KP_BTN_TASK;
-  case BTN_TRIGGER: return KP_BTN_TRIGGER;
-  case BTN_THUMB: return KP_BTN_THUMB;
-  case BTN_THUMB2: return KP_BTN_THUMB2;
-  case BTN_TOP: return KP_BTN_TOP;
-  case BTN_TOP2: return KP_BTN_TOP2;
-  case BTN_PINKIE: return KP_BTN_PINKIE;
-  case BTN_BASE: return KP_BTN_BASE;
-  case BTN_BASE2: return KP_BTN_BASE2;
-  case BTN_BASE3: return KP_BTN_BASE3;
-  case BTN_BASE4: return KP_BTN_BASE4;
-  case BTN_BASE5: return KP_BTN_BASE5;
-  case BTN_BASE6: return KP_BTN_BASE6;
-  case BTN_DEAD: return KP_BTN_DEAD;
-  case BTN_SOUTH: return KP_BTN_SOUTH;
-  case BTN_EAST: return KP_BTN_EAST;
-  case BTN_NORTH: return KP_BTN_NORTH;
-  case BTN_WEST: return KP_BTN_WEST;
-  case BTN_Z: return KP_BTN_Z;
-  case BTN_TL: return KP_BTN_TL;
-  case BTN_TR: return KP_BTN_TR;
-  case BTN_TL2: return KP_BTN_TL2;
-  case BTN_TR2: return KP_BTN_TR2;
-  case BTN_SELECT: return KP_BTN_SELECT;
-  case BTN_START: return KP_BTN_START;
-  case BTN_MODE: return KP_BTN_MODE;
-  case BTN_THUMBL: return KP_BTN_THUMBL;
-  case BTN_THUMBR: return KP_BTN_THUMBR;
-  case BTN_DPAD_UP: return KP_BTN_DPAD_UP;
-  case BTN_DPAD_DOWN: return KP_BTN_DPAD_DOWN;
-  case BTN_DPAD_LEFT: return KP_BTN_DPAD_LEFT;
-  case BTN_DPAD_RIGHT: return KP_BTN_DPAD_RIGHT;
+#define KEYPOLL_DIR "/dev/input/by-path/"
+#define KEYPOLL_RECORD_MAGIC "KPRL"
+
+enum {
+  KEYPOLL_CACHE_LINE = 64,
+  KEYPOLL_READ_BATCH = 64,
+  /* Pending devices are retried every KEYPOLL_RETRY_FRAMES kp_updates, up
+   * to KEYPOLL_MAX_RETRIES times */
+  KEYPOLL_RETRY_FRAMES = 30,
+  KEYPOLL_MAX_RETRIES = 10,
+  KEYPOLL_RECORD_VERSION = 1
+};
+
+/* Recordings are a header followed by packed records, native byte order */
+struct kp_record_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+struct kp_record {
+  uint32_t frame;
+  uint16_t type;
+  uint16_t code;
+  int32_t value;
+};
+
+/* Single producer (the input thread), single consumer (kp_update) ring of
+ * raw events, kernel timestamps included.
+ * Each side owns one index on its own cache line and publishes it with a
+ * release store, the other side reads it with an acquire load */
+struct kp_thread {
+  struct {
+    size_t head;
+    unsigned char pad[KEYPOLL_CACHE_LINE - sizeof(size_t)];
+  } producer;
+  struct {
+    size_t tail;
+    unsigned char pad[KEYPOLL_CACHE_LINE - sizeof(size_t)];
+  } consumer;
+  size_t dropped;
+  /* Set by the thread when the one-shot inotify watch fires */
+  int hotplug;
+  pthread_t thread;
+  int shutdown_fd;
+  /* Bumped after each batch so a sleeping main thread can wait on it */
+  int wake_fd;
+  /* Device fds the main thread removed. The thread closes them between
+   * batches, until then their numbers can't be reused for a new device
+   * while an old ready entry still names them. reap_fd wakes it to */
+  int closing[KEYPOLL_MAX_DEVICES];
+  size_t closing_head;
+  size_t closing_tail;
+  int reap_fd;
+  struct thread_config config;
+  struct thread_stats stats;
+  struct input_event ring[KEYPOLL_RING_SIZE];
+};
+
+/* evdev code to enum kp_key, one table per run of codes we care about.
+ * Holes map to KP_KEY_BLANK */
+static const unsigned char key_table[KEY_PAUSE + 1] = {
+  KP_KEY_RESERVED,
+  KP_KEY_ESC,
+  KP_KEY_1,
+  KP_KEY_2,
+  KP_KEY_3,
+  KP_KEY_4,
+  KP_KEY_5,
+  KP_KEY_6,
+  KP_KEY_7,
+  KP_KEY_8,
+  KP_KEY_9,
+  KP_KEY_0,
+  KP_KEY_MINUS,
+  KP_KEY_EQUAL,
+  KP_KEY_BACKSPACE,
+  KP_KEY_TAB,
+  KP_KEY_Q,
+  KP_KEY_W,
+  KP_KEY_E,
+  KP_KEY_R,
+  KP_KEY_T,
+  KP_KEY_Y,
+  KP_KEY_U,
+  KP_KEY_I,
+  KP_KEY_O,
+  KP_KEY_P,
+  KP_KEY_LEFTBRACE,
+  KP_KEY_RIGHTBRACE,
+  KP_KEY_ENTER,
+  KP_KEY_LEFTCTRL,
+  KP_KEY_A,
+  KP_KEY_S,
+  KP_KEY_D,
+  KP_KEY_F,
+  KP_KEY_G,
+  KP_KEY_H,
+  KP_KEY_J,
+  KP_KEY_K,
+  KP_KEY_L,
+  KP_KEY_SEMICOLON,
+  KP_KEY_APOSTROPHE,
+  KP_KEY_GRAVE,
+  KP_KEY_LEFTSHIFT,
+  KP_KEY_BACKSLASH,
+  KP_KEY_Z,
+  KP_KEY_X,
+  KP_KEY_C,
+  KP_KEY_V,
+  KP_KEY_B,
+  KP_KEY_N,
+  KP_KEY_M,
+  KP_KEY_COMMA,
+  KP_KEY_DOT,
+  KP_KEY_SLASH,
+  KP_KEY_RIGHTSHIFT,
+  KP_KEY_KPASTERISK,
+  KP_KEY_LEFTALT,
+  KP_KEY_SPACE,
+  KP_KEY_CAPSLOCK,
+  KP_KEY_F1,
+  KP_KEY_F2,
+  KP_KEY_F3,
+  KP_KEY_F4,
+  KP_KEY_F5,
+  KP_KEY_F6,
+  KP_KEY_F7,
+  KP_KEY_F8,
+  KP_KEY_F9,
+  KP_KEY_F10,
+  KP_KEY_NUMLOCK,
+  KP_KEY_SCROLLLOCK,
+  KP_KEY_KP7,
+  KP_KEY_KP8,
+  KP_KEY_KP9,
+  KP_KEY_KPMINUS,
+  KP_KEY_KP4,
+  KP_KEY_KP5,
+  KP_KEY_KP6,
+  KP_KEY_KPPLUS,
+  KP_KEY_KP1,
+  KP_KEY_KP2,
+  KP_KEY_KP3,
+  KP_KEY_KP0,
+  KP_KEY_KPDOT,
+  KP_KEY_BLANK,  /* 84 */
+  KP_KEY_BLANK,  /* KEY_ZENKAKUHANKAKU */
+  KP_KEY_BLANK,  /* KEY_102ND */
+  KP_KEY_F11,
+  KP_KEY_F12,
+  KP_KEY_BLANK,  /* KEY_RO */
+  KP_KEY_BLANK,  /* KEY_KATAKANA */
+  KP_KEY_BLANK,  /* KEY_HIRAGANA */
+  KP_KEY_BLANK,  /* KEY_HENKAN */
+  KP_KEY_BLANK,  /* KEY_KATAKANAHIRAGANA */
+  KP_KEY_BLANK,  /* KEY_MUHENKAN */
+  KP_KEY_BLANK,  /* KEY_KPJPCOMMA */
+  KP_KEY_KPENTER,
+  KP_KEY_RIGHTCTRL,
+  KP_KEY_KPSLASH,
+  KP_KEY_BLANK,  /* KEY_SYSRQ */
+  KP_KEY_RIGHTALT,
+  KP_KEY_LINEFEED,
+  KP_KEY_HOME,
+  KP_KEY_UP,
+  KP_KEY_PAGEUP,
+  KP_KEY_LEFT,
+  KP_KEY_RIGHT,
+  KP_KEY_END,
+  KP_KEY_DOWN,
+  KP_KEY_PAGEDOWN,
+  KP_KEY_INSERT,
+  KP_KEY_DELETE,
+  KP_KEY_BLANK,  /* KEY_MACRO */
+  KP_KEY_BLANK,  /* KEY_MUTE */
+  KP_KEY_BLANK,  /* KEY_VOLUMEDOWN */
+  KP_KEY_BLANK,  /* KEY_VOLUMEUP */
+  KP_KEY_BLANK,  /* KEY_POWER */
+  KP_KEY_KPEQUAL,
+  KP_KEY_BLANK,  /* KEY_KPPLUSMINUS */
+  KP_KEY_PAUSE
+};
+
+static const unsigned char btn_table[BTN_THUMBR - BTN_LEFT + 1] = {
+  KP_BTN_LEFT,
+  KP_BTN_RIGHT,
+  KP_BTN_MIDDLE,
+  KP_BTN_SIDE,
+  KP_BTN_EXTRA,
+  KP_BTN_FORWARD,
+  KP_BTN_BACK,
+  KP_BTN_TASK,
+  KP_KEY_BLANK,  /* 0x118 */
+  KP_KEY_BLANK,  /* 0x119 */
+  KP_KEY_BLANK,  /* 0x11a */
+  KP_KEY_BLANK,  /* 0x11b */
+  KP_KEY_BLANK,  /* 0x11c */
+  KP_KEY_BLANK,  /* 0x11d */
+  KP_KEY_BLANK,  /* 0x11e */
+  KP_KEY_BLANK,  /* 0x11f */
+  KP_BTN_TRIGGER,
+  KP_BTN_THUMB,
+  KP_BTN_THUMB2,
+  KP_BTN_TOP,
+  KP_BTN_TOP2,
+  KP_BTN_PINKIE,
+  KP_BTN_BASE,
+  KP_BTN_BASE2,
+  KP_BTN_BASE3,
+  KP_BTN_BASE4,
+  KP_BTN_BASE5,
+  KP_BTN_BASE6,
+  KP_KEY_BLANK,  /* 0x12c */
+  KP_KEY_BLANK,  /* 0x12d */
+  KP_KEY_BLANK,  /* 0x12e */
+  KP_BTN_DEAD,
+  KP_BTN_SOUTH,
+  KP_BTN_EAST,
+  KP_KEY_BLANK,  /* BTN_C */
+  KP_BTN_NORTH,
+  KP_BTN_WEST,
+  KP_BTN_Z,
+  KP_BTN_TL,
+  KP_BTN_TR,
+  KP_BTN_TL2,
+  KP_BTN_TR2,
+  KP_BTN_SELECT,
+  KP_BTN_START,
+  KP_BTN_MODE,
+  KP_BTN_THUMBL,
+  KP_BTN_THUMBR
+};
+
+static const unsigned char dpad_table[BTN_DPAD_RIGHT - BTN_DPAD_UP + 1] = {
+  KP_BTN_DPAD_UP,
+  KP_BTN_DPAD_DOWN,
+  KP_BTN_DPAD_LEFT,
+  KP_BTN_DPAD_RIGHT
+};
+
+static size_t get_key_index(int code) {
+  if (code >= 0 && code <= KEY_PAUSE) return key_table[code];
+  if (code >= BTN_LEFT && code <= BTN_THUMBR) {
+    return btn_table[code - BTN_LEFT];
+  }
+  if (code >= BTN_DPAD_UP && code <= BTN_DPAD_RIGHT) {
+    return dpad_table[code - BTN_DPAD_UP];
   }
   return KP_KEY_BLANK;
 }
@@ -205,52 +323,474 @@ static int supported_device(char *name) {
   return 0;
 }
 
-static int process_devices(
-  struct kp_ctx *kp,
-  size_t n_devices,
-  char **devices
-) {
-  enum {
-    filepath_end = 19
-  };
-
-  char filepath[256] = "/dev/input/by-path/";
-  size_t i;
+static int open_device(struct kp_ctx *kp, char *name) {
+  char path[sizeof(KEYPOLL_DIR) + KEYPOLL_MAX_NAME];
+  int fd, clock = CLOCK_MONOTONIC;
+  struct epoll_event ev = { 0 };
 
-  kp->n_devices = n_devices;
-  for (i = 0; i < n_devices; ++i) {
-    strcat(filepath, devices[i]);
-    kp->os.fds[i] = open(filepath, O_RDONLY | O_NONBLOCK);
-    /* we're going to reuse filepath for each device */
-    filepath[filepath_end] = '\0';
-    if (kp->os.fds[i] < 0) goto err;
-    continue;
-
-  err:
-    /* close all previous file descriptors */
-    while (i--) close(kp->os.fds[i]);
+  /* Out of slots is not worth retrying */
+  if (kp->n_devices >= KEYPOLL_MAX_DEVICES) return 0;
+  strcpy(path, KEYPOLL_DIR);
+  strcat(path, name);
+  fd = open(path, O_RDONLY | O_NONBLOCK);
+  if (fd < 0) return -1;
+  /* Event times default to the wall clock, which can jump. Not fatal if
+   * the kernel refuses, the stamps just won't line up with timer.h */
+  ioctl(fd, EVIOCSCLOCKID, &clock);
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(kp->os.epfd, EPOLL_CTL_ADD, fd, &ev)) {
+    close(fd);
     return -1;
   }
+  kp->os.fds[kp->n_devices] = fd;
+  strcpy(kp->os.names[kp->n_devices], name);
+  ++kp->n_devices;
   return 0;
 }
 
+static void add_device(struct kp_ctx *kp, char *name) {
+  size_t i;
+
+  if (strlen(name) >= KEYPOLL_MAX_NAME) return;
+  for (i = 0; i < kp->n_devices; ++i) {
+    if (!strcmp(kp->os.names[i], name)) return;
+  }
+  if (!open_device(kp, name)) return;
+  for (i = 0; i < kp->os.n_pending; ++i) {
+    if (!strcmp(kp->os.pending[i].name, name)) return;
+  }
+  if (kp->os.n_pending >= KEYPOLL_MAX_DEVICES) return;
+  strcpy(kp->os.pending[kp->os.n_pending].name, name);
+  kp->os.pending[kp->os.n_pending].tries = 0;
+  ++kp->os.n_pending;
+}
+
+/* Closes what the main thread handed over, on the input thread between
+ * batches or after it stopped */
+static void reap_closed(struct kp_thread *t) {
+  size_t head, tail;
+
+  head = __atomic_load_n(&t->closing_head, __ATOMIC_ACQUIRE);
+  tail = __atomic_load_n(&t->closing_tail, __ATOMIC_RELAXED);
+  for (; tail != head; ++tail) {
+    close(t->closing[tail % KEYPOLL_MAX_DEVICES]);
+  }
+  __atomic_store_n(&t->closing_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void close_device_fd(struct kp_ctx *kp, int fd) {
+  struct kp_thread *t = kp->os.thread;
+  size_t head;
+  uint64_t one = 1;
+
+  if (!t) {
+    close(fd);
+    return;
+  }
+  head = __atomic_load_n(&t->closing_head, __ATOMIC_RELAXED);
+  /* Only full after a burst of removals, the thread empties it as soon
+   * as it sees reap_fd */
+  while (
+    head - __atomic_load_n(&t->closing_tail, __ATOMIC_ACQUIRE)
+    >= KEYPOLL_MAX_DEVICES
+  ) {
+    sched_yield();
+  }
+  t->closing[head % KEYPOLL_MAX_DEVICES] = fd;
+  __atomic_store_n(&t->closing_head, head + 1, __ATOMIC_RELEASE);
+  /* Only fails if the counter would overflow, it is readable then */
+  write(t->reap_fd, &one, sizeof(one));
+}
+
+static void remove_device(struct kp_ctx *kp, size_t i) {
+  /* Out of the epoll set no later epoll_wait returns it, but the input
+   * thread may still hold it from the current one. The close waits for
+   * that batch to finish */
+  epoll_ctl(kp->os.epfd, EPOLL_CTL_DEL, kp->os.fds[i], NULL);
+  close_device_fd(kp, kp->os.fds[i]);
+  --kp->n_devices;
+  if (i == kp->n_devices) return;
+  kp->os.fds[i] = kp->os.fds[kp->n_devices];
+  strcpy(kp->os.names[i], kp->os.names[kp->n_devices]);
+}
+
+static void remove_device_fd(struct kp_ctx *kp, int fd) {
+  size_t i;
+
+  for (i = 0; i < kp->n_devices; ++i) {
+    if (kp->os.fds[i] == fd) {
+      remove_device(kp, i);
+      return;
+    }
+  }
+}
+
+static void remove_device_name(struct kp_ctx *kp, char *name) {
+  size_t i;
+
+  for (i = 0; i < kp->n_devices; ++i) {
+    if (!strcmp(kp->os.names[i], name)) {
+      remove_device(kp, i);
+      break;
+    }
+  }
+  for (i = 0; i < kp->os.n_pending; ++i) {
+    if (!strcmp(kp->os.pending[i].name, name)) {
+      kp->os.pending[i] = kp->os.pending[--kp->os.n_pending];
+      break;
+    }
+  }
+}
+
+static void retry_pending(struct kp_ctx *kp) {
+  size_t i = 0;
+
+  while (i < kp->os.n_pending) {
+    if (
+      !open_device(kp, kp->os.pending[i].name)
+      || ++kp->os.pending[i].tries >= KEYPOLL_MAX_RETRIES
+    ) {
+      kp->os.pending[i] = kp->os.pending[--kp->os.n_pending];
+      continue;
+    }
+    ++i;
+  }
+}
+
+static void handle_hotplug(struct kp_ctx *kp) {
+  union {
+    struct inotify_event event;
+    char buf[4096];
+  } u;
+  ssize_t rc;
+  struct epoll_event ev = { 0 };
+
+  /* udev creates the by-path links under a temporary name and renames
+   * them into place, so moves count as well */
+  while ((rc = read(kp->os.inotify_fd, u.buf, sizeof(u.buf))) > 0) {
+    char *p = u.buf;
+
+    ++kp->stats.syscalls;
+    while (p < u.buf + rc) {
+      struct inotify_event *e = (struct inotify_event *) p;
+
+      if (e->len && supported_device(e->name)) {
+        if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+          add_device(kp, e->name);
+        } else {
+          remove_device_name(kp, e->name);
+        }
+      }
+      p += sizeof(struct inotify_event) + e->len;
+    }
+  }
+  ++kp->stats.syscalls;
+  /* The watch is one-shot so the input thread never spins on it, re-arm
+   * it now that the queue is empty */
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = kp->os.inotify_fd;
+  epoll_ctl(kp->os.epfd, EPOLL_CTL_MOD, kp->os.inotify_fd, &ev);
+  ++kp->stats.syscalls;
+}
+
+static void init_hotplug(struct kp_ctx *kp) {
+  struct epoll_event ev = { 0 };
+
+  /* Hotplug is best effort, without it we keep the devices found now */
+  kp->os.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (kp->os.inotify_fd < 0) return;
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = kp->os.inotify_fd;
+  if (
+    inotify_add_watch(
+      kp->os.inotify_fd,
+      KEYPOLL_DIR,
+      IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM
+    ) < 0
+    || epoll_ctl(kp->os.epfd, EPOLL_CTL_ADD, kp->os.inotify_fd, &ev)
+  ) {
+    close(kp->os.inotify_fd);
+    kp->os.inotify_fd = -1;
+  }
+}
+
 static void update_states(struct kp_ctx *kp) {
   size_t i;
 
-  /* advance the state from KP_STATE_PRESSED to KP_STATE_HELD */
-  for (i = 0; i < KP_MAX_KEYS; ++i) {
-    kp->keymap[i] =
-      (unsigned char) (kp->keymap[i] + (kp->keymap[i] == 1));
+  /* Only keys that changed last frame have pressed or released bits to
+   * clear */
+  for (i = 0; i < kp->keys.n_changed; ++i) {
+    size_t k = kp->keys.changed[i];
+    uint32_t bit = (uint32_t) 1 << (k % 32);
+
+    kp->keys.pressed[k / 32] &= ~bit;
+    kp->keys.released[k / 32] &= ~bit;
+  }
+  /* Latched edges only made it into the uniforms, game code sees them
+   * this frame */
+  for (i = 0; i < kp->keys.n_late; ++i) {
+    size_t k = kp->keys.late[i];
+    uint32_t bit = (uint32_t) 1 << (k % 32);
+
+    kp->keys.pressed[k / 32] |= kp->keys.late_pressed[k / 32] & bit;
+    kp->keys.released[k / 32] |= kp->keys.late_released[k / 32] & bit;
+    kp->keys.late_pressed[k / 32] &= ~bit;
+    kp->keys.late_released[k / 32] &= ~bit;
+    kp->keys.changed[i] = (unsigned char) k;
   }
+  kp->keys.n_changed = kp->keys.n_late;
+  kp->keys.n_late = 0;
+  kp->mouse.dx = 0;
+  kp->mouse.dy = 0;
+}
+
+static void set_key(struct kp_ctx *kp, int code, int value) {
+  size_t k, word, *n_changed = &kp->keys.n_changed;
+  uint32_t bit, *edge;
+  uint32_t *pressed = kp->keys.pressed, *released = kp->keys.released;
+  unsigned char *changed = kp->keys.changed;
+
+  if (kp->keys.latching) {
+    n_changed = &kp->keys.n_late;
+    pressed = kp->keys.late_pressed;
+    released = kp->keys.late_released;
+    changed = kp->keys.late;
+  }
+  k = get_key_index(code);
+  if (k == KP_KEY_BLANK) return;
+  word = k / 32;
+  bit = (uint32_t) 1 << (k % 32);
+  if (value) {
+    if (kp->keys.down[word] & bit) return;
+    kp->keys.down[word] |= bit;
+    /* A repeat (2) for a key we never saw go down still counts as held,
+     * but not as a press */
+    if (value != 1) return;
+    edge = pressed;
+  } else {
+    if (!(kp->keys.down[word] & bit)) return;
+    kp->keys.down[word] &= ~bit;
+    edge = released;
+  }
+  /* Each key goes on the changed list at most once per frame */
+  if (!((pressed[word] | released[word]) & bit)) {
+    changed[(*n_changed)++] = (unsigned char) k;
+  }
+  edge[word] |= bit;
+}
+
+static void record_event(struct kp_ctx *kp, struct input_event *e) {
+  struct kp_record r;
+
+  r.frame = (uint32_t) (kp->frame - kp->os.record_base);
+  /* Game code sees latched events on the next frame, so that is where
+   * replay has to apply them */
+  if (kp->keys.latching) ++r.frame;
+  r.type = e->type;
+  r.code = e->code;
+  r.value = e->value;
+  /* stdio does the batching, a failed write ends the recording */
+  if (fwrite(&r, sizeof(r), 1, kp->os.record) != 1) kp_record_stop(kp);
+}
+
+static void stamp_event(struct kp_ctx *kp, struct input_event *e) {
+  /* Replayed events carry no time */
+  if (!e->time.tv_sec && !e->time.tv_usec) return;
+  if (kp->stamps.n >= KEYPOLL_MAX_STAMPS) return;
+  kp->stamps.ns[kp->stamps.n++] =
+    (uint64_t) e->time.tv_sec * 1000000000UL +
+    (uint64_t) e->time.tv_usec * 1000UL;
 }
 
-static void set_keymap(struct kp_ctx *kp, int code, int value) {
-  /*
-   * On Linux, key repeat events are 2 which is the same as
-   * our KP_STATE_PRESSED, so we don't have to filter them out
-   * here
-   */
-  kp->keymap[get_key_index(code)] = (unsigned char) value;
+static void process_event(struct kp_ctx *kp, struct input_event *e) {
+  if (kp->os.record) record_event(kp, e);
+  switch (e->type) {
+  case EV_KEY:
+    /* Repeats are generated by the kernel, not the user */
+    if (e->value != 2) stamp_event(kp, e);
+    set_key(kp, e->code, e->value);
+    break;
+
+    /* gamepad analog sticks/triggers and multitouch */
+  case EV_ABS:
+    switch (e->code) {
+    case ABS_MT_SLOT:
+      kp->mt.active_slot = e->value;
+      break;
+    case ABS_MT_TRACKING_ID:
+      if (ABS_MT_TRACKING_ID > 0) {
+        kp->mt.slots[kp->mt.active_slot].id = e->value;
+      }
+      else {
+        kp->mt.slots[kp->mt.active_slot].id = e->value;
+      }
+      break;
+    case ABS_MT_POSITION_X:
+      if (kp->mt.active_slot != 0) break;
+      break;
+    case ABS_MT_POSITION_Y:
+      break;
+    case ABS_X: kp->left.stick_x = e->value; break;
+    case ABS_Y: kp->left.stick_y = e->value; break;
+    case ABS_Z: kp->left.trigger = e->value; break;
+    case ABS_RX: kp->right.stick_x = e->value; break;
+    case ABS_RY: kp->right.stick_y = e->value; break;
+    case ABS_RZ: kp->right.trigger = e->value; break;
+    }
+    break;
+
+    /* mouse movement */
+  case EV_REL:
+    switch (e->code) {
+    case REL_X:
+      kp->mouse.dx += e->value;
+      kp->mouse.x += e->value;
+      break;
+    case REL_Y:
+      kp->mouse.dy += e->value;
+      kp->mouse.y += e->value;
+      break;
+    }
+    break;
+  }
+}
+
+static void replay_frame(struct kp_ctx *kp) {
+  struct input_event e;
+
+  memset(&e, 0, sizeof(struct input_event));
+  while (kp->os.replay_pos < kp->os.replay_len) {
+    const struct kp_record *r = kp->os.replay + kp->os.replay_pos;
+
+    if (r->frame > kp->frame) break;
+    e.type = r->type;
+    e.code = r->code;
+    e.value = r->value;
+    process_event(kp, &e);
+    ++kp->os.replay_pos;
+    ++kp->stats.events;
+  }
+}
+
+static void ring_push(
+  struct kp_thread *t,
+  struct input_event *events,
+  size_t n
+) {
+  size_t head, tail, space, i;
+
+  head = __atomic_load_n(&t->producer.head, __ATOMIC_RELAXED);
+  tail = __atomic_load_n(&t->consumer.tail, __ATOMIC_ACQUIRE);
+  space = KEYPOLL_RING_SIZE - (head - tail);
+  if (n > space) {
+    __atomic_add_fetch(&t->dropped, n - space, __ATOMIC_RELAXED);
+    n = space;
+  }
+  for (i = 0; i < n; ++i) {
+    t->ring[(head + i) & (KEYPOLL_RING_SIZE - 1)] = events[i];
+  }
+  __atomic_store_n(&t->producer.head, head + n, __ATOMIC_RELEASE);
+}
+
+static void ring_drain(struct kp_ctx *kp) {
+  struct kp_thread *t = kp->os.thread;
+  size_t head, tail;
+
+  head = __atomic_load_n(&t->producer.head, __ATOMIC_ACQUIRE);
+  tail = __atomic_load_n(&t->consumer.tail, __ATOMIC_RELAXED);
+  kp->stats.events += head - tail;
+  for (; tail != head; ++tail) {
+    process_event(kp, t->ring + (tail & (KEYPOLL_RING_SIZE - 1)));
+  }
+  __atomic_store_n(&t->consumer.tail, tail, __ATOMIC_RELEASE);
+  kp->stats.dropped = __atomic_exchange_n(&t->dropped, 0, __ATOMIC_RELAXED);
+}
+
+static void read_devices(struct kp_ctx *kp) {
+  struct kp_thread *t = kp->os.thread;
+  struct epoll_event ready[KEYPOLL_MAX_DEVICES + 3];
+  struct input_event events[KEYPOLL_READ_BATCH];
+
+  for (;;) {
+    int i, n_ready;
+    uint64_t one = 1, count;
+
+    n_ready = epoll_wait(kp->os.epfd, ready, KEYPOLL_MAX_DEVICES + 3, -1);
+    if (n_ready < 0 && errno != EINTR) return;
+    for (i = 0; i < n_ready; ++i) {
+      ssize_t rc;
+
+      if (ready[i].data.fd == t->shutdown_fd) return;
+      if (ready[i].data.fd == kp->os.inotify_fd) {
+        /* Devices belong to the main thread, kp_update handles it */
+        __atomic_store_n(&t->hotplug, 1, __ATOMIC_RELEASE);
+        continue;
+      }
+      if (ready[i].data.fd == t->reap_fd) {
+        /* Closed below, later entries of this batch may be those fds */
+        if (read(t->reap_fd, &count, sizeof(count)) < 0) count = 0;
+        continue;
+      }
+      do {
+        rc = read(ready[i].data.fd, events, sizeof(events));
+        if (rc <= 0) break;
+        ring_push(t, events, (size_t) rc / sizeof(struct input_event));
+      } while ((size_t) rc == sizeof(events));
+      if (rc < 0 && errno != EAGAIN && errno != EINTR) {
+        /* Unplugged. Stop polling it, kp_update closes it once inotify
+         * reports the removal */
+        epoll_ctl(kp->os.epfd, EPOLL_CTL_DEL, ready[i].data.fd, NULL);
+      }
+    }
+    /* Only fails if the counter would overflow, it is readable then */
+    if (n_ready > 0) write(t->wake_fd, &one, sizeof(one));
+    reap_closed(t);
+  }
+}
+
+static void *input_thread(void *arg) {
+  struct kp_ctx *kp = arg;
+  struct kp_thread *t = kp->os.thread;
+
+  /* Best effort, input arrives the same either way */
+  thread_configure(&t->config);
+  read_devices(kp);
+  thread_sample(&t->stats);
+  return NULL;
+}
+
+static void poll_devices(struct kp_ctx *kp) {
+  int i, n_ready;
+  struct epoll_event ready[KEYPOLL_MAX_DEVICES + 1];
+  struct input_event events[KEYPOLL_READ_BATCH];
+
+  /* Quiet devices never show up here, so they cost nothing */
+  n_ready = epoll_wait(kp->os.epfd, ready, KEYPOLL_MAX_DEVICES + 1, 0);
+  ++kp->stats.syscalls;
+  for (i = 0; i < n_ready; ++i) {
+    ssize_t rc;
+
+    if (ready[i].data.fd == kp->os.inotify_fd) {
+      handle_hotplug(kp);
+      continue;
+    }
+    do {
+      size_t j, n;
+
+      rc = read(ready[i].data.fd, events, sizeof(events));
+      ++kp->stats.syscalls;
+      if (rc <= 0) break;
+      n = (size_t) rc / sizeof(struct input_event);
+      for (j = 0; j < n; ++j) process_event(kp, events + j);
+      kp->stats.events += n;
+      /* A short read means the device is drained, skip the read that
+       * would only return EAGAIN */
+    } while ((size_t) rc == sizeof(events));
+    if (rc < 0 && errno != EAGAIN && errno != EINTR) {
+      remove_device_fd(kp, ready[i].data.fd);
+    }
+  }
 }
 
 /* **************************************** */
@@ -258,80 +798,251 @@ static void set_keymap(struct kp_ctx *kp, int code, int value) {
 /* **************************************** */
 
 int kp_init(struct kp_ctx *kp) {
-  char *devices[KEYPOLL_MAX_DEVICES] = { 0 };
-  size_t n_devices = 0;
   DIR *input_dir = NULL;
   struct dirent *input = NULL;
 
   if (!kp) return KEYPOLL_ERROR_NULL;
   memset(kp, 0, sizeof(struct kp_ctx));
-  input_dir = opendir("/dev/input/by-path/");
-  if (!input_dir) return KEYPOLL_ERROR_INVALID_DIR;
+  kp->os.inotify_fd = -1;
+  kp->os.epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (kp->os.epfd < 0) return KEYPOLL_ERROR_EPOLL;
+  /* Watch before scanning so nothing plugged in between is missed */
+  init_hotplug(kp);
+  input_dir = opendir(KEYPOLL_DIR);
+  if (!input_dir) {
+    kp_deinit(kp);
+    return KEYPOLL_ERROR_INVALID_DIR;
+  }
   while ((input = readdir(input_dir))) {
     if (!supported_device(input->d_name)) continue;
-    if (n_devices >= KEYPOLL_MAX_DEVICES) break;
-    devices[n_devices++] = input->d_name;
+    add_device(kp, input->d_name);
   }
-  chkerr(process_devices(kp, n_devices, devices));
   closedir(input_dir);
-  kp->n_devices = n_devices;
   return KEYPOLL_ERROR_NONE;
 }
 
 void kp_deinit(struct kp_ctx *kp) {
-  size_t i;
-
   if (!kp) return;
-  for (i = 0; i < kp->n_devices; ++i) close(kp->os.fds[i]);
+  kp_stop_thread(kp);
+  kp_record_stop(kp);
+  if (kp->os.replay_map) {
+    munmap(kp->os.replay_map, kp->os.replay_map_size);
+    kp->os.replay_map = NULL;
+    kp->os.replay = NULL;
+  }
+  while (kp->n_devices) remove_device(kp, kp->n_devices - 1);
+  if (kp->os.inotify_fd >= 0) close(kp->os.inotify_fd);
+  if (kp->os.epfd >= 0) close(kp->os.epfd);
+  kp->os.inotify_fd = -1;
+  kp->os.epfd = -1;
 }
 
 void kp_update(struct kp_ctx *kp) {
   /* no null check */
-  size_t i;
-
+  kp->stats.syscalls = 0;
+  kp->stats.events = 0;
+  kp->stamps.n = 0;
+  ++kp->frame;
   update_states(kp);
-  for (i = 0; i < kp->n_devices; ++i) {
-    ssize_t rc;
-    struct input_event e;
-
-    while ((rc = read(kp->os.fds[i], &e, sizeof(struct input_event))) > 0) {
-      switch (e.type) {
-      case EV_KEY:
-        set_keymap(kp, e.code, e.value);
-        break;
-
-        /* gamepad analog sticks/triggers and multitouch */
-      case EV_ABS:
-        switch (e.code) {
-        case ABS_MT_SLOT:
-          kp->mt.active_slot = e.value;
-          break;
-        case ABS_MT_TRACKING_ID:
-          if (ABS_MT_TRACKING_ID > 0) {
-            kp->mt.slots[kp->mt.active_slot].id = e.value;
-          }
-          else {
-            kp->mt.slots[kp->mt.active_slot].id = e.value;
-          }
-          break;
-        case ABS_MT_POSITION_X:
-          if (kp->mt.active_slot != 0) break;
-          break;
-        case ABS_MT_POSITION_Y:
-          break;
-        case ABS_X: kp->left.stick_x = e.value; break;
-        case ABS_Y: kp->left.stick_y = e.value; break;
-        case ABS_Z: kp->left.trigger = e.value; break;
-        case ABS_RX: kp->right.stick_x = e.value; break;
-        case ABS_RY: kp->right.stick_y = e.value; break;
-        case ABS_RZ: kp->right.trigger = e.value; break;
-        }
-        break;
+  if (kp->os.replay) {
+    replay_frame(kp);
+    return;
+  }
+  if (kp->os.n_pending && kp->frame % KEYPOLL_RETRY_FRAMES == 0) {
+    retry_pending(kp);
+  }
+  if (kp->os.thread) {
+    uint64_t count;
 
-        /* mouse movement */
-      case EV_REL:
-        break;
-      }
+    /* Reset the wakeup before draining, anything pushed after this read
+     * sets it again */
+    if (read(kp->os.thread->wake_fd, &count, sizeof(count)) < 0) count = 0;
+    ++kp->stats.syscalls;
+    if (__atomic_exchange_n(&kp->os.thread->hotplug, 0, __ATOMIC_ACQUIRE)) {
+      handle_hotplug(kp);
     }
+    ring_drain(kp);
+    return;
+  }
+  poll_devices(kp);
+}
+
+void kp_latch(struct kp_ctx *kp) {
+  /* no null check */
+  if (kp->os.replay) return;
+  kp->keys.latching = 1;
+  if (kp->os.thread) {
+    ring_drain(kp);
+  } else {
+    poll_devices(kp);
+  }
+  kp->keys.latching = 0;
+}
+
+int kp_start_thread(struct kp_ctx *kp, struct thread_config *config) {
+  struct kp_thread *t;
+  struct epoll_event ev = { 0 };
+
+  if (!kp) return KEYPOLL_ERROR_NULL;
+  if (kp->os.thread) return KEYPOLL_ERROR_NONE;
+  if (kp->os.replay) return KEYPOLL_ERROR_THREAD;
+  t = calloc(1, sizeof(struct kp_thread));
+  if (!t) return KEYPOLL_ERROR_THREAD;
+  if (config) memcpy(&t->config, config, sizeof(struct thread_config));
+  else thread_config_default(&t->config, "input");
+  t->shutdown_fd = eventfd(0, EFD_CLOEXEC);
+  if (t->shutdown_fd < 0) goto err_eventfd;
+  t->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (t->wake_fd < 0) goto err_wake;
+  t->reap_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (t->reap_fd < 0) goto err_reap;
+  /* The thread owns the epoll set from here until kp_stop_thread */
+  ev.events = EPOLLIN;
+  ev.data.fd = t->shutdown_fd;
+  if (epoll_ctl(kp->os.epfd, EPOLL_CTL_ADD, t->shutdown_fd, &ev)) {
+    goto err_epoll;
   }
+  ev.data.fd = t->reap_fd;
+  if (epoll_ctl(kp->os.epfd, EPOLL_CTL_ADD, t->reap_fd, &ev)) {
+    goto err_epoll_reap;
+  }
+  kp->os.thread = t;
+  if (pthread_create(&t->thread, NULL, input_thread, kp)) goto err_thread;
+  return KEYPOLL_ERROR_NONE;
+
+ err_thread:
+  kp->os.thread = NULL;
+  epoll_ctl(kp->os.epfd, EPOLL_CTL_DEL, t->reap_fd, NULL);
+ err_epoll_reap:
+  epoll_ctl(kp->os.epfd, EPOLL_CTL_DEL, t->shutdown_fd, NULL);
+ err_epoll:
+  close(t->reap_fd);
+ err_reap:
+  close(t->wake_fd);
+ err_wake:
+  close(t->shutdown_fd);
+ err_eventfd:
+  free(t);
+  return KEYPOLL_ERROR_THREAD;
+}
+
+void kp_stop_thread(struct kp_ctx *kp) {
+  struct kp_thread *t;
+  uint64_t one = 1;
+
+  if (!kp || !kp->os.thread) return;
+  t = kp->os.thread;
+  if (write(t->shutdown_fd, &one, sizeof(one)) == sizeof(one)) {
+    pthread_join(t->thread, NULL);
+  } else {
+    pthread_cancel(t->thread);
+    pthread_join(t->thread, NULL);
+  }
+  epoll_ctl(kp->os.epfd, EPOLL_CTL_DEL, t->shutdown_fd, NULL);
+  epoll_ctl(kp->os.epfd, EPOLL_CTL_DEL, t->reap_fd, NULL);
+  close(t->shutdown_fd);
+  close(t->wake_fd);
+  close(t->reap_fd);
+  /* Removed while it ran but not closed yet */
+  reap_closed(t);
+  /* Whatever the thread queued or saw last still counts */
+  ring_drain(kp);
+  memcpy(&kp->thread_stats, &t->stats, sizeof(struct thread_stats));
+  kp->os.thread = NULL;
+  if (t->hotplug) handle_hotplug(kp);
+  free(t);
+}
+
+int kp_fd(struct kp_ctx *kp) {
+  if (!kp) return -1;
+  if (kp->os.replay) return -1;
+  if (kp->os.thread) return kp->os.thread->wake_fd;
+  /* An epoll set is readable whenever one of its fds is */
+  return kp->os.epfd;
+}
+
+int kp_record_start(struct kp_ctx *kp, char *path) {
+  struct kp_record_header header;
+
+  if (!kp) return KEYPOLL_ERROR_NULL;
+  if (!path) return KEYPOLL_ERROR_NULL;
+  kp_record_stop(kp);
+  kp->os.record = fopen(path, "wb");
+  if (!kp->os.record) return KEYPOLL_ERROR_FILE;
+  memset(&header, 0, sizeof(struct kp_record_header));
+  memcpy(header.magic, KEYPOLL_RECORD_MAGIC, sizeof(header.magic));
+  header.version = KEYPOLL_RECORD_VERSION;
+  header.record_size = sizeof(struct kp_record);
+  if (fwrite(&header, sizeof(header), 1, kp->os.record) != 1) {
+    kp_record_stop(kp);
+    return KEYPOLL_ERROR_FILE;
+  }
+  kp->os.record_base = kp->frame;
+  return KEYPOLL_ERROR_NONE;
+}
+
+void kp_record_stop(struct kp_ctx *kp) {
+  struct kp_record end = { 0 };
+  FILE *record;
+
+  if (!kp || !kp->os.record) return;
+  record = kp->os.record;
+  kp->os.record = NULL;
+  /* A trailing EV_SYN keeps replays running as many frames as the
+   * recording did, even when the last frames had no input */
+  end.frame = (uint32_t) (kp->frame - kp->os.record_base);
+  end.type = EV_SYN;
+  end.code = SYN_REPORT;
+  fwrite(&end, sizeof(end), 1, record);
+  fclose(record);
+}
+
+int kp_replay_init(struct kp_ctx *kp, char *path) {
+  int fd;
+  size_t size;
+  void *map;
+  struct stat st;
+  const struct kp_record_header *header;
+
+  if (!kp) return KEYPOLL_ERROR_NULL;
+  if (!path) return KEYPOLL_ERROR_NULL;
+  memset(kp, 0, sizeof(struct kp_ctx));
+  kp->os.epfd = -1;
+  kp->os.inotify_fd = -1;
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return KEYPOLL_ERROR_FILE;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return KEYPOLL_ERROR_FILE;
+  }
+  size = (size_t) st.st_size;
+  if (size < sizeof(struct kp_record_header)) {
+    close(fd);
+    return KEYPOLL_ERROR_FORMAT;
+  }
+  /* Records are read straight out of the mapping, which outlives fd */
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return KEYPOLL_ERROR_FILE;
+  header = map;
+  if (
+    memcmp(header->magic, KEYPOLL_RECORD_MAGIC, sizeof(header->magic))
+    || header->version != KEYPOLL_RECORD_VERSION
+    || header->record_size != sizeof(struct kp_record)
+  ) {
+    munmap(map, size);
+    return KEYPOLL_ERROR_FORMAT;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+  kp->os.replay_map = map;
+  kp->os.replay_map_size = size;
+  kp->os.replay = (const struct kp_record *) (header + 1);
+  kp->os.replay_len =
+    (size - sizeof(struct kp_record_header)) / sizeof(struct kp_record);
+  return KEYPOLL_ERROR_NONE;
+}
+
+int kp_replay_finished(struct kp_ctx *kp) {
+  if (!kp || !kp->os.replay) return 0;
+  return kp->os.replay_pos >= kp->os.replay_len;
 }
@@ -0,0 +1,122 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "latency.h"
+#include <string.h>
+
+#define NS_TO_MS(ns) ((double) (ns) / 1e6)
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+void latency_reset(struct latency_hist *h) {
+  memset(h, 0, sizeof(struct latency_hist));
+}
+
+void latency_add(struct latency_hist *h, uint64_t ns) {
+  /* no null check */
+  uint64_t i = ns / LATENCY_BUCKET_NS;
+
+  if (i >= LATENCY_N_BUCKETS) i = LATENCY_N_BUCKETS - 1;
+  ++h->buckets[i];
+  if (!h->count || ns < h->min_ns) h->min_ns = ns;
+  if (ns > h->max_ns) h->max_ns = ns;
+  h->sum_ns += ns;
+  ++h->count;
+}
+
+void latency_add_events(
+  struct latency_hist *h,
+  const uint64_t *stamps,
+  size_t n,
+  uint64_t end_ns
+) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    if (stamps[i] > end_ns) continue;
+    latency_add(h, end_ns - stamps[i]);
+  }
+}
+
+uint64_t latency_percentile(struct latency_hist *h, unsigned int pct) {
+  size_t i;
+  uint64_t target, seen = 0;
+
+  if (!h->count) return 0;
+  /* Round up so p100 needs every sample */
+  target = ((uint64_t) h->count * pct + 99) / 100;
+  if (!target) target = 1;
+  for (i = 0; i < LATENCY_N_BUCKETS; ++i) {
+    seen += h->buckets[i];
+    if (seen >= target) break;
+  }
+  if (i == LATENCY_N_BUCKETS - 1) return h->max_ns;
+  return (uint64_t) (i + 1) * LATENCY_BUCKET_NS;
+}
+
+void latency_print(struct latency_hist *h, char *name, FILE *out) {
+  enum {
+    BAR_WIDTH = 40
+  };
+
+  size_t i;
+  uint32_t peak = 0;
+
+  if (!h->count) {
+    fprintf(out, "%s: no samples\n", name);
+    return;
+  }
+  fprintf(
+    out,
+    "%s: %lu samples, min %.2fms mean %.2fms p50 %.1fms p90 %.1fms "
+    "p99 %.1fms max %.2fms\n",
+    name,
+    (unsigned long) h->count,
+    NS_TO_MS(h->min_ns),
+    NS_TO_MS(h->sum_ns / h->count),
+    NS_TO_MS(latency_percentile(h, 50)),
+    NS_TO_MS(latency_percentile(h, 90)),
+    NS_TO_MS(latency_percentile(h, 99)),
+    NS_TO_MS(h->max_ns)
+  );
+  for (i = 0; i < LATENCY_N_BUCKETS; ++i) {
+    if (h->buckets[i] > peak) peak = h->buckets[i];
+  }
+  /* Only buckets that saw something, the range is mostly empty */
+  for (i = 0; i < LATENCY_N_BUCKETS; ++i) {
+    char bar[BAR_WIDTH + 1];
+    size_t len;
+
+    if (!h->buckets[i]) continue;
+    len = (size_t) h->buckets[i] * BAR_WIDTH / peak;
+    if (!len) len = 1;
+    memset(bar, '#', len);
+    bar[len] = '\0';
+    fprintf(
+      out,
+      "  %5.1fms%s %-*s %lu\n",
+      NS_TO_MS((uint64_t) i * LATENCY_BUCKET_NS),
+      i == LATENCY_N_BUCKETS - 1 ? "+" : " ",
+      BAR_WIDTH,
+      bar,
+      (unsigned long) h->buckets[i]
+    );
+  }
+}
@@ -0,0 +1,54 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "sized_types.h"
+#include <stddef.h>
+#include <stdio.h>
+
+enum {
+  /* 100us buckets out to 50ms, anything slower lands in the last one */
+  LATENCY_BUCKET_NS = 100000,
+  LATENCY_N_BUCKETS = 500
+};
+
+struct latency_hist {
+  uint32_t buckets[LATENCY_N_BUCKETS];
+  uint32_t count;
+  uint64_t sum_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+};
+
+void latency_reset(struct latency_hist *h);
+void latency_add(struct latency_hist *h, uint64_t ns);
+/* Adds end_ns - stamps[i] for each stamp. Stamps later than end_ns are
+ * from a clock that was never switched over and are skipped */
+void latency_add_events(
+  struct latency_hist *h,
+  const uint64_t *stamps,
+  size_t n,
+  uint64_t end_ns
+);
+/* Upper edge of the bucket holding the pct-th percentile */
+uint64_t latency_percentile(struct latency_hist *h, unsigned int pct);
+void latency_print(struct latency_hist *h, char *name, FILE *out);
+
+#endif
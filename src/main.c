@@ -16,52 +16,330 @@
  * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "audit.h"
 #include "error.h"
 #include "sized_types.h"
 #include "window.h"
 #include "keypoll.h"
+#include "idle.h"
+#include "frame.h"
+#include "latency.h"
 #include "render.h"
+#include "render_thread.h"
+#include "thread.h"
 #include "xrand.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 #include <time.h>
 
+/* Simulation state. prev_angle is one step back, rendered frames land
+ * somewhere in between */
+struct sim {
+  int spinning;
+  float angle;
+  float prev_angle;
+};
+
+static void sim_step(struct sim *s, float dt) {
+  const float two_pi = 6.28318531f;
+  /* radians per second */
+  const float spin_rate = 1.5f;
+
+  s->prev_angle = s->angle;
+  if (s->spinning) s->angle += spin_rate * dt;
+  /* Wrap both so the step between them stays small */
+  if (s->angle >= two_pi) {
+    s->angle -= two_pi;
+    s->prev_angle -= two_pi;
+  }
+}
+
+static void sim_interpolate(struct sim *s, float alpha, struct mat4 *out) {
+  float angle, sin_a, cos_a;
+
+  angle = s->prev_angle + (s->angle - s->prev_angle) * alpha;
+  fsincos(angle, &sin_a, &cos_a);
+  m4ident(out);
+  out->data[0] = cos_a;
+  out->data[1] = sin_a;
+  out->data[4] = -sin_a;
+  out->data[5] = cos_a;
+}
+
+static void cursor_position(struct kp_ctx *kp, struct render_uniforms *u) {
+  enum {
+    /* Mouse counts per unit of clip space */
+    CURSOR_COUNTS = 320
+  };
+
+  float x, y;
+
+  x = (float) kp->mouse.x / CURSOR_COUNTS;
+  y = (float) kp->mouse.y / CURSOR_COUNTS;
+  u->cursor.x = (x < -1.0f) ? -1.0f : (x > 1.0f) ? 1.0f : x;
+  u->cursor.y = (y < -1.0f) ? -1.0f : (y > 1.0f) ? 1.0f : y;
+}
+
+/* Runs right before submit so the cursor reflects input that came in
+ * while the frame was being built */
+static void latch_input(void *user, struct render_uniforms *u) {
+  struct kp_ctx *kp = user;
+
+  kp_latch(kp);
+  cursor_position(kp, u);
+}
+
 int main(int argc, char **argv) {
   enum {
     WIDTH = 640,
-    HEIGHT = 480
+    HEIGHT = 480,
     /* RENDER_WIDTH = 320, */
     /* RENDER_HEIGHT = 240 */
+    SIM_HZ = 120,
+    SIM_MAX_STEPS = 8,
+    /* Frames allowed to allocate before the allocation audit complains
+     * and the Vulkan allocation counts are taken as steady */
+    WARMUP_FRAMES = 120,
+    /* Real-time priorities. Input outranks rendering so a busy render
+     * thread can't hold up timestamps */
+    INPUT_PRIORITY = 20,
+    RENDER_PRIORITY = 10
   };
 
-  int err;
+  int err, i, input_thread = 0, measure_latency = 0, idle_mode = 0;
+  int render_threaded = 0, thread_stats = 0, animating = 0, redraw = 1;
+  int vk_alloc = 0, vk_profile = 0, frame_metrics = 0, compute = 0;
+  unsigned int frames = 0;
+  char *record_path = NULL, *replay_path = NULL;
   struct window window;
   struct kp_ctx kp;
+  struct idle_ctx idle;
+  struct frame_clock clock;
+  struct sim sim = { 1, 0.0f, 0.0f };
   struct render_instance instance;
   struct render_device device;
   struct render_pass pipeline;
+  struct render_thread render_thread;
+  struct thread_config input_config, render_config;
+  struct thread_stats main_stats;
+  /* Input event to present return, and to GPU completion */
+  static struct latency_hist present_latency, gpu_latency;
 
-  XRAND_SEED = (uint64_t) time(NULL);
+  audit_phase("init");
+  audit_set_warmup(WARMUP_FRAMES);
+  thread_config_default(&input_config, "tortuga-input");
+  thread_config_default(&render_config, "tortuga-render");
+  input_config.priority = INPUT_PRIORITY;
+  render_config.priority = RENDER_PRIORITY;
+  for (i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--input-thread")) {
+      input_thread = 1;
+    } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (!strcmp(argv[i], "--latency")) {
+      measure_latency = 1;
+    } else if (!strcmp(argv[i], "--idle")) {
+      idle_mode = 1;
+    } else if (!strcmp(argv[i], "--render-thread")) {
+      render_threaded = 1;
+    } else if (!strcmp(argv[i], "--input-cpu") && i + 1 < argc) {
+      input_config.cpu = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--render-cpu") && i + 1 < argc) {
+      render_config.cpu = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--realtime") && i + 1 < argc) {
+      /* Needs CAP_SYS_NICE or an RLIMIT_RTPRIO, threads stay on normal
+       * scheduling without */
+      ++i;
+      input_config.policy = render_config.policy =
+        !strcmp(argv[i], "rr") ? THREAD_POLICY_RR : THREAD_POLICY_FIFO;
+    } else if (!strcmp(argv[i], "--thread-stats")) {
+      thread_stats = 1;
+    } else if (!strcmp(argv[i], "--vk-alloc")) {
+      vk_alloc = 1;
+    } else if (!strcmp(argv[i], "--vk-profile")) {
+      vk_profile = 1;
+    } else if (!strcmp(argv[i], "--frame-metrics")) {
+      frame_metrics = 1;
+    } else if (!strcmp(argv[i], "--compute")) {
+      compute = 1;
+    }
+  }
+  xrand_seed(&XRAND_DEFAULT, (uint64_t) time(NULL));
   chkerrg(err = window_init(&window, "Tortuga", WIDTH, HEIGHT), err_window);
-  chkerrg(err = kp_init(&kp), err_kp);
+  if (replay_path) {
+    chkerrg(err = kp_replay_init(&kp, replay_path), err_kp);
+  } else {
+    chkerrg(err = kp_init(&kp), err_kp);
+    if (input_thread) {
+      chkerrg(err = kp_start_thread(&kp, &input_config), err_render);
+    }
+    if (record_path) {
+      chkerrg(err = kp_record_start(&kp, record_path), err_render);
+    }
+  }
+  /* Has to see the instance created to account for everything after */
+  if (vk_alloc) render_alloc_track();
+  if (vk_profile) render_profile_enable();
   chkerrg(err = render_instance_init(&instance, &window), err_render);
   chkerrg(err = render_device_init(&device, &instance, 0), err_device);
+  if (compute) render_pass_enable_compute();
   chkerrg(err = render_pass_init(&pipeline, &device), err_pass);
+  render_pass_set_latch(&pipeline, latch_input, &kp);
+  render_pass_set_timing(&pipeline, measure_latency);
+  chkerrg(err = idle_init(&idle), err_idle);
+  chkerrg(err = idle_add_fd(&idle, window_fd(&window)), err_idle_fd);
+  if (kp_fd(&kp) >= 0) {
+    chkerrg(err = idle_add_fd(&idle, kp_fd(&kp)), err_idle_fd);
+  }
+  /* The input latch can't run there, kp belongs to this thread. The
+   * render thread latches the newest snapshot instead */
+  if (render_threaded) {
+    chkerrg(
+      err = render_thread_start(
+        &render_thread,
+        &pipeline,
+        &render_config,
+        measure_latency ? &present_latency : NULL,
+        measure_latency ? &gpu_latency : NULL
+      ),
+      err_render_thread
+    );
+  }
+  frame_init(&clock, 1000000000UL / SIM_HZ, SIM_MAX_STEPS);
   for (;;) {
+    int n_window_events, stale;
+    unsigned int n_steps;
+    struct render_snapshot *snapshot;
+
     if (window.should_close) break;
+    if (render_threaded && (err = render_thread_error(&render_thread))) {
+      break;
+    }
+    audit_phase("input");
     kp_update(&kp);
-    window_update(&window);
+    audit_phase("window");
+    n_window_events = window_update(&window);
+    audit_phase("main loop");
 
     if (kp_getkey_press(kp, KP_KEY_ESC)) break;
-    render_pass_update(&pipeline);
+    if (kp_replay_finished(&kp)) break;
+    if (kp_getkey_press(kp, KP_KEY_SPACE)) sim.spinning = !sim.spinning;
+    /* Replays step once per frame and have nothing to wait on */
+    animating = sim.spinning || replay_path;
+    if (n_window_events || kp.stats.events) redraw = 1;
+    if (window.resized) {
+      if (render_threaded) render_thread_resize(&render_thread);
+      else render_pass_resize(&pipeline);
+    }
+    /* A threaded pass keeps itself drawing until it's rebuilt */
+    stale = !render_threaded && pipeline.stale;
+    /* Hidden windows never render. In idle mode neither does a frame
+     * that would look the same as the last one */
+    if (
+      !window.visible
+      || (idle_mode && !redraw && !animating && !stale)
+    ) {
+      audit_phase("idle");
+      idle_wait(&idle, -1);
+      /* Nothing moved while asleep, don't make up for the time */
+      frame_reset(&clock);
+      continue;
+    }
+    redraw = 0;
+    /* Only iterations that simulate and render are frames. Whatever ran
+     * since the last one, idle iterations included, counts toward it */
+    audit_frame();
+    if (vk_alloc && ++frames == WARMUP_FRAMES) render_alloc_steady();
+    audit_phase("sim");
+    n_steps = frame_begin(&clock);
+    while (n_steps--) sim_step(&sim, 1.0f / SIM_HZ);
+    audit_phase("render");
+    if (render_threaded) {
+      snapshot = render_thread_snapshot(&render_thread);
+      sim_interpolate(&sim, frame_alpha(&clock), &snapshot->uniforms.m);
+      cursor_position(&kp, &snapshot->uniforms);
+      render_snapshot_add_stamps(snapshot, kp.stamps.ns, kp.stamps.n);
+      render_thread_publish(&render_thread);
+      /* Nothing blocks here anymore. Sleep until the next step is due
+       * unless input comes in first */
+      audit_phase("idle");
+      idle_wait(
+        &idle,
+        (int) ((frame_until_step_ns(&clock) + 999999) / 1000000)
+      );
+      continue;
+    }
+    sim_interpolate(&sim, frame_alpha(&clock), &pipeline.uniform_data.m);
+    if ((err = render_pass_update(&pipeline))) break;
+    if (measure_latency && pipeline.timing.present_ns) {
+      latency_add_events(
+        &present_latency,
+        kp.stamps.ns,
+        kp.stamps.n,
+        pipeline.timing.present_ns
+      );
+    }
+    if (measure_latency && pipeline.timing.gpu_ns) {
+      latency_add_events(
+        &gpu_latency,
+        kp.stamps.ns,
+        kp.stamps.n,
+        pipeline.timing.gpu_ns
+      );
+    }
+  }
+  /* Shutdown frees and the printing below aren't steady state */
+  audit_end();
+  audit_phase("shutdown");
+  /* Stopped first, the histograms are the render thread's until then */
+  if (render_threaded) render_thread_stop(&render_thread);
+  kp_stop_thread(&kp);
+  if (measure_latency) {
+    latency_print(&present_latency, "input to present", stdout);
+    latency_print(&gpu_latency, "input to gpu done", stdout);
+  }
+  if (thread_stats) {
+    thread_sample(&main_stats);
+    thread_print_stats(&main_stats, "main thread", stdout);
+    if (input_thread && !replay_path) {
+      thread_print_stats(&kp.thread_stats, "input thread", stdout);
+    }
+    if (render_threaded) {
+      thread_print_stats(
+        &render_thread.thread_stats,
+        "render thread",
+        stdout
+      );
+    }
   }
+  /* Before teardown's unmaps land in the last frame */
+  if (vk_profile) render_profile_print(stdout);
+  if (frame_metrics) render_pass_print_metrics(&pipeline, stdout);
+  idle_deinit(&idle);
   render_pass_deinit(&pipeline);
   render_device_deinit(&device);
   render_instance_deinit(&instance);
   kp_deinit(&kp);
   window_deinit(&window);
-  return 0;
+  /* After deinit, anything still live was leaked by us or the driver */
+  if (vk_alloc) render_alloc_print(stdout);
+  if (audit_enabled()) {
+    audit_print(stdout);
+    /* Fails the run, the frame loop must not touch the heap */
+    if (audit_steady_allocations()) return AUDIT_ERROR_STEADY;
+  }
+  /* Set when the loop stopped on a failed frame */
+  return err;
 
+ err_render_thread:
+ err_idle_fd:
+  idle_deinit(&idle);
+ err_idle:
+  render_pass_deinit(&pipeline);
  err_pass:
   render_device_deinit(&device);
  err_device:
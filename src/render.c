@@ -1,7 +1,10 @@
 #ifdef RENDER_BACKEND_VK
+# include "render_vk_alloc.c"
+# include "render_vk_profile.c"
 # include "render_vk_device.c"
 # include "render_vk_instance.c"
 # include "render_vk_memory.c"
+# include "render_vk_compute.c"
 # include "render_vk_pass.c"
 # include "render_vk_shader.c"
 #else
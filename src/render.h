@@ -20,6 +20,32 @@
 #define RENDER_H
 
 #include "window.h"
+#include "trig.h"
+#include <stdio.h>
+
+/* Matches the Uniforms block in shaders/default_vert.vert */
+struct render_uniforms {
+  struct vec3 color;
+  char pad0;
+  struct mat4 m;
+  /* xy offset in clip space */
+  struct vec4 cursor;
+};
+
+/* What the draws of one frame did on the GPU. Counters the device has no
+ * query for stay 0 */
+struct render_frame_metrics {
+  uint64_t ia_vertices;
+  uint64_t ia_primitives;
+  uint64_t vs_invocations;
+  uint64_t clipping_invocations;
+  uint64_t clipping_primitives;
+  uint64_t fs_invocations;
+  uint64_t samples_passed;
+};
+
+/* Patches u with the newest state right before the frame is submitted */
+typedef void (*render_latch_fn)(void *user, struct render_uniforms *u);
 
 #ifdef RENDER_BACKEND_VK
 #include "render_vk.h"
@@ -61,6 +87,25 @@
 #define RENDER_ERROR_VULKAN_DESCRIPTOR_SET -33
 #define RENDER_ERROR_VULKAN_DESCRIPTOR_POOL -34
 #define RENDER_ERROR_VULKAN_UNIFORM_BUFFERS -35
+#define RENDER_ERROR_VULKAN_COMPUTE_PIPELINE -36
+#define RENDER_ERROR_VULKAN_FENCE -37
+#define RENDER_ERROR_VULKAN_QUERY_POOL -38
+#define RENDER_ERROR_VULKAN_ACQUIRE -39
+#define RENDER_ERROR_VULKAN_SUBMIT -40
+#define RENDER_ERROR_VULKAN_PRESENT -41
+
+/* Counts the graphics driver's own host allocations by lifetime and by
+ * object type. Has to be called before render_instance_init and can't be
+ * undone */
+void render_alloc_track(void);
+/* Marks the end of warm-up, the report tells what changed after it */
+void render_alloc_steady(void);
+void render_alloc_print(FILE *out);
+/* Counts and times acquire, submit, present, memory mapping and
+ * descriptor updates per frame. Has to be called before
+ * render_device_init */
+void render_profile_enable(void);
+void render_profile_print(FILE *out);
 
 int render_instance_init(struct render_instance *r, struct window *w);
 void render_instance_deinit(struct render_instance *r);
@@ -72,6 +117,25 @@ int render_device_init(
 void render_device_deinit(struct render_device *rd);
 int render_pass_init(struct render_pass *rp, struct render_device *rd);
 void render_pass_deinit(struct render_pass *rp);
-void render_pass_update(struct render_pass *rp);
+/* Only fails when the device can't go on, e.g. once it's lost. A pass that
+ * can't be rebuilt after a resize draws nothing and stays stale */
+int render_pass_update(struct render_pass *rp);
+/* Call when the window changed size. Frames keep going to the old
+ * swapchain until resizes stop for a moment */
+void render_pass_resize(struct render_pass *rp);
+void render_pass_set_latch(
+  struct render_pass *rp,
+  render_latch_fn latch,
+  void *user
+);
+/* Also stamps when each frame finished on the GPU, which waits on a
+ * fence every frame. Off by default */
+void render_pass_set_timing(struct render_pass *rp, int enabled);
+/* Runs the demo compute pass that recolors the vertices every frame. Has
+ * to be called before render_pass_init */
+void render_pass_enable_compute(void);
+/* Average and worst frame of the metrics read back so far, with overdraw
+ * per swapchain pixel */
+void render_pass_print_metrics(struct render_pass *rp, FILE *out);
 
 #endif
@@ -0,0 +1,127 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "sized_types.h"
+#include "render.h"
+#include "snapshot.h"
+#include "latency.h"
+#include "thread.h"
+#include <stddef.h>
+
+#define RENDER_THREAD_ERROR_NONE 0
+#define RENDER_THREAD_ERROR_NULL -1
+#define RENDER_THREAD_ERROR_THREAD -2
+
+enum {
+  RENDER_SNAPSHOT_MAX_STAMPS = 64
+};
+
+/* Everything the render thread needs for one frame. The main thread
+ * fills it in and never touches it again once published */
+struct render_snapshot {
+  struct render_uniforms uniforms;
+  /* Counts resizes, so one is still seen if its snapshot is skipped */
+  unsigned long resize_seq;
+  /* Input event timestamps this frame is the first to show */
+  size_t n_stamps;
+  uint64_t stamps[RENDER_SNAPSHOT_MAX_STAMPS];
+};
+
+#ifdef PLATFORM_LINUX
+
+#include <pthread.h>
+
+struct render_thread_os_details {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+#else
+
+struct render_thread_os_details {
+  int dummy;
+};
+
+#endif  /* PLATFORM_LINUX */
+
+/* Runs render_pass_update on its own thread so acquire, submit and
+ * present never hold up the main loop. The pass belongs to the render
+ * thread until render_thread_stop */
+struct render_thread {
+  struct render_pass *rp;
+  struct snapshot_buffer snapshots;
+  struct render_snapshot slots[3];
+  int stop;
+  /* Main thread side */
+  unsigned long resize_seq;
+  int carry;
+  unsigned long published;
+  unsigned long skipped;
+  /* Render thread side */
+  unsigned long resize_seen;
+  unsigned long frames;
+  /* The render_pass_update error that stopped the thread, under the
+   * lock */
+  int err;
+  struct {
+    size_t n;
+    uint64_t ns[RENDER_SNAPSHOT_MAX_STAMPS];
+  } shown;
+  /* Optional, filled by the render thread. Only read them after
+   * render_thread_stop */
+  struct latency_hist *present_latency;
+  struct latency_hist *gpu_latency;
+  struct thread_config config;
+  /* Filled in by the render thread as it exits */
+  struct thread_stats thread_stats;
+  struct render_thread_os_details os;
+};
+
+/* **************************************** */
+/* render_thread_<platform>.c */
+/* Takes over the pass's latch, which picks up the newest snapshot right
+ * before submit. The latency histograms and config can be NULL */
+int render_thread_start(
+  struct render_thread *rt,
+  struct render_pass *rp,
+  struct thread_config *config,
+  struct latency_hist *present_latency,
+  struct latency_hist *gpu_latency
+);
+void render_thread_stop(struct render_thread *rt);
+/* The snapshot to fill for the next frame. Stamps of a snapshot the
+ * render thread skipped are still in it, add to them */
+struct render_snapshot *render_thread_snapshot(struct render_thread *rt);
+void render_thread_publish(struct render_thread *rt);
+/* Stamps past what a snapshot holds are dropped */
+void render_snapshot_add_stamps(
+  struct render_snapshot *s,
+  uint64_t *ns,
+  size_t n
+);
+/* Call from the main thread when the window changed size */
+void render_thread_resize(struct render_thread *rt);
+/* The RENDER_ERROR_* that stopped the render thread, 0 while it runs */
+int render_thread_error(struct render_thread *rt);
+/* **************************************** */
+
+#endif
@@ -0,0 +1,262 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* pthread_condattr_setclock */
+#define _DEFAULT_SOURCE
+
+#include "render_thread.h"
+#include "audit.h"
+#include "error.h"
+#include <string.h>
+#include <time.h>
+
+enum {
+  /* How often a stale pass checks whether the resize has settled when no
+   * new snapshot wakes it */
+  RENDER_THREAD_STALE_POLL_NS = 10000000
+};
+
+/* Moves to the newest snapshot and applies what it carries besides the
+ * uniforms. Render thread only */
+static void take_snapshot(struct render_thread *rt) {
+  struct render_snapshot *s;
+  size_t n;
+
+  if (!snapshot_acquire(&rt->snapshots)) return;
+  s = snapshot_front(&rt->snapshots);
+  if (s->resize_seq != rt->resize_seen) {
+    rt->resize_seen = s->resize_seq;
+    render_pass_resize(rt->rp);
+  }
+  /* A frame can pick up more than one snapshot, the first one before
+   * acquire and a newer one in the latch. It shows the input of both */
+  n = s->n_stamps;
+  if (n > RENDER_SNAPSHOT_MAX_STAMPS - rt->shown.n) {
+    n = RENDER_SNAPSHOT_MAX_STAMPS - rt->shown.n;
+  }
+  memcpy(rt->shown.ns + rt->shown.n, s->stamps, n * sizeof(uint64_t));
+  rt->shown.n += n;
+}
+
+static void latch_snapshot(void *user, struct render_uniforms *u) {
+  struct render_thread *rt = user;
+  struct render_snapshot *s;
+
+  take_snapshot(rt);
+  s = snapshot_front(&rt->snapshots);
+  memcpy(u, &s->uniforms, sizeof(struct render_uniforms));
+}
+
+static void record_latency(struct render_thread *rt) {
+  struct render_pass *rp = rt->rp;
+
+  if (rt->present_latency && rp->timing.present_ns) {
+    latency_add_events(
+      rt->present_latency,
+      rt->shown.ns,
+      rt->shown.n,
+      rp->timing.present_ns
+    );
+  }
+  if (rt->gpu_latency && rp->timing.gpu_ns) {
+    latency_add_events(
+      rt->gpu_latency,
+      rt->shown.ns,
+      rt->shown.n,
+      rp->timing.gpu_ns
+    );
+  }
+  rt->shown.n = 0;
+}
+
+/* Returns 0 once stopped */
+static int wait_for_work(struct render_thread *rt) {
+  struct timespec until;
+  int running;
+
+  pthread_mutex_lock(&rt->os.lock);
+  if (!rt->stop && !snapshot_pending(&rt->snapshots)) {
+    if (rt->rp->stale) {
+      /* Nothing new to draw, but the pass has to be rebuilt once the
+       * resize settles */
+      clock_gettime(CLOCK_MONOTONIC, &until);
+      until.tv_nsec += RENDER_THREAD_STALE_POLL_NS;
+      if (until.tv_nsec >= 1000000000L) {
+        until.tv_nsec -= 1000000000L;
+        ++until.tv_sec;
+      }
+      pthread_cond_timedwait(&rt->os.wake, &rt->os.lock, &until);
+    } else {
+      while (!rt->stop && !snapshot_pending(&rt->snapshots)) {
+        pthread_cond_wait(&rt->os.wake, &rt->os.lock);
+      }
+    }
+  }
+  running = !rt->stop;
+  pthread_mutex_unlock(&rt->os.lock);
+  return running;
+}
+
+/* Timed waits are against the monotonic clock so wall clock changes can't
+ * stretch them */
+static int init_wake(pthread_cond_t *wake) {
+  pthread_condattr_t attr;
+  int err;
+
+  if (pthread_condattr_init(&attr)) return RENDER_THREAD_ERROR_THREAD;
+  err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)
+    || pthread_cond_init(wake, &attr);
+  pthread_condattr_destroy(&attr);
+  return err ? RENDER_THREAD_ERROR_THREAD : RENDER_THREAD_ERROR_NONE;
+}
+
+static void *render_main(void *arg) {
+  struct render_thread *rt = arg;
+  int err;
+
+  /* Best effort, it renders the same either way */
+  thread_configure(&rt->config);
+  audit_phase("render thread");
+  while (wait_for_work(rt)) {
+    /* Resizes apply before acquire, the latch takes anything newer */
+    take_snapshot(rt);
+    if ((err = render_pass_update(rt->rp))) {
+      /* Left for the main thread to pick up, it stops us */
+      pthread_mutex_lock(&rt->os.lock);
+      rt->err = err;
+      pthread_mutex_unlock(&rt->os.lock);
+      break;
+    }
+    record_latency(rt);
+    ++rt->frames;
+  }
+  thread_sample(&rt->thread_stats);
+  return NULL;
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int render_thread_start(
+  struct render_thread *rt,
+  struct render_pass *rp,
+  struct thread_config *config,
+  struct latency_hist *present_latency,
+  struct latency_hist *gpu_latency
+) {
+  size_t i;
+
+  if (!rt) return RENDER_THREAD_ERROR_NULL;
+  if (!rp) return RENDER_THREAD_ERROR_NULL;
+  memset(rt, 0, sizeof(struct render_thread));
+  rt->rp = rp;
+  rt->present_latency = present_latency;
+  rt->gpu_latency = gpu_latency;
+  if (config) memcpy(&rt->config, config, sizeof(struct thread_config));
+  else thread_config_default(&rt->config, "render");
+  /* Snapshots only carry what changes per frame, the rest starts out as
+   * whatever the pass was set up with */
+  for (i = 0; i < 3; ++i) {
+    memcpy(
+      &rt->slots[i].uniforms,
+      &rp->uniform_data,
+      sizeof(struct render_uniforms)
+    );
+  }
+  snapshot_init(&rt->snapshots, rt->slots, rt->slots + 1, rt->slots + 2);
+  chkerrg(pthread_mutex_init(&rt->os.lock, NULL), err_lock);
+  chkerrg(init_wake(&rt->os.wake), err_wake);
+  render_pass_set_latch(rp, latch_snapshot, rt);
+  chkerrg(pthread_create(&rt->os.thread, NULL, render_main, rt), err_thread);
+  return RENDER_THREAD_ERROR_NONE;
+
+ err_thread:
+  render_pass_set_latch(rp, NULL, NULL);
+  pthread_cond_destroy(&rt->os.wake);
+ err_wake:
+  pthread_mutex_destroy(&rt->os.lock);
+ err_lock:
+  rt->rp = NULL;
+  return RENDER_THREAD_ERROR_THREAD;
+}
+
+void render_thread_stop(struct render_thread *rt) {
+  if (!rt || !rt->rp) return;
+  pthread_mutex_lock(&rt->os.lock);
+  rt->stop = 1;
+  pthread_cond_signal(&rt->os.wake);
+  pthread_mutex_unlock(&rt->os.lock);
+  pthread_join(rt->os.thread, NULL);
+  render_pass_set_latch(rt->rp, NULL, NULL);
+  pthread_cond_destroy(&rt->os.wake);
+  pthread_mutex_destroy(&rt->os.lock);
+  rt->rp = NULL;
+}
+
+struct render_snapshot *render_thread_snapshot(struct render_thread *rt) {
+  /* no null check */
+  struct render_snapshot *s = snapshot_back(&rt->snapshots);
+
+  if (!rt->carry) s->n_stamps = 0;
+  rt->carry = 0;
+  return s;
+}
+
+void render_thread_publish(struct render_thread *rt) {
+  /* no null check */
+  struct render_snapshot *s = snapshot_back(&rt->snapshots);
+
+  s->resize_seq = rt->resize_seq;
+  /* The one this replaces was never drawn. It comes back as the next
+   * back slot, and its stamps go out with the next frame instead */
+  rt->carry = snapshot_publish(&rt->snapshots);
+  if (rt->carry) ++rt->skipped;
+  ++rt->published;
+  pthread_mutex_lock(&rt->os.lock);
+  pthread_cond_signal(&rt->os.wake);
+  pthread_mutex_unlock(&rt->os.lock);
+}
+
+void render_thread_resize(struct render_thread *rt) {
+  /* no null check */
+  ++rt->resize_seq;
+}
+
+int render_thread_error(struct render_thread *rt) {
+  /* no null check */
+  int err;
+
+  pthread_mutex_lock(&rt->os.lock);
+  err = rt->err;
+  pthread_mutex_unlock(&rt->os.lock);
+  return err;
+}
+
+void render_snapshot_add_stamps(
+  struct render_snapshot *s,
+  uint64_t *ns,
+  size_t n
+) {
+  /* no null check */
+  if (n > RENDER_SNAPSHOT_MAX_STAMPS - s->n_stamps) {
+    n = RENDER_SNAPSHOT_MAX_STAMPS - s->n_stamps;
+  }
+  memcpy(s->stamps + s->n_stamps, ns, n * sizeof(uint64_t));
+  s->n_stamps += n;
+}
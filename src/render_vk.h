@@ -22,6 +22,7 @@
 #define VK_NO_PROTOTYPES
 #include <vulkan/vulkan_core.h>
 #include <vulkan/vk_platform.h>
+#include "arena.h"
 
 #ifdef PLATFORM_LINUX
 #include <xcb/xcb.h>
@@ -29,7 +30,18 @@
 #endif
 
 #define vkfunc(F) PFN_##F F
+/* pAllocator for creating or destroying a type of object. NULL unless
+ * render_alloc_track was called, the same for creation and destruction
+ * either way */
+#define RENDER_ALLOC(type) render_alloc_callbacks(RENDER_ALLOC_##type)
 #define MB_TO_BYTES(n) (n * 1024 * 1024)
+#define KB_TO_BYTES(n) (n * 1024)
+
+/* Arena sizes. Everything the renderer allocates on the CPU after init
+ * comes out of these, so they bound how many swapchain images it takes */
+#define RENDER_SCRATCH_SIZE KB_TO_BYTES(64)
+#define RENDER_SWAPCHAIN_ARENA_SIZE KB_TO_BYTES(4)
+#define RENDER_PASS_ARENA_SIZE KB_TO_BYTES(16)
 
 /* Instance */
 vkfunc(vkGetInstanceProcAddr);
@@ -69,6 +81,8 @@ struct render_memory {
   size_t offset;
   VkBuffer buffer;
   VkDeviceMemory memory;
+  /* Set by render_memory_map, stays valid until render_memory_deinit */
+  unsigned char *mapped;
 };
 
 struct render_buffer {
@@ -91,9 +105,16 @@ struct render_device {
   VkSwapchainKHR swapchain;
   uint32_t n_swapchain_images;
   VkImage *swapchain_images;
+  /* Holds swapchain_images, emptied by every recreate */
+  struct arena swapchain_arena;
+  /* Query results that are only needed while building something. Callers
+   * release back to a mark when done */
+  struct arena scratch;
   VkSemaphore image_semaphore;
   VkSemaphore render_semaphore;
   VkPhysicalDeviceProperties properties;
+  /* Supported features. The optional ones used here are also enabled
+   * whenever supported */
   VkPhysicalDeviceFeatures features;
   VkPhysicalDeviceMemoryProperties memory_properties;
   struct render_memory memory;
@@ -126,6 +147,11 @@ struct render_device {
   vkfunc(vkCmdBindVertexBuffers);
   vkfunc(vkCmdBindIndexBuffer);
   vkfunc(vkCmdDrawIndexed);
+  /* Compute */
+  vkfunc(vkCreateComputePipelines);
+  vkfunc(vkCmdDispatch);
+  vkfunc(vkCmdPipelineBarrier);
+  vkfunc(vkCmdPushConstants);
   /* Descriptors */
   vkfunc(vkCreateDescriptorPool);
   vkfunc(vkDestroyDescriptorPool);
@@ -151,6 +177,29 @@ struct render_device {
   vkfunc(vkQueueSubmit);
   vkfunc(vkQueuePresentKHR);
   vkfunc(vkQueueWaitIdle);
+  /* Sync */
+  vkfunc(vkCreateFence);
+  vkfunc(vkDestroyFence);
+  vkfunc(vkWaitForFences);
+  vkfunc(vkResetFences);
+  /* Queries */
+  vkfunc(vkCreateQueryPool);
+  vkfunc(vkDestroyQueryPool);
+  vkfunc(vkCmdResetQueryPool);
+  vkfunc(vkCmdBeginQuery);
+  vkfunc(vkCmdEndQuery);
+  vkfunc(vkGetQueryPoolResults);
+};
+
+struct render_compute {
+  struct render_device *device;
+  size_t n_buffers;
+  uint32_t push_size;
+  VkDescriptorSetLayout desc_layout;
+  VkDescriptorPool desc_pool;
+  VkDescriptorSet desc_set;
+  VkPipelineLayout pipeline_layout;
+  VkPipeline pipeline;
 };
 
 struct render_pass {
@@ -170,6 +219,47 @@ struct render_pass {
   struct render_buffer vertices;
   struct render_buffer indices;
   struct render_buffer *uniforms;
+  /* Holds the per swapchain image arrays above, emptied by every
+   * recreate */
+  struct arena arena;
+  struct render_compute compute;
+  /* Current uniform values, written to the frame's slot before submit */
+  struct render_uniforms uniform_data;
+  render_latch_fn latch;
+  void *latch_user;
+  /* The swapchain no longer matches the window but can still present.
+   * Recreated once no resize came in for a while. Stays set after a
+   * failed rebuild, which left the pass torn down until one succeeds */
+  int stale;
+  int torn_down;
+  uint64_t resize_ns;
+  /* Signaled when a submitted frame finishes on the GPU. Only attached
+   * while timing is enabled, pending until it was seen signaled and
+   * reset */
+  VkFence frame_fence;
+  int fence_pending;
+  /* timer_now_ns stamps from the last render_pass_update, 0 when the
+   * frame never made it that far. gpu_ns stays 0 unless enabled, see
+   * render_pass_set_timing */
+  struct {
+    int enabled;
+    uint64_t present_ns;
+    uint64_t gpu_ns;
+  } timing;
+  /* One query per swapchain image around its draws, VK_NULL_HANDLE when
+   * the device can't count that */
+  VkQueryPool stats_pool;
+  VkQueryPool occlusion_pool;
+  /* The last submitted frame's queries are read at the start of the next
+   * render_pass_update, without waiting */
+  int metrics_pending;
+  uint32_t metrics_image;
+  /* Newest frame read back, and the sum and per counter worst of all
+   * n_metrics frames */
+  struct render_frame_metrics metrics;
+  struct render_frame_metrics metrics_total;
+  struct render_frame_metrics metrics_max;
+  uint64_t n_metrics;
 };
 
 struct render_shader {
@@ -177,13 +267,79 @@ struct render_shader {
   VkShaderModule frag_module;
 };
 
+/* What a driver host allocation was made for, see RENDER_ALLOC */
+enum render_alloc_type {
+  RENDER_ALLOC_INSTANCE,
+  RENDER_ALLOC_SURFACE,
+  RENDER_ALLOC_DEVICE,
+  RENDER_ALLOC_SWAPCHAIN,
+  RENDER_ALLOC_SEMAPHORE,
+  RENDER_ALLOC_FENCE,
+  RENDER_ALLOC_MEMORY,
+  RENDER_ALLOC_BUFFER,
+  RENDER_ALLOC_IMAGE_VIEW,
+  RENDER_ALLOC_FRAMEBUFFER,
+  RENDER_ALLOC_RENDER_PASS,
+  RENDER_ALLOC_SHADER_MODULE,
+  RENDER_ALLOC_PIPELINE_LAYOUT,
+  RENDER_ALLOC_PIPELINE,
+  RENDER_ALLOC_DESCRIPTOR_SET_LAYOUT,
+  RENDER_ALLOC_DESCRIPTOR_POOL,
+  RENDER_ALLOC_COMMAND_POOL,
+  RENDER_ALLOC_QUERY_POOL,
+  RENDER_ALLOC_N_TYPES
+};
+
 #undef vkfunc
 
+/* **************************************** */
+/* render_vk_alloc.c */
+VkAllocationCallbacks *render_alloc_callbacks(enum render_alloc_type type);
+/* **************************************** */
+
+/* **************************************** */
+/* render_vk_profile.c */
+/* Swaps the shims into rd's table if profiling is on */
+void render_profile_wrap(struct render_device *rd);
+/* Closes the frame the counted calls belong to */
+void render_profile_frame(void);
+/* **************************************** */
+
 /* **************************************** */
 /* render_vk_device.c */
 int render_device_recreate_swapchain(struct render_device *rd);
 /* **************************************** */
 
+/* **************************************** */
+/* render_vk_compute.c */
+int render_compute_init(
+  struct render_compute *rc,
+  struct render_device *rd,
+  size_t src_len,
+  uint32_t *src,
+  size_t n_buffers,
+  struct render_buffer *buffers,
+  uint32_t push_size
+);
+void render_compute_deinit(struct render_compute *rc);
+void render_compute_dispatch(
+  struct render_compute *rc,
+  VkCommandBuffer command_buffer,
+  void *push_data,
+  uint32_t n_groups_x,
+  uint32_t n_groups_y,
+  uint32_t n_groups_z
+);
+void render_compute_barrier(
+  struct render_device *rd,
+  VkCommandBuffer command_buffer,
+  VkPipelineStageFlags src_stage,
+  VkAccessFlags src_access,
+  VkPipelineStageFlags dst_stage,
+  VkAccessFlags dst_access
+);
+/* **************************************** */
+
 /* **************************************** */
 /* render_vk_memory.c */
 int render_memory_init(
@@ -194,6 +350,9 @@ int render_memory_init(
 );
 void render_memory_deinit(struct render_memory *rm);
 void render_memory_reset(struct render_memory *memory);
+/* Maps the whole allocation once so render_buffer_write is a copy and a
+ * flush instead of a map and unmap per call */
+int render_memory_map(struct render_memory *rm);
 int render_memory_create_buffer(
   struct render_memory *rm,
   size_t align,
@@ -0,0 +1,327 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "render.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Host allocations made by the driver through VkAllocationCallbacks. Every
+ * object type gets its own callbacks so pUserData can say what the memory
+ * is for, and VkSystemAllocationScope says how long it lives */
+
+#define ALLOC_N_SCOPES (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+/* Smallest alignment handed out, enough for anything malloc returns */
+#define ALLOC_MIN_ALIGN 16
+
+struct alloc_counts {
+  size_t allocs;
+  size_t reallocs;
+  size_t frees;
+  size_t live;
+  size_t peak;
+  /* allocs and reallocs at render_alloc_steady */
+  size_t steady;
+};
+
+/* Sits right before every block handed to the driver */
+struct alloc_header {
+  void *raw;
+  size_t size;
+  int type;
+  int scope;
+};
+
+static int alloc_enabled = 0;
+static enum render_alloc_type alloc_types[RENDER_ALLOC_N_TYPES];
+static VkAllocationCallbacks alloc_callbacks[RENDER_ALLOC_N_TYPES];
+static struct alloc_counts alloc_by_type[RENDER_ALLOC_N_TYPES];
+static struct alloc_counts alloc_by_scope[ALLOC_N_SCOPES];
+/* Memory the driver got elsewhere and only told us about */
+static struct alloc_counts alloc_internal[ALLOC_N_SCOPES];
+
+static const char *type_names[RENDER_ALLOC_N_TYPES] = {
+  "instance",
+  "surface",
+  "device",
+  "swapchain",
+  "semaphore",
+  "fence",
+  "memory",
+  "buffer",
+  "image view",
+  "framebuffer",
+  "render pass",
+  "shader module",
+  "pipeline layout",
+  "pipeline",
+  "descriptor set layout",
+  "descriptor pool",
+  "command pool",
+  "query pool"
+};
+
+static const char *scope_names[ALLOC_N_SCOPES] = {
+  "command",
+  "object",
+  "cache",
+  "device",
+  "instance"
+};
+
+static void count_add(struct alloc_counts *c, size_t size, int realloc) {
+  size_t live;
+  size_t peak;
+
+  if (realloc) __atomic_add_fetch(&c->reallocs, 1, __ATOMIC_RELAXED);
+  else __atomic_add_fetch(&c->allocs, 1, __ATOMIC_RELAXED);
+  live = __atomic_add_fetch(&c->live, size, __ATOMIC_RELAXED);
+  peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+  while (live > peak) {
+    if (__atomic_compare_exchange_n(
+      &c->peak, &peak, live, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+    )) break;
+  }
+}
+
+static void count_sub(struct alloc_counts *c, size_t size, int realloc) {
+  if (!realloc) __atomic_add_fetch(&c->frees, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&c->live, size, __ATOMIC_RELAXED);
+}
+
+static int scope_index(VkSystemAllocationScope scope) {
+  if ((int) scope < 0 || (int) scope >= ALLOC_N_SCOPES) {
+    return VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+  }
+  return (int) scope;
+}
+
+static struct alloc_header *header_of(void *p) {
+  return (struct alloc_header *) p - 1;
+}
+
+static void *engine_alloc(
+  size_t size,
+  size_t alignment,
+  int type,
+  int scope
+) {
+  char *raw;
+  size_t offset;
+  struct alloc_header *header;
+
+  if (alignment < ALLOC_MIN_ALIGN) alignment = ALLOC_MIN_ALIGN;
+  /* worst case the header needs a whole extra alignment step */
+  raw = malloc(size + sizeof(struct alloc_header) + alignment);
+  if (!raw) return NULL;
+  offset = (size_t) (raw + sizeof(struct alloc_header));
+  offset = (offset + alignment - 1) & ~(alignment - 1);
+  offset -= (size_t) raw;
+  header = header_of(raw + offset);
+  header->raw = raw;
+  header->size = size;
+  header->type = type;
+  header->scope = scope;
+  return raw + offset;
+}
+
+static void engine_free(void *p) {
+  free(header_of(p)->raw);
+}
+
+static void *VKAPI_CALL alloc_fn(
+  void *user,
+  size_t size,
+  size_t alignment,
+  VkSystemAllocationScope scope
+) {
+  int type;
+  int s;
+  void *p;
+
+  type = (int) *(enum render_alloc_type *) user;
+  s = scope_index(scope);
+  p = engine_alloc(size, alignment, type, s);
+  if (!p) return NULL;
+  count_add(&alloc_by_type[type], size, 0);
+  count_add(&alloc_by_scope[s], size, 0);
+  return p;
+}
+
+static void VKAPI_CALL free_fn(void *user, void *p) {
+  struct alloc_header *header;
+
+  (void) user;
+  if (!p) return;
+  header = header_of(p);
+  count_sub(&alloc_by_type[header->type], header->size, 0);
+  count_sub(&alloc_by_scope[header->scope], header->size, 0);
+  engine_free(p);
+}
+
+static void *VKAPI_CALL realloc_fn(
+  void *user,
+  void *original,
+  size_t size,
+  size_t alignment,
+  VkSystemAllocationScope scope
+) {
+  struct alloc_header *header;
+  void *p;
+  int type;
+  int s;
+
+  if (!original) return alloc_fn(user, size, alignment, scope);
+  if (!size) {
+    free_fn(user, original);
+    return NULL;
+  }
+  header = header_of(original);
+  type = header->type;
+  s = header->scope;
+  p = engine_alloc(size, alignment, type, s);
+  /* the original stays valid when this fails */
+  if (!p) return NULL;
+  memcpy(p, original, size < header->size ? size : header->size);
+  count_sub(&alloc_by_type[type], header->size, 1);
+  count_sub(&alloc_by_scope[s], header->size, 1);
+  count_add(&alloc_by_type[type], size, 1);
+  count_add(&alloc_by_scope[s], size, 1);
+  engine_free(original);
+  return p;
+}
+
+static void VKAPI_CALL internal_alloc_fn(
+  void *user,
+  size_t size,
+  VkInternalAllocationType type,
+  VkSystemAllocationScope scope
+) {
+  (void) user;
+  (void) type;
+  count_add(&alloc_internal[scope_index(scope)], size, 0);
+}
+
+static void VKAPI_CALL internal_free_fn(
+  void *user,
+  size_t size,
+  VkInternalAllocationType type,
+  VkSystemAllocationScope scope
+) {
+  (void) user;
+  (void) type;
+  count_sub(&alloc_internal[scope_index(scope)], size, 0);
+}
+
+static size_t count_since_steady(struct alloc_counts *c) {
+  size_t n;
+
+  n = __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+  n += __atomic_load_n(&c->reallocs, __ATOMIC_RELAXED);
+  return n - c->steady;
+}
+
+static void count_mark_steady(struct alloc_counts *c) {
+  c->steady = __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+  c->steady += __atomic_load_n(&c->reallocs, __ATOMIC_RELAXED);
+}
+
+static void print_counts(FILE *out, const char *name, struct alloc_counts *c) {
+  fprintf(
+    out,
+    "  %-22s %8lu %8lu %8lu %10lu %10lu %8lu\n",
+    name,
+    (unsigned long) c->allocs,
+    (unsigned long) c->reallocs,
+    (unsigned long) c->frees,
+    (unsigned long) c->live,
+    (unsigned long) c->peak,
+    (unsigned long) count_since_steady(c)
+  );
+}
+
+static void print_heading(FILE *out, const char *title) {
+  fprintf(
+    out,
+    "%-24s %8s %8s %8s %10s %10s %8s\n",
+    title,
+    "allocs",
+    "reallocs",
+    "frees",
+    "live",
+    "peak",
+    "steady"
+  );
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+VkAllocationCallbacks *render_alloc_callbacks(enum render_alloc_type type) {
+  if (!alloc_enabled) return NULL;
+  return &alloc_callbacks[type];
+}
+
+void render_alloc_track(void) {
+  int i;
+
+  for (i = 0; i < RENDER_ALLOC_N_TYPES; ++i) {
+    alloc_types[i] = (enum render_alloc_type) i;
+    alloc_callbacks[i].pUserData = &alloc_types[i];
+    alloc_callbacks[i].pfnAllocation = alloc_fn;
+    alloc_callbacks[i].pfnReallocation = realloc_fn;
+    alloc_callbacks[i].pfnFree = free_fn;
+    alloc_callbacks[i].pfnInternalAllocation = internal_alloc_fn;
+    alloc_callbacks[i].pfnInternalFree = internal_free_fn;
+  }
+  alloc_enabled = 1;
+}
+
+void render_alloc_steady(void) {
+  int i;
+
+  if (!alloc_enabled) return;
+  for (i = 0; i < RENDER_ALLOC_N_TYPES; ++i) {
+    count_mark_steady(&alloc_by_type[i]);
+  }
+  for (i = 0; i < ALLOC_N_SCOPES; ++i) {
+    count_mark_steady(&alloc_by_scope[i]);
+    count_mark_steady(&alloc_internal[i]);
+  }
+}
+
+void render_alloc_print(FILE *out) {
+  int i;
+
+  if (!alloc_enabled) return;
+  fprintf(out, "vulkan host allocations (bytes live/peak):\n");
+  print_heading(out, "by scope");
+  for (i = 0; i < ALLOC_N_SCOPES; ++i) {
+    print_counts(out, scope_names[i], &alloc_by_scope[i]);
+  }
+  print_heading(out, "by object");
+  for (i = 0; i < RENDER_ALLOC_N_TYPES; ++i) {
+    if (!alloc_by_type[i].allocs) continue;
+    print_counts(out, type_names[i], &alloc_by_type[i]);
+  }
+  print_heading(out, "driver internal");
+  for (i = 0; i < ALLOC_N_SCOPES; ++i) {
+    if (!alloc_internal[i].allocs) continue;
+    print_counts(out, scope_names[i], &alloc_internal[i]);
+  }
+}
@@ -0,0 +1,376 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "render.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int create_compute_desc_layout(
+  struct render_device *device,
+  size_t n_buffers,
+  VkDescriptorSetLayout *out_layout
+) {
+  enum {
+    MAX_STORAGE_BUFFERS = 8
+  };
+
+  size_t i;
+  VkDescriptorSetLayoutBinding bindings[MAX_STORAGE_BUFFERS];
+  VkDescriptorSetLayoutCreateInfo create_info = { 0 };
+  VkResult result;
+
+  if (n_buffers > MAX_STORAGE_BUFFERS) {
+    return RENDER_ERROR_VULKAN_DESCRIPTOR_SET;
+  }
+  memset(bindings, 0, sizeof(bindings));
+  for (i = 0; i < n_buffers; ++i) {
+    bindings[i].binding = (uint32_t) i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  create_info.bindingCount = (uint32_t) n_buffers;
+  create_info.pBindings = bindings;
+  result = device->vkCreateDescriptorSetLayout(
+    device->device,
+    &create_info,
+    RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT),
+    out_layout
+  );
+  if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_DESCRIPTOR_SET;
+  return RENDER_ERROR_NONE;
+}
+
+static int create_compute_desc_set(
+  struct render_device *device,
+  VkDescriptorSetLayout layout,
+  size_t n_buffers,
+  struct render_buffer *buffers,
+  VkDescriptorPool *out_pool,
+  VkDescriptorSet *out_set
+) {
+  size_t i;
+  VkDescriptorPoolSize size = { 0 };
+  VkDescriptorPoolCreateInfo pool_info = { 0 };
+  VkDescriptorSetAllocateInfo alloc_info = { 0 };
+  VkDescriptorBufferInfo buffer_info = { 0 };
+  VkWriteDescriptorSet write_info = { 0 };
+  VkResult result;
+
+  size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  size.descriptorCount = (uint32_t) n_buffers;
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &size;
+  result = device->vkCreateDescriptorPool(
+    device->device,
+    &pool_info,
+    RENDER_ALLOC(DESCRIPTOR_POOL),
+    out_pool
+  );
+  if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_DESCRIPTOR_POOL;
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.descriptorPool = *out_pool;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &layout;
+  result = device->vkAllocateDescriptorSets(
+    device->device,
+    &alloc_info,
+    out_set
+  );
+  if (result != VK_SUCCESS) goto err_desc_set;
+  for (i = 0; i < n_buffers; ++i) {
+    buffer_info.buffer = buffers[i].buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = buffers[i].size;
+    write_info.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write_info.dstSet = *out_set;
+    write_info.dstBinding = (uint32_t) i;
+    write_info.dstArrayElement = 0;
+    write_info.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write_info.descriptorCount = 1;
+    write_info.pBufferInfo = &buffer_info;
+    device->vkUpdateDescriptorSets(
+      device->device,
+      1,
+      &write_info,
+      0,
+      NULL
+    );
+  }
+  return RENDER_ERROR_NONE;
+
+ err_desc_set:
+  device->vkDestroyDescriptorPool(
+    device->device,
+    *out_pool,
+    RENDER_ALLOC(DESCRIPTOR_POOL)
+  );
+  return RENDER_ERROR_VULKAN_DESCRIPTOR_SET;
+}
+
+static int create_compute_pipeline(
+  struct render_device *device,
+  size_t src_len,
+  uint32_t *src,
+  VkDescriptorSetLayout desc_layout,
+  uint32_t push_size,
+  VkPipelineLayout *out_layout,
+  VkPipeline *out_pipeline
+) {
+  int err = RENDER_ERROR_VULKAN_COMPUTE_PIPELINE;
+  VkShaderModuleCreateInfo module_info = { 0 };
+  VkShaderModule module;
+  VkPushConstantRange push_range = { 0 };
+  VkPipelineLayoutCreateInfo layout_info = { 0 };
+  VkComputePipelineCreateInfo pipeline_info = { 0 };
+  VkResult result;
+
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.codeSize = src_len;
+  module_info.pCode = src;
+  result = device->vkCreateShaderModule(
+    device->device,
+    &module_info,
+    RENDER_ALLOC(SHADER_MODULE),
+    &module
+  );
+  if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_SHADER_MODULE;
+  push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_range.offset = 0;
+  push_range.size = push_size;
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &desc_layout;
+  layout_info.pushConstantRangeCount = push_size ? 1 : 0;
+  layout_info.pPushConstantRanges = push_size ? &push_range : NULL;
+  result = device->vkCreatePipelineLayout(
+    device->device,
+    &layout_info,
+    RENDER_ALLOC(PIPELINE_LAYOUT),
+    out_layout
+  );
+  if (result != VK_SUCCESS) {
+    err = RENDER_ERROR_VULKAN_PIPELINE_LAYOUT;
+    goto err_layout;
+  }
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = *out_layout;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_info.basePipelineIndex = -1;
+  result = device->vkCreateComputePipelines(
+    device->device,
+    VK_NULL_HANDLE,
+    1,
+    &pipeline_info,
+    RENDER_ALLOC(PIPELINE),
+    out_pipeline
+  );
+  if (result != VK_SUCCESS) goto err_pipeline;
+  /* The pipeline keeps its own copy of the shader code */
+  device->vkDestroyShaderModule(
+    device->device,
+    module,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
+  return RENDER_ERROR_NONE;
+
+ err_pipeline:
+  device->vkDestroyPipelineLayout(
+    device->device,
+    *out_layout,
+    RENDER_ALLOC(PIPELINE_LAYOUT)
+  );
+ err_layout:
+  device->vkDestroyShaderModule(
+    device->device,
+    module,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
+  return err;
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+int render_compute_init(
+  struct render_compute *rc,
+  struct render_device *device,
+  size_t src_len,
+  uint32_t *src,
+  size_t n_buffers,
+  struct render_buffer *buffers,
+  uint32_t push_size
+) {
+  int err;
+
+  if (!rc) return RENDER_ERROR_NULL;
+  if (!device) return RENDER_ERROR_NULL;
+  if (!src) return RENDER_ERROR_NULL;
+  if (!buffers) return RENDER_ERROR_NULL;
+  /* A pool can't be made for zero descriptors */
+  if (!n_buffers) return RENDER_ERROR_VULKAN_DESCRIPTOR_SET;
+  memset(rc, 0, sizeof(struct render_compute));
+  chkerrg(
+    err = create_compute_desc_layout(device, n_buffers, &rc->desc_layout),
+    err_desc_layout
+  );
+  chkerrg(
+    err = create_compute_desc_set(
+      device,
+      rc->desc_layout,
+      n_buffers,
+      buffers,
+      &rc->desc_pool,
+      &rc->desc_set
+    ),
+    err_desc_set
+  );
+  chkerrg(
+    err = create_compute_pipeline(
+      device,
+      src_len,
+      src,
+      rc->desc_layout,
+      push_size,
+      &rc->pipeline_layout,
+      &rc->pipeline
+    ),
+    err_pipeline
+  );
+  rc->device = device;
+  rc->n_buffers = n_buffers;
+  rc->push_size = push_size;
+  return RENDER_ERROR_NONE;
+
+ err_pipeline:
+  device->vkDestroyDescriptorPool(
+    device->device,
+    rc->desc_pool,
+    RENDER_ALLOC(DESCRIPTOR_POOL)
+  );
+ err_desc_set:
+  device->vkDestroyDescriptorSetLayout(
+    device->device,
+    rc->desc_layout,
+    RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT)
+  );
+ err_desc_layout:
+  return err;
+}
+
+void render_compute_deinit(struct render_compute *rc) {
+  if (!rc || !rc->device) return;
+  rc->device->vkDestroyPipeline(
+    rc->device->device,
+    rc->pipeline,
+    RENDER_ALLOC(PIPELINE)
+  );
+  rc->device->vkDestroyPipelineLayout(
+    rc->device->device,
+    rc->pipeline_layout,
+    RENDER_ALLOC(PIPELINE_LAYOUT)
+  );
+  /* Destroying the pool frees the descriptor set with it */
+  rc->device->vkDestroyDescriptorPool(
+    rc->device->device,
+    rc->desc_pool,
+    RENDER_ALLOC(DESCRIPTOR_POOL)
+  );
+  rc->device->vkDestroyDescriptorSetLayout(
+    rc->device->device,
+    rc->desc_layout,
+    RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT)
+  );
+  memset(rc, 0, sizeof(struct render_compute));
+}
+
+void render_compute_dispatch(
+  struct render_compute *rc,
+  VkCommandBuffer command_buffer,
+  void *push_data,
+  uint32_t n_groups_x,
+  uint32_t n_groups_y,
+  uint32_t n_groups_z
+) {
+  /* no null check */
+  rc->device->vkCmdBindPipeline(
+    command_buffer,
+    VK_PIPELINE_BIND_POINT_COMPUTE,
+    rc->pipeline
+  );
+  rc->device->vkCmdBindDescriptorSets(
+    command_buffer,
+    VK_PIPELINE_BIND_POINT_COMPUTE,
+    rc->pipeline_layout,
+    0,
+    1,
+    &rc->desc_set,
+    0,
+    NULL
+  );
+  if (rc->push_size && push_data) {
+    rc->device->vkCmdPushConstants(
+      command_buffer,
+      rc->pipeline_layout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      rc->push_size,
+      push_data
+    );
+  }
+  rc->device->vkCmdDispatch(command_buffer, n_groups_x, n_groups_y, n_groups_z);
+}
+
+void render_compute_barrier(
+  struct render_device *device,
+  VkCommandBuffer command_buffer,
+  VkPipelineStageFlags src_stage,
+  VkAccessFlags src_access,
+  VkPipelineStageFlags dst_stage,
+  VkAccessFlags dst_access
+) {
+  VkMemoryBarrier barrier = { 0 };
+
+  /* A global memory barrier covers every buffer the compute pass touches,
+   * which is all we need since we never transfer queue ownership */
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = src_access;
+  barrier.dstAccessMask = dst_access;
+  device->vkCmdPipelineBarrier(
+    command_buffer,
+    src_stage,
+    dst_stage,
+    0,
+    (src_access || dst_access) ? 1 : 0,
+    (src_access || dst_access) ? &barrier : NULL,
+    0,
+    NULL,
+    0,
+    NULL
+  );
+}
@@ -22,12 +22,14 @@
 #include <string.h>
 
 static int get_queue_information(
+  struct arena *scratch,
   VkPhysicalDevice pdevice,
   VkSurfaceKHR surface,
   uint32_t *out_graphics_index,
   uint32_t *out_present_index
 ) {
   int graphics_set = 0, present_set = 0;
+  size_t mark;
   uint32_t i, n_props, graphics_index, present_index;
   VkQueueFamilyProperties *props;
   VkResult result;
@@ -38,15 +40,19 @@ static int get_queue_information(
     NULL
   );
   if (n_props == 0) goto err_n_props;
-  props = malloc(sizeof(VkQueueFamilyProperties) * n_props);
+  mark = arena_mark(scratch);
+  props = arena_alloc(scratch, sizeof(VkQueueFamilyProperties) * n_props);
   if (!props) goto err_props;
   vkGetPhysicalDeviceQueueFamilyProperties(pdevice, &n_props, props);
   for (i = 0; i < n_props; ++i) {
     uint32_t present_support = 0;
 
+    /* We record compute dispatches into the frame command buffers, so the
+     * graphics family has to take compute work as well */
     if (
       props[i].queueCount > 0
       && props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT
+      && props[i].queueFlags & VK_QUEUE_COMPUTE_BIT
     ) {
       graphics_set = 1;
       graphics_index = i;
@@ -63,15 +69,15 @@ static int get_queue_information(
       present_index = i;
     }
   }
-  free(props);
+  arena_release(scratch, mark);
   if (!graphics_set || !present_set) goto err_unset;
   *out_graphics_index = graphics_index;
   *out_present_index = present_index;
   return RENDER_ERROR_NONE;
 
- err_unset:
  err_surface_support:
-  free(props);
+  arena_release(scratch, mark);
+ err_unset:
  err_props:
  err_n_props:
   return RENDER_ERROR_VULKAN_QUEUE_INDICES;
@@ -79,6 +85,7 @@ static int get_queue_information(
 
 static int create_device(
   VkPhysicalDevice pdevice,
+  VkPhysicalDeviceFeatures *supported,
   uint32_t graphics_index,
   uint32_t present_index,
   VkDevice *out_device
@@ -103,6 +110,9 @@ static int create_device(
     queue_infos[1].queueFamilyIndex = present_index;
     queue_infos[1].pQueuePriorities = &priority;
   }
+  /* Only frame metrics use these, they're skipped without */
+  features.pipelineStatisticsQuery = supported->pipelineStatisticsQuery;
+  features.occlusionQueryPrecise = supported->occlusionQueryPrecise;
   create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   create_info.pEnabledFeatures = &features;
   create_info.enabledExtensionCount = 1;
@@ -112,7 +122,7 @@ static int create_device(
   result = vkCreateDevice(
     pdevice,
     &create_info,
-    NULL,
+    RENDER_ALLOC(DEVICE),
     out_device
   );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_DEVICE;
@@ -152,6 +162,11 @@ static int load_device_functions(VkDevice device, struct render_device *rd) {
   vkfunc(vkCmdBindVertexBuffers);
   vkfunc(vkCmdBindIndexBuffer);
   vkfunc(vkCmdDrawIndexed);
+  /* Compute */
+  vkfunc(vkCreateComputePipelines);
+  vkfunc(vkCmdDispatch);
+  vkfunc(vkCmdPipelineBarrier);
+  vkfunc(vkCmdPushConstants);
   /* Descriptors */
   vkfunc(vkCreateDescriptorPool);
   vkfunc(vkDestroyDescriptorPool);
@@ -177,6 +192,18 @@ static int load_device_functions(VkDevice device, struct render_device *rd) {
   vkfunc(vkQueueSubmit);
   vkfunc(vkQueuePresentKHR);
   vkfunc(vkQueueWaitIdle);
+  /* Sync */
+  vkfunc(vkCreateFence);
+  vkfunc(vkDestroyFence);
+  vkfunc(vkWaitForFences);
+  vkfunc(vkResetFences);
+  /* Queries */
+  vkfunc(vkCreateQueryPool);
+  vkfunc(vkDestroyQueryPool);
+  vkfunc(vkCmdResetQueryPool);
+  vkfunc(vkCmdBeginQuery);
+  vkfunc(vkCmdEndQuery);
+  vkfunc(vkGetQueryPoolResults);
   return RENDER_ERROR_NONE;
 
 #undef vkfunc
@@ -199,6 +226,8 @@ static VkPresentModeKHR choose_present_mode(
 }
 
 static int create_swapchain(
+  struct arena *scratch,
+  struct arena *images_arena,
   VkPhysicalDevice pdevice,
   VkDevice device,
   VkSurfaceKHR surface,
@@ -210,6 +239,7 @@ static int create_swapchain(
   uint32_t *out_n_images,
   VkImage **out_images
 ) {
+  size_t mark;
   uint32_t n_formats, n_present_modes, n_images;
   VkSurfaceCapabilitiesKHR caps;
   VkSurfaceFormatKHR *formats;
@@ -221,7 +251,8 @@ static int create_swapchain(
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(pdevice, surface, &caps);
   vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface, &n_formats, NULL);
   if (n_formats == 0) goto err_n_formats;
-  formats = malloc(sizeof(VkSurfaceFormatKHR) * n_formats);
+  mark = arena_mark(scratch);
+  formats = arena_alloc(scratch, sizeof(VkSurfaceFormatKHR) * n_formats);
   if (!formats) goto err_formats;
   vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface, &n_formats, formats);
   vkGetPhysicalDeviceSurfacePresentModesKHR(
@@ -231,7 +262,10 @@ static int create_swapchain(
     NULL
   );
   if (n_present_modes == 0) goto err_n_present_modes;
-  present_modes = malloc(sizeof(VkPresentModeKHR) * n_present_modes);
+  present_modes = arena_alloc(
+    scratch,
+    sizeof(VkPresentModeKHR) * n_present_modes
+  );
   if (!present_modes) goto err_present_modes;
   vkGetPhysicalDeviceSurfacePresentModesKHR(
     pdevice,
@@ -272,7 +306,7 @@ static int create_swapchain(
   result = vkCreateSwapchainKHR(
     device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(SWAPCHAIN),
     out_swapchain
   );
   if (result != VK_SUCCESS) goto err_swapchain;
@@ -283,7 +317,7 @@ static int create_swapchain(
     NULL
   );
   if (n_images == 0) goto err_swapchain_images;
-  *out_images = malloc(sizeof(VkImage) * n_images);
+  *out_images = arena_alloc(images_arena, sizeof(VkImage) * n_images);
   if (!*out_images) goto err_swapchain_images;
   vkGetSwapchainImagesKHR(
     device,
@@ -294,17 +328,15 @@ static int create_swapchain(
   *out_n_images = n_images;
   *out_surface_format = selected_format;
   *out_swap_extent = caps.currentExtent;
-  free(present_modes);
-  free(formats);
+  arena_release(scratch, mark);
   return RENDER_ERROR_NONE;
 
  err_swapchain_images:
  err_swapchain:
-  free(present_modes);
  err_present_modes:
  err_n_present_modes:
-  free(formats);
  err_formats:
+  arena_release(scratch, mark);
  err_n_formats:
   return RENDER_ERROR_VULKAN_SWAPCHAIN;
 }
@@ -341,6 +373,12 @@ int render_device_init(
   if (device_id > instance->n_pdevices) return RENDER_ERROR_VULKAN_INVALID_DEVICE;
 
   memset(rd, 0, sizeof(struct render_device));
+  err = RENDER_ERROR_MEMORY;
+  chkerrg(arena_init(&rd->scratch, RENDER_SCRATCH_SIZE), err_scratch);
+  chkerrg(
+    arena_init(&rd->swapchain_arena, RENDER_SWAPCHAIN_ARENA_SIZE),
+    err_swapchain_arena
+  );
 
   vkGetPhysicalDeviceProperties(instance->pdevices[device_id], &properties);
   vkGetPhysicalDeviceFeatures(instance->pdevices[device_id], &features);
@@ -351,6 +389,7 @@ int render_device_init(
 
   chkerrg(
     err = get_queue_information(
+      &rd->scratch,
       instance->pdevices[device_id],
       instance->surface,
       &graphics_index,
@@ -361,6 +400,7 @@ int render_device_init(
   chkerrg(
     err = create_device(
       instance->pdevices[device_id],
+      &features,
       graphics_index,
       present_index,
       &device
@@ -368,8 +408,11 @@ int render_device_init(
     err_device
   );
   chkerrg(err = load_device_functions(device, rd), err_load_functions);
+  render_profile_wrap(rd);
   chkerrg(
     err = create_swapchain(
+      &rd->scratch,
+      &rd->swapchain_arena,
       instance->pdevices[device_id],
       device,
       instance->surface,
@@ -387,14 +430,14 @@ int render_device_init(
   result = rd->vkCreateSemaphore(
     device,
     &semaphore_info,
-    NULL,
+    RENDER_ALLOC(SEMAPHORE),
     &image_semaphore
   );
   if (result != VK_SUCCESS) goto err_image_semaphore;
   result = rd->vkCreateSemaphore(
     device,
     &semaphore_info,
-    NULL,
+    RENDER_ALLOC(SEMAPHORE),
     &render_semaphore
   );
   if (result != VK_SUCCESS) goto err_render_semaphore;
@@ -437,36 +480,52 @@ int render_device_init(
   return RENDER_ERROR_NONE;
 
  err_memory:
-  rd->vkDestroySemaphore(device, render_semaphore, NULL);
+  rd->vkDestroySemaphore(device, render_semaphore, RENDER_ALLOC(SEMAPHORE));
  err_render_semaphore:
-  rd->vkDestroySemaphore(device, image_semaphore, NULL);
+  rd->vkDestroySemaphore(device, image_semaphore, RENDER_ALLOC(SEMAPHORE));
  err_image_semaphore:
-  free(swapchain_images);
-  vkDestroySwapchainKHR(device, swapchain, NULL);
+  vkDestroySwapchainKHR(device, swapchain, RENDER_ALLOC(SWAPCHAIN));
  err_swapchain:
  err_load_functions:
-  vkDestroyDevice(device, NULL);
+  vkDestroyDevice(device, RENDER_ALLOC(DEVICE));
  err_device:
  err_queue:
+  arena_deinit(&rd->swapchain_arena);
+ err_swapchain_arena:
+  arena_deinit(&rd->scratch);
+ err_scratch:
   return err;
 }
 
 void render_device_deinit(struct render_device *rd) {
-  rd->vkDestroyBuffer(rd->device, rd->memory.buffer, NULL);
-  rd->vkFreeMemory(rd->device, rd->memory.memory, NULL);
-  rd->vkDestroySemaphore(rd->device, rd->image_semaphore, NULL);
-  rd->vkDestroySemaphore(rd->device, rd->render_semaphore, NULL);
-  free(rd->swapchain_images);
-  vkDestroySwapchainKHR(rd->device, rd->swapchain, NULL);
-  vkDestroyDevice(rd->device, NULL);
+  rd->vkDestroyBuffer(rd->device, rd->memory.buffer, RENDER_ALLOC(BUFFER));
+  rd->vkFreeMemory(rd->device, rd->memory.memory, RENDER_ALLOC(MEMORY));
+  rd->vkDestroySemaphore(
+    rd->device,
+    rd->image_semaphore,
+    RENDER_ALLOC(SEMAPHORE)
+  );
+  rd->vkDestroySemaphore(
+    rd->device,
+    rd->render_semaphore,
+    RENDER_ALLOC(SEMAPHORE)
+  );
+  vkDestroySwapchainKHR(rd->device, rd->swapchain, RENDER_ALLOC(SWAPCHAIN));
+  vkDestroyDevice(rd->device, RENDER_ALLOC(DEVICE));
+  arena_deinit(&rd->swapchain_arena);
+  arena_deinit(&rd->scratch);
 }
 
 int render_device_recreate_swapchain(struct render_device *rd) {
   if (!rd) return RENDER_ERROR_NULL;
-  free(rd->swapchain_images);
-  vkDestroySwapchainKHR(rd->device, rd->swapchain, NULL);
+  arena_reset(&rd->swapchain_arena);
+  vkDestroySwapchainKHR(rd->device, rd->swapchain, RENDER_ALLOC(SWAPCHAIN));
+  /* Destroyed again by the next try or deinit if this one fails */
+  rd->swapchain = VK_NULL_HANDLE;
   chkerrg(
     create_swapchain(
+      &rd->scratch,
+      &rd->swapchain_arena,
       rd->instance->pdevices[rd->device_id],
       rd->device,
       rd->instance->surface,
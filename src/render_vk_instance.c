@@ -89,7 +89,7 @@ static int create_instance(
   create_info.enabledLayerCount = 1;
   create_info.ppEnabledLayerNames = (const char *const *) layers;
 #endif
-  result = vkCreateInstance(&create_info, NULL, out_instance);
+  result = vkCreateInstance(&create_info, RENDER_ALLOC(INSTANCE), out_instance);
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_CREATE_INSTANCE;
   return RENDER_ERROR_NONE;
 }
@@ -134,7 +134,12 @@ static int create_surface(
   create_info.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
   create_info.connection = window->os.cn;
   create_info.window = window->os.wn;
-  result = vkCreateXcbSurfaceKHR(instance, &create_info, NULL, out_surface);
+  result = vkCreateXcbSurfaceKHR(
+    instance,
+    &create_info,
+    RENDER_ALLOC(SURFACE),
+    out_surface
+  );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_SURFACE;
   return RENDER_ERROR_NONE;
 }
@@ -198,10 +203,10 @@ int render_instance_init(struct render_instance *r, struct window *window) {
   return RENDER_ERROR_NONE;
 
  err_devices:
-  vkDestroySurfaceKHR(instance, surface, NULL);
+  vkDestroySurfaceKHR(instance, surface, RENDER_ALLOC(SURFACE));
  err_surface:
  err_instance_functions:
-  vkDestroyInstance(instance, NULL);
+  vkDestroyInstance(instance, RENDER_ALLOC(INSTANCE));
  err_instance:
  err_preinstance_functions:
 #ifdef PLATFORM_LINUX
@@ -213,8 +218,8 @@ int render_instance_init(struct render_instance *r, struct window *window) {
 
 void render_instance_deinit(struct render_instance *r) {
   free(r->pdevices);
-  vkDestroySurfaceKHR(r->instance, r->surface, NULL);
-  vkDestroyInstance(r->instance, NULL);
+  vkDestroySurfaceKHR(r->instance, r->surface, RENDER_ALLOC(SURFACE));
+  vkDestroyInstance(r->instance, RENDER_ALLOC(INSTANCE));
 #ifdef PLATFORM_LINUX
   dlclose(r->vk_handle);
 #endif
@@ -66,7 +66,7 @@ int render_memory_init(
   result = device->vkCreateBuffer(
     device->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(BUFFER),
     &rm->buffer
   );
   if (result != VK_SUCCESS) {
@@ -90,7 +90,7 @@ int render_memory_init(
   result = device->vkAllocateMemory(
     device->device,
     &alloc_info,
-    NULL,
+    RENDER_ALLOC(MEMORY),
     &rm->memory
   );
   chkerrf(
@@ -103,21 +103,51 @@ int render_memory_init(
 
  err_memory:
  err_index:
-  device->vkDestroyBuffer(device->device, rm->buffer, NULL);
+  device->vkDestroyBuffer(device->device, rm->buffer, RENDER_ALLOC(BUFFER));
  err_buffer:
   return err;
 }
 
 void render_memory_deinit(struct render_memory *rm) {
   if (!rm) return;
-  rm->device->vkDestroyBuffer(rm->device->device, rm->buffer, NULL);
-  rm->device->vkFreeMemory(rm->device->device, rm->memory, NULL);
+  if (rm->mapped) rm->device->vkUnmapMemory(rm->device->device, rm->memory);
+  rm->mapped = NULL;
+  rm->device->vkDestroyBuffer(
+    rm->device->device,
+    rm->buffer,
+    RENDER_ALLOC(BUFFER)
+  );
+  rm->device->vkFreeMemory(
+    rm->device->device,
+    rm->memory,
+    RENDER_ALLOC(MEMORY)
+  );
 }
 
 void render_memory_reset(struct render_memory *rm) {
   rm->offset = 0;
 }
 
+int render_memory_map(struct render_memory *rm) {
+  VkResult result;
+
+  if (!rm) return RENDER_ERROR_NULL;
+  if (rm->mapped) return RENDER_ERROR_NONE;
+  result = rm->device->vkMapMemory(
+    rm->device->device,
+    rm->memory,
+    0,
+    VK_WHOLE_SIZE,
+    0,
+    (void **) &rm->mapped
+  );
+  if (result != VK_SUCCESS) {
+    rm->mapped = NULL;
+    return RENDER_ERROR_VULKAN_MEMORY_MAP;
+  }
+  return RENDER_ERROR_NONE;
+}
+
 int render_memory_create_buffer(
   struct render_memory *rm,
   size_t align,
@@ -139,7 +169,7 @@ int render_memory_create_buffer(
   result = rm->device->vkCreateBuffer(
     rm->device->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(BUFFER),
     &out_buffer->buffer
   );
   chkerrg(result != VK_SUCCESS, err_buffer);
@@ -167,7 +197,11 @@ int render_memory_create_buffer(
   return RENDER_ERROR_NONE;
 
  err_bind:
-  rm->device->vkDestroyBuffer(rm->device->device, out_buffer->buffer, NULL);
+  rm->device->vkDestroyBuffer(
+    rm->device->device,
+    out_buffer->buffer,
+    RENDER_ALLOC(BUFFER)
+  );
  err_buffer:
   return RENDER_ERROR_VULKAN_BUFFER;
 }
@@ -177,7 +211,7 @@ void render_buffer_destroy(struct render_buffer *rb) {
   rb->memory->device->vkDestroyBuffer(
     rb->memory->device->device,
     rb->buffer,
-    NULL
+    RENDER_ALLOC(BUFFER)
   );
   /* TODO: update parent memory that this buffer has been freed */
 }
@@ -202,6 +236,21 @@ int render_buffer_write(
   range.memory = rb->memory->memory;
   range.offset = begin;
   range.size = len;
+  if (rb->memory->mapped) {
+    size_t end = rb->offset + size;
+
+    memcpy(rb->memory->mapped + rb->offset, data, size);
+    /* The flush has to cover whole atoms, and the last one may run past
+     * the end of the allocation */
+    end += (align - (end % align)) % align;
+    range.size = (end > rb->memory->size) ? VK_WHOLE_SIZE : end - begin;
+    rb->memory->device->vkFlushMappedMemoryRanges(
+      rb->memory->device->device,
+      1,
+      &range
+    );
+    return RENDER_ERROR_NONE;
+  }
   result = rb->memory->device->vkMapMemory(
     rb->memory->device->device,
     range.memory,
@@ -20,17 +20,41 @@
 #include "error.h"
 #include "shaders/default_vert.h"
 #include "shaders/default_frag.h"
+#include "shaders/default_comp.h"
 #include "trig.h"
+#include "timer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-struct uniforms {
-  struct vec3 color;
-  char pad0;
-  struct mat4 m;
+/* How long the window has to keep its size before the swapchain follows */
+#define RESIZE_SETTLE_NS 100000000UL
+/* Results come back in bit order, the same as render_frame_metrics */
+#define PASS_STATISTICS ( \
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT \
+  | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT \
+  | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT \
+  | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT \
+  | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT \
+  | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT \
+)
+
+/* Push constants for shaders/default_comp.comp */
+struct compute_push {
+  uint32_t n_vertices;
+  uint32_t stride;
 };
 
+enum {
+  COMPUTE_LOCAL_SIZE = 64,
+  N_VERTICES = 4,
+  VERTEX_STRIDE = 6,
+  N_STATISTICS = 6
+};
+
+/* Set by render_pass_enable_compute */
+static int compute_enabled = 0;
+
 /* TODO: Globals for now, will be passed in later */
 VkVertexInputBindingDescription bindings[] = {
   { 0, sizeof(float) * 6, VK_VERTEX_INPUT_RATE_VERTEX }
@@ -56,7 +80,7 @@ static int create_pipeline_layout(
   result = device->vkCreatePipelineLayout(
     device->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(PIPELINE_LAYOUT),
     out_layout
   );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_PIPELINE_LAYOUT;
@@ -103,7 +127,7 @@ static int create_render_pass(
   result = device->vkCreateRenderPass(
     device->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(RENDER_PASS),
     out_render_pass
   );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_RENDER_PASS;
@@ -125,7 +149,7 @@ static int create_shader(
   result = device->vkCreateShaderModule(
     device->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(SHADER_MODULE),
     out_module
   );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_SHADER_MODULE;
@@ -307,12 +331,20 @@ static int create_pipeline(
     VK_NULL_HANDLE,
     1,
     &graphics_pipeline,
-    NULL,
+    RENDER_ALLOC(PIPELINE),
     &pipeline
   );
   if (result != VK_SUCCESS) goto err_graphics_pipeline;
-  device->vkDestroyShaderModule(device->device, vmodule, NULL);
-  device->vkDestroyShaderModule(device->device, fmodule, NULL);
+  device->vkDestroyShaderModule(
+    device->device,
+    vmodule,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
+  device->vkDestroyShaderModule(
+    device->device,
+    fmodule,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
   *out_render_pass = render_pass;
   *out_pipeline_layout = layout;
   *out_pipeline = pipeline;
@@ -320,19 +352,36 @@ static int create_pipeline(
   return RENDER_ERROR_NONE;
 
  err_graphics_pipeline:
-  device->vkDestroyShaderModule(device->device, fmodule, NULL);
+  device->vkDestroyShaderModule(
+    device->device,
+    fmodule,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
  err_fmodule:
-  device->vkDestroyShaderModule(device->device, vmodule, NULL);
+  device->vkDestroyShaderModule(
+    device->device,
+    vmodule,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
  err_vmodule:
-  device->vkDestroyRenderPass(device->device, render_pass, NULL);
+  device->vkDestroyRenderPass(
+    device->device,
+    render_pass,
+    RENDER_ALLOC(RENDER_PASS)
+  );
  err_render_pass:
-  device->vkDestroyPipelineLayout(device->device, layout, NULL);
+  device->vkDestroyPipelineLayout(
+    device->device,
+    layout,
+    RENDER_ALLOC(PIPELINE_LAYOUT)
+  );
  err_pipeline_layout:
   return err;
 }
 
 static int create_image_views(
   struct render_device *device,
+  struct arena *arena,
   size_t n_images,
   VkImage *images,
   VkImageView **out_image_views
@@ -341,7 +390,7 @@ static int create_image_views(
   VkImageViewCreateInfo create_info = { 0 };
   VkResult result;
 
-  *out_image_views = malloc(sizeof(VkImage) * n_images);
+  *out_image_views = arena_alloc(arena, sizeof(VkImageView) * n_images);
   if (!*out_image_views) return RENDER_ERROR_MEMORY;
   for (i = 0; i < n_images; ++i) {
     create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -360,7 +409,7 @@ static int create_image_views(
     result = device->vkCreateImageView(
       device->device,
       &create_info,
-      NULL,
+      RENDER_ALLOC(IMAGE_VIEW),
       &(*out_image_views)[i]
     );
     if (result != VK_SUCCESS) goto err_loop_image_views;
@@ -372,10 +421,9 @@ static int create_image_views(
       device->vkDestroyImageView(
         device->device,
         (*out_image_views)[i],
-        NULL
+        RENDER_ALLOC(IMAGE_VIEW)
       );
     }
-    free(*out_image_views);
     return RENDER_ERROR_VULKAN_IMAGE_VIEW;
   }
   return RENDER_ERROR_NONE;
@@ -383,6 +431,7 @@ static int create_image_views(
 
 static int create_framebuffers(
   struct render_device *device,
+  struct arena *arena,
   VkRenderPass render_pass,
   size_t n_framebuffers,
   VkImageView *images,
@@ -392,7 +441,10 @@ static int create_framebuffers(
   VkFramebufferCreateInfo create_info = { 0 };
   VkResult result;
 
-  *out_framebuffers = malloc(sizeof(VkFramebuffer) * n_framebuffers);
+  *out_framebuffers = arena_alloc(
+    arena,
+    sizeof(VkFramebuffer) * n_framebuffers
+  );
   if (!*out_framebuffers) return RENDER_ERROR_MEMORY;
   for (i = 0; i < device->n_swapchain_images; ++i) {
     create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -405,7 +457,7 @@ static int create_framebuffers(
     result = device->vkCreateFramebuffer(
       device->device,
       &create_info,
-      NULL,
+      RENDER_ALLOC(FRAMEBUFFER),
       &(*out_framebuffers)[i]
     );
     if (result != VK_SUCCESS) goto err_loop_framebuffer;
@@ -417,10 +469,9 @@ static int create_framebuffers(
       device->vkDestroyFramebuffer(
         device->device,
         (*out_framebuffers)[i],
-        NULL
+        RENDER_ALLOC(FRAMEBUFFER)
       );
     }
-    free(*out_framebuffers);
     return RENDER_ERROR_VULKAN_FRAMEBUFFER;
   }
 
@@ -430,34 +481,31 @@ static int create_framebuffers(
 /* TODO: Pass in descriptor layouts instead of relying on rp to have them */
 static int create_descriptor_sets(
   struct render_device *device,
+  struct arena *arena,
   size_t n_desc_layouts,
   VkDescriptorSetLayout *desc_layouts,
   VkDescriptorPool desc_pool,
   VkDescriptorSet **out_desc_sets
 ) {
-  enum {
-    MAX_STACK_LAYOUTS = 8
-  };
-
-  size_t i;
+  size_t i, mark;
   VkDescriptorSetAllocateInfo alloc_info = { 0 };
-  VkDescriptorSetLayout stack_layouts[MAX_STACK_LAYOUTS];
   VkDescriptorSetLayout *layouts;
   VkResult result;
 
-  if (device->n_swapchain_images > MAX_STACK_LAYOUTS) {
-    /* TODO */
-    fprintf(stderr, "%s:%d:UNIMPLEMENTED", __FILE__, __LINE__);
-    abort();
-  } else {
-    /* TODO: Allow for more than one descriptor set */
-    layouts = stack_layouts;
-    for (i = 0; i < device->n_swapchain_images; ++i) {
-      layouts[i] = desc_layouts[0];
-    }
+  mark = arena_mark(&device->scratch);
+  layouts = arena_alloc(
+    &device->scratch,
+    sizeof(VkDescriptorSetLayout) * device->n_swapchain_images
+  );
+  if (!layouts) goto err_desc_memory;
+  /* TODO: Allow for more than one descriptor set */
+  for (i = 0; i < device->n_swapchain_images; ++i) {
+    layouts[i] = desc_layouts[0];
   }
-  *out_desc_sets =
-    malloc(sizeof(VkDescriptorSet) * device->n_swapchain_images);
+  *out_desc_sets = arena_alloc(
+    arena,
+    sizeof(VkDescriptorSet) * device->n_swapchain_images
+  );
   if (!*out_desc_sets) goto err_desc_memory;
   alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   alloc_info.descriptorPool = desc_pool;
@@ -469,11 +517,12 @@ static int create_descriptor_sets(
     *out_desc_sets
   );
   if (result != VK_SUCCESS) goto err_desc_sets;
+  arena_release(&device->scratch, mark);
   return RENDER_ERROR_NONE;
 
  err_desc_sets:
-  free(*out_desc_sets);
  err_desc_memory:
+  arena_release(&device->scratch, mark);
   return RENDER_ERROR_VULKAN_DESCRIPTOR_SET;
 }
 
@@ -489,7 +538,7 @@ static int write_descriptor_sets(
   for (i = 0; i < device->n_swapchain_images; ++i) {
     buffer_info.buffer = uniforms[i].buffer;
     buffer_info.offset = 0;
-    buffer_info.range = sizeof(struct uniforms);
+    buffer_info.range = sizeof(struct render_uniforms);
     write_info.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     write_info.dstSet = desc_sets[i];
     write_info.dstBinding = 0;
@@ -520,7 +569,7 @@ static int create_command_pool(
   result = rd->vkCreateCommandPool(
     rd->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(COMMAND_POOL),
     out_pool
   );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_COMMAND_POOL;
@@ -544,7 +593,7 @@ static int create_descriptor_pool(
   result = device->vkCreateDescriptorPool(
     device->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(DESCRIPTOR_POOL),
     out_desc_pool
   );
   if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_DESCRIPTOR_POOL;
@@ -554,6 +603,7 @@ static int create_descriptor_pool(
 
 static int create_command_buffers(
   struct render_device *device,
+  struct arena *arena,
   VkCommandPool command_pool,
   VkCommandBuffer **out_command_buffers
 ) {
@@ -561,8 +611,10 @@ static int create_command_buffers(
   VkCommandBufferAllocateInfo alloc_info = { 0 };
   VkResult result;
 
-  *out_command_buffers =
-    malloc(sizeof(VkCommandBuffer) * device->n_swapchain_images);
+  *out_command_buffers = arena_alloc(
+    arena,
+    sizeof(VkCommandBuffer) * device->n_swapchain_images
+  );
   if (!*out_command_buffers) goto err_command_buffer_memory;
   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   alloc_info.commandPool = command_pool;
@@ -577,7 +629,6 @@ static int create_command_buffers(
   return RENDER_ERROR_NONE;
 
  err_command_buffer:
-  free(*out_command_buffers);
  err_command_buffer_memory:
   return err;
 }
@@ -598,11 +649,13 @@ static int create_vertex_data(
   };
   uint16_t indices[] = { 0, 1, 2, 2, 3, 0 };
 
+  /* The vertices are also bound as a storage buffer so the compute pass
+   * can write into them */
   chkerrg(
     err = render_memory_create_buffer(
       &rd->memory,
       16,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
       size_verts,
       out_vertices
     ),
@@ -638,6 +691,69 @@ static int create_vertex_data(
   return err;
 }
 
+static void destroy_query_pools(
+  struct render_device *device,
+  VkQueryPool stats_pool,
+  VkQueryPool occlusion_pool
+) {
+  device->vkDestroyQueryPool(
+    device->device,
+    stats_pool,
+    RENDER_ALLOC(QUERY_POOL)
+  );
+  device->vkDestroyQueryPool(
+    device->device,
+    occlusion_pool,
+    RENDER_ALLOC(QUERY_POOL)
+  );
+}
+
+static int create_query_pools(
+  struct render_device *device,
+  VkQueryPool *out_stats_pool,
+  VkQueryPool *out_occlusion_pool
+) {
+  VkQueryPoolCreateInfo create_info = { 0 };
+  VkResult result;
+
+  *out_stats_pool = VK_NULL_HANDLE;
+  *out_occlusion_pool = VK_NULL_HANDLE;
+  create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  create_info.queryCount = (uint32_t) device->n_swapchain_images;
+  if (device->features.pipelineStatisticsQuery) {
+    create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    create_info.pipelineStatistics = PASS_STATISTICS;
+    result = device->vkCreateQueryPool(
+      device->device,
+      &create_info,
+      RENDER_ALLOC(QUERY_POOL),
+      out_stats_pool
+    );
+    if (result != VK_SUCCESS) goto err_stats;
+  }
+  /* An imprecise count may only say whether anything passed, which
+   * tells nothing about overdraw */
+  if (device->features.occlusionQueryPrecise) {
+    create_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+    create_info.pipelineStatistics = 0;
+    result = device->vkCreateQueryPool(
+      device->device,
+      &create_info,
+      RENDER_ALLOC(QUERY_POOL),
+      out_occlusion_pool
+    );
+    if (result != VK_SUCCESS) goto err_occlusion;
+  }
+  return RENDER_ERROR_NONE;
+
+ err_occlusion:
+  destroy_query_pools(device, *out_stats_pool, VK_NULL_HANDLE);
+  *out_stats_pool = VK_NULL_HANDLE;
+  *out_occlusion_pool = VK_NULL_HANDLE;
+ err_stats:
+  return RENDER_ERROR_VULKAN_QUERY_POOL;
+}
+
 static int write_buffers(
   struct render_device *device,
   VkCommandBuffer *command_buffers,
@@ -647,12 +763,19 @@ static int write_buffers(
   VkPipeline pipeline,
   VkDescriptorSet *desc_sets,
   struct render_buffer *vertices,
-  struct render_buffer *indices
+  struct render_buffer *indices,
+  struct render_compute *compute,
+  VkQueryPool stats_pool,
+  VkQueryPool occlusion_pool
 ) {
   size_t i;
+  struct compute_push push = { 0 };
   VkCommandBufferBeginInfo begin_info = { 0 };
   VkResult result;
 
+  push.n_vertices = N_VERTICES;
+  push.stride = VERTEX_STRIDE;
+
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   /* begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT; */
   for (i = 0; i < device->n_swapchain_images; ++i) {
@@ -661,6 +784,54 @@ static int write_buffers(
 
     result = device->vkBeginCommandBuffer(command_buffers[i], &begin_info);
     if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_COMMAND_BUFFER_BEGIN;
+    /* Only initialized when enabled, see render_pass_enable_compute */
+    if (compute->device) {
+      /* The previous frame may still be reading the vertices, so wait for
+       * vertex input before the compute pass overwrites them */
+      render_compute_barrier(
+        device,
+        command_buffers[i],
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0
+      );
+      render_compute_dispatch(
+        compute,
+        command_buffers[i],
+        &push,
+        (N_VERTICES + COMPUTE_LOCAL_SIZE - 1) / COMPUTE_LOCAL_SIZE,
+        1,
+        1
+      );
+      /* Shader writes have to land before the vertex fetch reads them */
+      render_compute_barrier(
+        device,
+        command_buffers[i],
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+      );
+    }
+    /* Has to happen outside the render pass. The last results of this
+     * image were read before it was submitted again */
+    if (stats_pool != VK_NULL_HANDLE) {
+      device->vkCmdResetQueryPool(
+        command_buffers[i],
+        stats_pool,
+        (uint32_t) i,
+        1
+      );
+    }
+    if (occlusion_pool != VK_NULL_HANDLE) {
+      device->vkCmdResetQueryPool(
+        command_buffers[i],
+        occlusion_pool,
+        (uint32_t) i,
+        1
+      );
+    }
     clear_value.color.float32[3] = 1.0f;
     render_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     render_info.renderPass = render_pass;
@@ -706,7 +877,33 @@ static int write_buffers(
         0,
         VK_INDEX_TYPE_UINT16
       );
+      if (stats_pool != VK_NULL_HANDLE) {
+        device->vkCmdBeginQuery(
+          command_buffers[i],
+          stats_pool,
+          (uint32_t) i,
+          0
+        );
+      }
+      if (occlusion_pool != VK_NULL_HANDLE) {
+        device->vkCmdBeginQuery(
+          command_buffers[i],
+          occlusion_pool,
+          (uint32_t) i,
+          VK_QUERY_CONTROL_PRECISE_BIT
+        );
+      }
       device->vkCmdDrawIndexed(command_buffers[i], 6, 1, 0, 0, 0);
+      if (occlusion_pool != VK_NULL_HANDLE) {
+        device->vkCmdEndQuery(
+          command_buffers[i],
+          occlusion_pool,
+          (uint32_t) i
+        );
+      }
+      if (stats_pool != VK_NULL_HANDLE) {
+        device->vkCmdEndQuery(command_buffers[i], stats_pool, (uint32_t) i);
+      }
     }
     device->vkCmdEndRenderPass(command_buffers[i]);
     result = device->vkEndCommandBuffer(command_buffers[i]);
@@ -727,24 +924,26 @@ static int teardown_pass(struct render_pass *rp) {
     rp->device->vkDestroyDescriptorSetLayout(
       rp->device->device,
       rp->desc_layouts[i],
-      NULL
+      RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT)
     );
   }
-  free(rp->desc_layouts);
-  free(rp->desc_sets);
 
-  rp->device->vkDestroyDescriptorPool(rp->device->device, rp->desc_pool, NULL);
+  rp->device->vkDestroyDescriptorPool(
+    rp->device->device,
+    rp->desc_pool,
+    RENDER_ALLOC(DESCRIPTOR_POOL)
+  );
 
   for (i = 0; i < rp->device->n_swapchain_images; ++i) {
     rp->device->vkDestroyImageView(
       rp->device->device,
       rp->image_views[i],
-      NULL
+      RENDER_ALLOC(IMAGE_VIEW)
     );
     rp->device->vkDestroyFramebuffer(
       rp->device->device,
       rp->framebuffers[i],
-      NULL
+      RENDER_ALLOC(FRAMEBUFFER)
     );
   }
   rp->device->vkFreeCommandBuffers(
@@ -753,21 +952,34 @@ static int teardown_pass(struct render_pass *rp) {
     (uint32_t) rp->device->n_swapchain_images,
     rp->command_buffers
   );
+  destroy_query_pools(rp->device, rp->stats_pool, rp->occlusion_pool);
+  /* Whatever was in flight is gone with the pools */
+  rp->metrics_pending = 0;
 
-  free(rp->command_buffers);
-  rp->device->vkDestroyRenderPass(rp->device->device, rp->render_pass, NULL);
-  rp->device->vkDestroyPipeline(rp->device->device, rp->pipeline, NULL);
+  rp->device->vkDestroyRenderPass(
+    rp->device->device,
+    rp->render_pass,
+    RENDER_ALLOC(RENDER_PASS)
+  );
+  rp->device->vkDestroyPipeline(
+    rp->device->device,
+    rp->pipeline,
+    RENDER_ALLOC(PIPELINE)
+  );
   rp->device->vkDestroyPipelineLayout(
     rp->device->device,
     rp->pipeline_layout,
-    NULL
+    RENDER_ALLOC(PIPELINE_LAYOUT)
   );
+  /* Every array above came out of here */
+  arena_reset(&rp->arena);
 
   return RENDER_ERROR_NONE;
 }
 
 static int create_descriptor_layouts(
   struct render_device *device,
+  struct arena *arena,
   uint32_t n_desc_layouts,
   VkDescriptorSetLayoutCreateInfo *desc_layout_info,
   VkDescriptorSetLayout **out_desc_layouts
@@ -775,14 +987,16 @@ static int create_descriptor_layouts(
   size_t i;
   VkResult result;
 
-  *out_desc_layouts =
-    malloc(sizeof(VkDescriptorSetLayout) * device->n_swapchain_images);
+  *out_desc_layouts = arena_alloc(
+    arena,
+    sizeof(VkDescriptorSetLayout) * device->n_swapchain_images
+  );
   if (!*out_desc_layouts) return RENDER_ERROR_MEMORY;
   for (i = 0; i < n_desc_layouts; ++i) {
     result = device->vkCreateDescriptorSetLayout(
       device->device,
       desc_layout_info,
-      NULL,
+      RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT),
       &(*out_desc_layouts)[i]
     );
     if (result != VK_SUCCESS) goto err_descriptors;
@@ -793,9 +1007,8 @@ static int create_descriptor_layouts(
     while (i--) device->vkDestroyDescriptorSetLayout(
       device->device,
       (*out_desc_layouts)[i],
-      NULL
+      RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT)
     );
-    free(*out_desc_layouts);
     return RENDER_ERROR_VULKAN_DESCRIPTOR_SET;
   }
   return RENDER_ERROR_NONE;
@@ -803,12 +1016,15 @@ static int create_descriptor_layouts(
 
 static int create_uniform_buffers(
   struct render_memory *memory,
+  struct arena *arena,
   struct render_buffer **out_uniforms
 ) {
   size_t i;
 
-  *out_uniforms =
-    malloc(sizeof(struct render_buffer) * memory->device->n_swapchain_images);
+  *out_uniforms = arena_alloc(
+    arena,
+    sizeof(struct render_buffer) * memory->device->n_swapchain_images
+  );
   if (!*out_uniforms) return RENDER_ERROR_MEMORY;
   for (i = 0; i < memory->device->n_swapchain_images; ++i) {
     int err;
@@ -817,7 +1033,7 @@ static int create_uniform_buffers(
       memory,
       16,
       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      sizeof(struct uniforms),
+      sizeof(struct render_uniforms),
       *out_uniforms + i
     );
     if (err) goto err_loop;
@@ -826,7 +1042,6 @@ static int create_uniform_buffers(
 
   err_loop:
     while (i--) render_buffer_destroy(*out_uniforms + i);
-    free(*out_uniforms);
     return RENDER_ERROR_VULKAN_BUFFER;
   }
 
@@ -835,6 +1050,7 @@ static int create_uniform_buffers(
 
 static int create_pass(
   struct render_device *device,
+  struct arena *arena,
   size_t n_desc_layouts,
   VkDescriptorSetLayoutCreateInfo *desc_layout_info,
   size_t n_bindings,
@@ -842,6 +1058,7 @@ static int create_pass(
   size_t n_attrs,
   VkVertexInputAttributeDescription *attrs,
   struct render_memory *uniform_memory,
+  struct render_uniforms *uniform_data,
   /* out params */
   VkDescriptorSetLayout **out_desc_layouts,
   VkDescriptorPool *out_desc_pool,
@@ -854,8 +1071,11 @@ static int create_pass(
   VkDescriptorSet **out_desc_sets,
   VkCommandBuffer **out_command_buffers,
   VkCommandPool *out_command_pool,
+  VkQueryPool *out_stats_pool,
+  VkQueryPool *out_occlusion_pool,
   struct render_buffer *vertices,
-  struct render_buffer *indices
+  struct render_buffer *indices,
+  struct render_compute *compute
 ) {
   int err = RENDER_ERROR_VULKAN_SWAPCHAIN_RECREATE;
   size_t i;
@@ -863,6 +1083,7 @@ static int create_pass(
   chkerrg(
     err = create_descriptor_layouts(
       device,
+      arena,
       (uint32_t) n_desc_layouts,
       desc_layout_info,
       out_desc_layouts
@@ -876,22 +1097,15 @@ static int create_pass(
   );
 
   chkerrg(
-    err = create_uniform_buffers(uniform_memory, out_uniforms),
+    err = create_uniform_buffers(uniform_memory, arena, out_uniforms),
     err_uniforms
   );
 
   for (i = 0; i < device->n_swapchain_images; ++i) {
-    struct uniforms data = { 0 };
-
-    /* data.color.x = 1.0; */
-    /* data.color.y = 1.0; */
-    data.m.data[0] = 1.0;
-    data.m.data[1] = 1.0;
-    data.m.data[2] = 1.0;
     render_buffer_write(
       &(*out_uniforms)[i],
-      sizeof(struct uniforms),
-      (void *) &data
+      sizeof(struct render_uniforms),
+      (void *) uniform_data
     );
   }
 
@@ -914,6 +1128,7 @@ static int create_pass(
   chkerrg(
     err = create_image_views(
       device,
+      arena,
       device->n_swapchain_images,
       device->swapchain_images,
       out_image_views
@@ -924,6 +1139,7 @@ static int create_pass(
   chkerrg(
     err = create_framebuffers(
       device,
+      arena,
       *out_render_pass,
       device->n_swapchain_images,
       *out_image_views,
@@ -935,6 +1151,7 @@ static int create_pass(
   chkerrg(
     err = create_descriptor_sets(
       device,
+      arena,
       n_desc_layouts,
       *out_desc_layouts,
       *out_desc_pool,
@@ -950,11 +1167,16 @@ static int create_pass(
   chkerrg(
     err = create_command_buffers(
       device,
+      arena,
       *out_command_pool,
       out_command_buffers
     ),
     err_command_buffers
   );
+  chkerrg(
+    err = create_query_pools(device, out_stats_pool, out_occlusion_pool),
+    err_query_pools
+  );
   chkerrg(
     err = write_buffers(
       device,
@@ -965,7 +1187,10 @@ static int create_pass(
       *out_pipeline,
       *out_desc_sets,
       vertices,
-      indices
+      indices,
+      compute,
+      *out_stats_pool,
+      *out_occlusion_pool
     ),
     err_write_buffers
   );
@@ -973,13 +1198,14 @@ static int create_pass(
   return RENDER_ERROR_NONE;
 
  err_write_buffers:
+  destroy_query_pools(device, *out_stats_pool, *out_occlusion_pool);
+ err_query_pools:
   device->vkFreeCommandBuffers(
     device->device,
     *out_command_pool,
     (uint32_t) device->n_swapchain_images,
     *out_command_buffers
   );
-  free(*out_command_buffers);
  err_command_buffers:
  err_write_descriptor_sets:
  err_descriptor_sets:
@@ -990,7 +1216,7 @@ static int create_pass(
       device->vkDestroyFramebuffer(
         device->device,
         (*out_framebuffers)[i],
-        NULL
+        RENDER_ALLOC(FRAMEBUFFER)
       );
     }
   }
@@ -1002,14 +1228,26 @@ static int create_pass(
       device->vkDestroyImageView(
         device->device,
         (*out_image_views)[i],
-        NULL
+        RENDER_ALLOC(IMAGE_VIEW)
       );
     }
   }
  err_image_views:
-  device->vkDestroyRenderPass(device->device, *out_render_pass, NULL);
-  device->vkDestroyPipelineLayout(device->device, *out_pipeline_layout, NULL);
-  device->vkDestroyPipeline(device->device, *out_pipeline, NULL);
+  device->vkDestroyRenderPass(
+    device->device,
+    *out_render_pass,
+    RENDER_ALLOC(RENDER_PASS)
+  );
+  device->vkDestroyPipelineLayout(
+    device->device,
+    *out_pipeline_layout,
+    RENDER_ALLOC(PIPELINE_LAYOUT)
+  );
+  device->vkDestroyPipeline(
+    device->device,
+    *out_pipeline,
+    RENDER_ALLOC(PIPELINE)
+  );
  err_pipeline:
   {
     size_t i;
@@ -1018,9 +1256,12 @@ static int create_pass(
       render_buffer_destroy(*out_uniforms + i);
     }
   }
-  free(*out_uniforms);
  err_uniforms:
-  device->vkDestroyDescriptorPool(device->device, *out_desc_pool, NULL);
+  device->vkDestroyDescriptorPool(
+    device->device,
+    *out_desc_pool,
+    RENDER_ALLOC(DESCRIPTOR_POOL)
+  );
  err_descriptor_pool:
   {
     size_t i;
@@ -1029,24 +1270,32 @@ static int create_pass(
       device->vkDestroyDescriptorSetLayout(
         device->device,
         (*out_desc_layouts)[i],
-        NULL
+        RENDER_ALLOC(DESCRIPTOR_SET_LAYOUT)
       );
     }
   }
-  free(*out_desc_layouts);
  err_descriptors:
+  /* Whatever the arrays took is given back by the next arena_reset */
   return err;
 }
 
+/* Leaves the pass stale when it fails so the next update tries again */
 static int recreate_pass(struct render_pass *rp) {
   int err = RENDER_ERROR_VULKAN_SWAPCHAIN_RECREATE;
   size_t n_bindings, n_attrs;
   VkDescriptorSetLayoutCreateInfo desc_layout_info = { 0 };
   VkDescriptorSetLayoutBinding desc_layout_bindings[] = { 0 };
 
-  render_device_recreate_swapchain(rp->device);
+  rp->stale = 1;
+  /* The image views go before the swapchain images they point at */
+  if (!rp->torn_down) {
+    teardown_pass(rp);
+    rp->torn_down = 1;
+  } else {
+    /* The last try left its arrays in there */
+    arena_reset(&rp->arena);
+  }
   if ((err = render_device_recreate_swapchain(rp->device))) return err;
-  teardown_pass(rp);
   /* TODO: move out the vertices, indices, and descriptor stuff */
   n_bindings = sizeof(bindings) / sizeof(bindings[0]);
   n_attrs = sizeof(attrs) / sizeof(attrs[0]);
@@ -1062,6 +1311,7 @@ static int recreate_pass(struct render_pass *rp) {
   desc_layout_info.pBindings = desc_layout_bindings;
   err = create_pass(
     rp->device,
+    &rp->arena,
     1,
     &desc_layout_info,
     n_bindings,
@@ -1069,6 +1319,7 @@ static int recreate_pass(struct render_pass *rp) {
     n_attrs,
     attrs,
     &rp->uniform_memory,
+    &rp->uniform_data,
     &rp->desc_layouts,
     &rp->desc_pool,
     &rp->uniforms,
@@ -1080,13 +1331,83 @@ static int recreate_pass(struct render_pass *rp) {
     &rp->desc_sets,
     &rp->command_buffers,
     &rp->command_pool,
+    &rp->stats_pool,
+    &rp->occlusion_pool,
     &rp->vertices,
-    &rp->indices
+    &rp->indices,
+    &rp->compute
   );
   if (err) return err;
+  rp->torn_down = 0;
+  rp->stale = 0;
   return RENDER_ERROR_NONE;
 }
 
+static void add_metrics(struct render_pass *rp) {
+#define add_metric(F) \
+  rp->metrics_total.F += rp->metrics.F; \
+  if (rp->metrics.F > rp->metrics_max.F) rp->metrics_max.F = rp->metrics.F
+
+  add_metric(ia_vertices);
+  add_metric(ia_primitives);
+  add_metric(vs_invocations);
+  add_metric(clipping_invocations);
+  add_metric(clipping_primitives);
+  add_metric(fs_invocations);
+  add_metric(samples_passed);
+  ++rp->n_metrics;
+
+#undef add_metric
+}
+
+/* Picks up the queries of the last submitted frame if the GPU is done with
+ * them. Never waits, a frame that isn't ready yet is skipped */
+static void read_metrics(struct render_pass *rp) {
+  /* each query is followed by its availability */
+  uint64_t stats[N_STATISTICS + 1] = { 0 };
+  uint64_t samples[2] = { 0 };
+  VkQueryResultFlags flags;
+  VkResult result;
+
+  if (!rp->metrics_pending) return;
+  rp->metrics_pending = 0;
+  flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+  if (rp->stats_pool != VK_NULL_HANDLE) {
+    result = rp->device->vkGetQueryPoolResults(
+      rp->device->device,
+      rp->stats_pool,
+      rp->metrics_image,
+      1,
+      sizeof(stats),
+      stats,
+      sizeof(stats),
+      flags
+    );
+    if (result != VK_SUCCESS || !stats[N_STATISTICS]) return;
+  }
+  if (rp->occlusion_pool != VK_NULL_HANDLE) {
+    result = rp->device->vkGetQueryPoolResults(
+      rp->device->device,
+      rp->occlusion_pool,
+      rp->metrics_image,
+      1,
+      sizeof(samples),
+      samples,
+      sizeof(samples),
+      flags
+    );
+    if (result != VK_SUCCESS || !samples[1]) return;
+  }
+  rp->metrics.ia_vertices = stats[0];
+  rp->metrics.ia_primitives = stats[1];
+  rp->metrics.vs_invocations = stats[2];
+  rp->metrics.clipping_invocations = stats[3];
+  rp->metrics.clipping_primitives = stats[4];
+  rp->metrics.fs_invocations = stats[5];
+  rp->metrics.samples_passed = samples[0];
+  add_metrics(rp);
+}
+
 /* **************************************** */
 /* Public */
 /* **************************************** */
@@ -1099,11 +1420,14 @@ int render_pass_init(
   size_t n_bindings, n_attrs;
   VkDescriptorSetLayoutBinding desc_layout_bindings[] = { 0 };
   VkDescriptorSetLayoutCreateInfo desc_layout_info = { 0 };
+  VkFenceCreateInfo fence_info = { 0 };
 
   if (!rp) return RENDER_ERROR_NULL;
   if (!device) return RENDER_ERROR_NULL;
 
   memset(rp, 0, sizeof(struct render_pass));
+  err = RENDER_ERROR_MEMORY;
+  chkerrg(arena_init(&rp->arena, RENDER_PASS_ARENA_SIZE), err_arena);
 
   chkerrg(
     err = render_memory_init(
@@ -1114,6 +1438,9 @@ int render_pass_init(
     ),
     err_uniform_render_memory
   );
+  /* Uniforms are rewritten every frame, keep them mapped */
+  chkerrg(err = render_memory_map(&rp->uniform_memory), err_command_pool);
+  m4ident(&rp->uniform_data.m);
 
   chkerrg(
     err = create_command_pool(device, &rp->command_pool),
@@ -1123,6 +1450,31 @@ int render_pass_init(
     err = create_vertex_data(device, &rp->vertices, &rp->indices),
     err_vertex_data
   );
+  /* Left zeroed otherwise, which render_compute_deinit skips */
+  if (compute_enabled) {
+    chkerrg(
+      err = render_compute_init(
+        &rp->compute,
+        device,
+        sizeof(default_comp_src),
+        (uint32_t *) default_comp_src,
+        1,
+        &rp->vertices,
+        sizeof(struct compute_push)
+      ),
+      err_compute
+    );
+  }
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  if (device->vkCreateFence(
+    device->device,
+    &fence_info,
+    RENDER_ALLOC(FENCE),
+    &rp->frame_fence
+  ) != VK_SUCCESS) {
+    err = RENDER_ERROR_VULKAN_FENCE;
+    goto err_fence;
+  }
 
   n_bindings = sizeof(bindings) / sizeof(bindings[0]);
   n_attrs = sizeof(attrs) / sizeof(attrs[0]);
@@ -1139,6 +1491,7 @@ int render_pass_init(
   chkerrg(
     err = create_pass(
       device,
+      &rp->arena,
       1,                        /* TODO: don't hardcode */
       &desc_layout_info,
       n_bindings,
@@ -1146,6 +1499,7 @@ int render_pass_init(
       n_attrs,
       attrs,
       &rp->uniform_memory,
+      &rp->uniform_data,
       &rp->desc_layouts,
       &rp->desc_pool,
       &rp->uniforms,
@@ -1157,8 +1511,11 @@ int render_pass_init(
       &rp->desc_sets,
       &rp->command_buffers,
       &rp->command_pool,
+      &rp->stats_pool,
+      &rp->occlusion_pool,
       &rp->vertices,
-      &rp->indices
+      &rp->indices,
+      &rp->compute
     ),
     err_pass
   );
@@ -1168,37 +1525,75 @@ int render_pass_init(
   return RENDER_ERROR_NONE;
 
  err_pass:
+  device->vkDestroyFence(device->device, rp->frame_fence, RENDER_ALLOC(FENCE));
+ err_fence:
+  render_compute_deinit(&rp->compute);
+ err_compute:
   render_buffer_destroy(&rp->vertices);
   render_buffer_destroy(&rp->indices);
  err_vertex_data:
-  device->vkDestroyCommandPool(device->device, rp->command_pool, NULL);
+  device->vkDestroyCommandPool(
+    device->device,
+    rp->command_pool,
+    RENDER_ALLOC(COMMAND_POOL)
+  );
  err_command_pool:
   render_memory_deinit(&rp->uniform_memory);
  err_uniform_render_memory:
+  arena_deinit(&rp->arena);
+ err_arena:
   return err;
 }
 
 void render_pass_deinit(struct render_pass *rp) {
-  teardown_pass(rp);
+  /* A fence in use can't be destroyed */
+  if (rp->fence_pending) {
+    rp->device->vkWaitForFences(
+      rp->device->device,
+      1,
+      &rp->frame_fence,
+      VK_TRUE,
+      (uint64_t) 2e9L
+    );
+  }
+  rp->device->vkDestroyFence(
+    rp->device->device,
+    rp->frame_fence,
+    RENDER_ALLOC(FENCE)
+  );
+  if (!rp->torn_down) teardown_pass(rp);
   render_memory_deinit(&rp->uniform_memory);
-  free(rp->uniforms);
+  render_compute_deinit(&rp->compute);
   /* TODO: remove vertices and indices */
   render_buffer_destroy(&rp->vertices);
   render_buffer_destroy(&rp->indices);
-  rp->device->vkDestroyCommandPool(rp->device->device, rp->command_pool, NULL);
-  free(rp->image_views);
-  free(rp->framebuffers);
+  rp->device->vkDestroyCommandPool(
+    rp->device->device,
+    rp->command_pool,
+    RENDER_ALLOC(COMMAND_POOL)
+  );
+  arena_deinit(&rp->arena);
 }
 
-void render_pass_update(struct render_pass *rp) {
+int render_pass_update(struct render_pass *rp) {
   uint32_t image_index;
   VkSubmitInfo submit_info = { 0 };
   VkPipelineStageFlags wait_stages[] = {
     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
   };
   VkPresentInfoKHR present_info = { 0 };
+  VkFence fence = VK_NULL_HANDLE;
   VkResult result;
 
+  rp->timing.present_ns = 0;
+  rp->timing.gpu_ns = 0;
+  render_profile_frame();
+  read_metrics(rp);
+  if (rp->stale && timer_now_ns() - rp->resize_ns >= RESIZE_SETTLE_NS) {
+    recreate_pass(rp);
+  }
+  /* Nothing to draw with until a rebuild goes through */
+  if (rp->torn_down) return RENDER_ERROR_NONE;
   result = rp->device->vkAcquireNextImageKHR(
     rp->device->device,
     rp->device->swapchain,
@@ -1208,9 +1603,25 @@ void render_pass_update(struct render_pass *rp) {
     &image_index
   );
   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    /* Nothing can be presented, so this one can't wait */
     recreate_pass(rp);
-    return;
+    return RENDER_ERROR_NONE;
   }
+  /* No image this time around, try again next frame */
+  if (result == VK_TIMEOUT || result == VK_NOT_READY) {
+    return RENDER_ERROR_NONE;
+  }
+  if (result == VK_SUBOPTIMAL_KHR) rp->stale = 1;
+  else if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_ACQUIRE;
+  /* Late latch: give the caller one last chance to pull in input that
+   * arrived while the frame was being built. The slot is free to patch
+   * since the previous frame was waited on */
+  if (rp->latch) rp->latch(rp->latch_user, &rp->uniform_data);
+  render_buffer_write(
+    rp->uniforms + image_index,
+    sizeof(struct render_uniforms),
+    (void *) &rp->uniform_data
+  );
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submit_info.waitSemaphoreCount = 1;
   submit_info.pWaitSemaphores = &rp->device->image_semaphore;
@@ -1219,22 +1630,141 @@ void render_pass_update(struct render_pass *rp) {
   submit_info.pCommandBuffers = rp->command_buffers + image_index;
   submit_info.signalSemaphoreCount = 1;
   submit_info.pSignalSemaphores = &rp->device->render_semaphore;
+  if (rp->timing.enabled) {
+    /* An earlier wait gave up. The fence can only go out again once it
+     * signaled, until then frames go without a GPU stamp */
+    if (rp->fence_pending && rp->device->vkWaitForFences(
+      rp->device->device,
+      1,
+      &rp->frame_fence,
+      VK_TRUE,
+      0
+    ) == VK_SUCCESS) {
+      rp->device->vkResetFences(rp->device->device, 1, &rp->frame_fence);
+      rp->fence_pending = 0;
+    }
+    if (!rp->fence_pending) fence = rp->frame_fence;
+  }
   result = rp->device->vkQueueSubmit(
     rp->device->graphics_queue,
     1,
     &submit_info,
-    VK_NULL_HANDLE
+    fence
   );
-  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-    recreate_pass(rp);
-  }
+  /* Presenting would wait on a semaphore nothing signals */
+  if (result != VK_SUCCESS) return RENDER_ERROR_VULKAN_SUBMIT;
+  if (fence != VK_NULL_HANDLE) rp->fence_pending = 1;
+  rp->metrics_pending =
+    rp->stats_pool != VK_NULL_HANDLE
+    || rp->occlusion_pool != VK_NULL_HANDLE;
+  rp->metrics_image = image_index;
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   present_info.waitSemaphoreCount = 1;
   present_info.pWaitSemaphores = &rp->device->render_semaphore;
   present_info.swapchainCount = 1;
   present_info.pSwapchains = &rp->device->swapchain;
   present_info.pImageIndices = &image_index;
-  rp->device->vkQueuePresentKHR(rp->device->present_queue, &present_info);
+  result =
+    rp->device->vkQueuePresentKHR(rp->device->present_queue, &present_info);
+  rp->timing.present_ns = timer_now_ns();
+  /* Waited on after the present so measuring doesn't hold it back. If the
+   * GPU was already done this reads as the present time */
+  if (fence != VK_NULL_HANDLE && rp->device->vkWaitForFences(
+    rp->device->device,
+    1,
+    &rp->frame_fence,
+    VK_TRUE,
+    (uint64_t) 2e9L
+  ) == VK_SUCCESS) {
+    rp->timing.gpu_ns = timer_now_ns();
+    rp->device->vkResetFences(rp->device->device, 1, &rp->frame_fence);
+    rp->fence_pending = 0;
+  }
   rp->device->vkQueueWaitIdle(rp->device->present_queue);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    recreate_pass(rp);
+  } else if (result == VK_SUBOPTIMAL_KHR) {
+    rp->stale = 1;
+  } else if (result != VK_SUCCESS) {
+    return RENDER_ERROR_VULKAN_PRESENT;
+  }
+  return RENDER_ERROR_NONE;
 }
 
+void render_pass_resize(struct render_pass *rp) {
+  /* no null check */
+  rp->stale = 1;
+  rp->resize_ns = timer_now_ns();
+}
+
+void render_pass_set_timing(struct render_pass *rp, int enabled) {
+  /* no null check */
+  rp->timing.enabled = enabled;
+}
+
+void render_pass_enable_compute(void) {
+  compute_enabled = 1;
+}
+
+void render_pass_print_metrics(struct render_pass *rp, FILE *out) {
+  double n, pixels;
+
+  /* no null check */
+  if (
+    rp->stats_pool == VK_NULL_HANDLE
+    && rp->occlusion_pool == VK_NULL_HANDLE
+  ) {
+    fprintf(out, "frame metrics: no query support\n");
+    return;
+  }
+  fprintf(
+    out,
+    "frame metrics over %lu frames:\n",
+    (unsigned long) rp->n_metrics
+  );
+  if (!rp->n_metrics) return;
+  n = (double) rp->n_metrics;
+  fprintf(out, "  %-22s %14s %14s\n", "", "average", "max");
+#define print_metric(F, NAME) \
+  fprintf( \
+    out, \
+    "  %-22s %14.1f %14lu\n", \
+    NAME, \
+    (double) rp->metrics_total.F / n, \
+    (unsigned long) rp->metrics_max.F \
+  )
+
+  if (rp->stats_pool != VK_NULL_HANDLE) {
+    print_metric(ia_vertices, "input vertices");
+    print_metric(ia_primitives, "input primitives");
+    print_metric(vs_invocations, "vertex invocations");
+    print_metric(clipping_invocations, "clipping invocations");
+    print_metric(clipping_primitives, "clipped primitives");
+    print_metric(fs_invocations, "fragment invocations");
+  }
+  if (rp->occlusion_pool != VK_NULL_HANDLE) {
+    print_metric(samples_passed, "samples passed");
+  }
+
+#undef print_metric
+  pixels = (double) rp->device->swap_extent.width;
+  pixels *= (double) rp->device->swap_extent.height;
+  if (pixels > 0.0 && rp->stats_pool != VK_NULL_HANDLE) {
+    fprintf(
+      out,
+      "  %-22s %14.2f\n",
+      "fragments per pixel",
+      (double) rp->metrics_total.fs_invocations / n / pixels
+    );
+  }
+}
+
+void render_pass_set_latch(
+  struct render_pass *rp,
+  render_latch_fn latch,
+  void *user
+) {
+  /* no null check */
+  rp->latch = latch;
+  rp->latch_user = user;
+}
@@ -0,0 +1,283 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "render.h"
+#include "timer.h"
+
+/* Counting and timing shims swapped into the device dispatch table. The
+ * driver is only ever called from one thread at a time here, init on the
+ * main thread and frames on whichever thread owns the pass, so the counts
+ * aren't atomic */
+
+enum profile_call {
+  PROFILE_ACQUIRE,
+  PROFILE_SUBMIT,
+  PROFILE_PRESENT,
+  PROFILE_MAP,
+  PROFILE_UNMAP,
+  PROFILE_FLUSH,
+  PROFILE_INVALIDATE,
+  PROFILE_UPDATE_DESCRIPTORS,
+  PROFILE_N_CALLS
+};
+
+struct profile_counts {
+  uint64_t calls;
+  uint64_t ns;
+  /* calls made before the first frame */
+  uint64_t setup_calls;
+  uint64_t frame_calls;
+  uint64_t max_frame_calls;
+};
+
+static int profile_enabled = 0;
+static uint64_t profile_frames = 0;
+static struct profile_counts profile_counts[PROFILE_N_CALLS];
+
+static const char *call_names[PROFILE_N_CALLS] = {
+  "vkAcquireNextImageKHR",
+  "vkQueueSubmit",
+  "vkQueuePresentKHR",
+  "vkMapMemory",
+  "vkUnmapMemory",
+  "vkFlushMappedMemoryRanges",
+  "vkInvalidateMappedMemoryRanges",
+  "vkUpdateDescriptorSets"
+};
+
+/* What the shims forward to */
+static PFN_vkAcquireNextImageKHR real_acquire;
+static PFN_vkQueueSubmit real_submit;
+static PFN_vkQueuePresentKHR real_present;
+static PFN_vkMapMemory real_map;
+static PFN_vkUnmapMemory real_unmap;
+static PFN_vkFlushMappedMemoryRanges real_flush;
+static PFN_vkInvalidateMappedMemoryRanges real_invalidate;
+static PFN_vkUpdateDescriptorSets real_update_descriptors;
+
+static void count_call(enum profile_call call, uint64_t start) {
+  struct profile_counts *c;
+
+  c = profile_counts + call;
+  c->ns += timer_now_ns() - start;
+  ++c->calls;
+  ++c->frame_calls;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL profile_acquire(
+  VkDevice device,
+  VkSwapchainKHR swapchain,
+  uint64_t timeout,
+  VkSemaphore semaphore,
+  VkFence fence,
+  uint32_t *image_index
+) {
+  uint64_t start;
+  VkResult result;
+
+  start = timer_now_ns();
+  result = real_acquire(
+    device,
+    swapchain,
+    timeout,
+    semaphore,
+    fence,
+    image_index
+  );
+  count_call(PROFILE_ACQUIRE, start);
+  return result;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL profile_submit(
+  VkQueue queue,
+  uint32_t n_submits,
+  const VkSubmitInfo *submits,
+  VkFence fence
+) {
+  uint64_t start;
+  VkResult result;
+
+  start = timer_now_ns();
+  result = real_submit(queue, n_submits, submits, fence);
+  count_call(PROFILE_SUBMIT, start);
+  return result;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL profile_present(
+  VkQueue queue,
+  const VkPresentInfoKHR *present_info
+) {
+  uint64_t start;
+  VkResult result;
+
+  start = timer_now_ns();
+  result = real_present(queue, present_info);
+  count_call(PROFILE_PRESENT, start);
+  return result;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL profile_map(
+  VkDevice device,
+  VkDeviceMemory memory,
+  VkDeviceSize offset,
+  VkDeviceSize size,
+  VkMemoryMapFlags flags,
+  void **data
+) {
+  uint64_t start;
+  VkResult result;
+
+  start = timer_now_ns();
+  result = real_map(device, memory, offset, size, flags, data);
+  count_call(PROFILE_MAP, start);
+  return result;
+}
+
+static VKAPI_ATTR void VKAPI_CALL profile_unmap(
+  VkDevice device,
+  VkDeviceMemory memory
+) {
+  uint64_t start;
+
+  start = timer_now_ns();
+  real_unmap(device, memory);
+  count_call(PROFILE_UNMAP, start);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL profile_flush(
+  VkDevice device,
+  uint32_t n_ranges,
+  const VkMappedMemoryRange *ranges
+) {
+  uint64_t start;
+  VkResult result;
+
+  start = timer_now_ns();
+  result = real_flush(device, n_ranges, ranges);
+  count_call(PROFILE_FLUSH, start);
+  return result;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL profile_invalidate(
+  VkDevice device,
+  uint32_t n_ranges,
+  const VkMappedMemoryRange *ranges
+) {
+  uint64_t start;
+  VkResult result;
+
+  start = timer_now_ns();
+  result = real_invalidate(device, n_ranges, ranges);
+  count_call(PROFILE_INVALIDATE, start);
+  return result;
+}
+
+static VKAPI_ATTR void VKAPI_CALL profile_update_descriptors(
+  VkDevice device,
+  uint32_t n_writes,
+  const VkWriteDescriptorSet *writes,
+  uint32_t n_copies,
+  const VkCopyDescriptorSet *copies
+) {
+  uint64_t start;
+
+  start = timer_now_ns();
+  real_update_descriptors(device, n_writes, writes, n_copies, copies);
+  count_call(PROFILE_UPDATE_DESCRIPTORS, start);
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+void render_profile_wrap(struct render_device *rd) {
+  /* no null check */
+  if (!profile_enabled) return;
+  real_acquire = rd->vkAcquireNextImageKHR;
+  real_submit = rd->vkQueueSubmit;
+  real_present = rd->vkQueuePresentKHR;
+  real_map = rd->vkMapMemory;
+  real_unmap = rd->vkUnmapMemory;
+  real_flush = rd->vkFlushMappedMemoryRanges;
+  real_invalidate = rd->vkInvalidateMappedMemoryRanges;
+  real_update_descriptors = rd->vkUpdateDescriptorSets;
+  rd->vkAcquireNextImageKHR = profile_acquire;
+  rd->vkQueueSubmit = profile_submit;
+  rd->vkQueuePresentKHR = profile_present;
+  rd->vkMapMemory = profile_map;
+  rd->vkUnmapMemory = profile_unmap;
+  rd->vkFlushMappedMemoryRanges = profile_flush;
+  rd->vkInvalidateMappedMemoryRanges = profile_invalidate;
+  rd->vkUpdateDescriptorSets = profile_update_descriptors;
+}
+
+void render_profile_frame(void) {
+  int i;
+
+  if (!profile_enabled) return;
+  for (i = 0; i < PROFILE_N_CALLS; ++i) {
+    struct profile_counts *c = profile_counts + i;
+    if (!profile_frames) c->setup_calls = c->frame_calls;
+    else if (c->frame_calls > c->max_frame_calls) {
+      c->max_frame_calls = c->frame_calls;
+    }
+    c->frame_calls = 0;
+  }
+  ++profile_frames;
+}
+
+void render_profile_enable(void) {
+  profile_enabled = 1;
+}
+
+void render_profile_print(FILE *out) {
+  int i;
+  uint64_t frames, max;
+
+  if (!profile_enabled) return;
+  frames = profile_frames;
+  fprintf(out, "vulkan calls over %lu frames:\n", (unsigned long) frames);
+  fprintf(
+    out,
+    "  %-31s %9s %9s %9s %9s %10s %9s\n",
+    "",
+    "calls",
+    "setup",
+    "per frame",
+    "max frame",
+    "total ms",
+    "us/call"
+  );
+  for (i = 0; i < PROFILE_N_CALLS; ++i) {
+    struct profile_counts *c = profile_counts + i;
+    /* The last frame never reached another boundary */
+    max = c->max_frame_calls;
+    if (frames && c->frame_calls > max) max = c->frame_calls;
+    fprintf(
+      out,
+      "  %-31s %9lu %9lu %9.2f %9lu %10.3f %9.2f\n",
+      call_names[i],
+      (unsigned long) c->calls,
+      (unsigned long) c->setup_calls,
+      frames ? (double) (c->calls - c->setup_calls) / (double) frames : 0.0,
+      (unsigned long) max,
+      (double) c->ns / 1e6,
+      c->calls ? (double) c->ns / (double) c->calls / 1e3 : 0.0
+    );
+  }
+}
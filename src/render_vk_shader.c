@@ -24,7 +24,7 @@ int render_compile_shader(
   result = rd->vkCreateShaderModule(
     rd->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(SHADER_MODULE),
     &rs->vert_module
   );
   if (result != VK_SUCCESS) goto err_vert;
@@ -33,14 +33,18 @@ int render_compile_shader(
   result = rd->vkCreateShaderModule(
     rd->device,
     &create_info,
-    NULL,
+    RENDER_ALLOC(SHADER_MODULE),
     &rs->frag_module
   );
   if (result != VK_SUCCESS) goto err_frag;
   return RENDER_ERROR_NONE;
 
  err_frag:
-  rd->vkDestroyShaderModule(rd->device, rs->vert_module, NULL);
+  rd->vkDestroyShaderModule(
+    rd->device,
+    rs->vert_module,
+    RENDER_ALLOC(SHADER_MODULE)
+  );
  err_vert:
   return err;
 }
@@ -8,11 +8,12 @@ layout (location = 0) out vec4 out_color;
 layout (binding = 0) uniform Uniforms {
   vec3 color;
   mat4 m;
+  vec4 cursor;
 } u;
 
 vec4 mega_color = vec4(1, 0, 1, 1);
 
 void main(void) {
-  gl_Position = vec4(position, 1.0);
-  out_color = vec4(u.m[0]);
+  gl_Position = u.m * vec4(position, 1.0) + vec4(u.cursor.xy, 0.0, 0.0);
+  out_color = vec4(color, 1.0);
 }
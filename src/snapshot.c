@@ -0,0 +1,73 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+
+#define SNAPSHOT_FRESH 4u
+#define SNAPSHOT_INDEX 3u
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+void snapshot_init(struct snapshot_buffer *sb, void *a, void *b, void *c) {
+  sb->slots[0] = a;
+  sb->slots[1] = b;
+  sb->slots[2] = c;
+  sb->back = 0;
+  sb->middle = 1;
+  sb->front = 2;
+}
+
+void *snapshot_back(struct snapshot_buffer *sb) {
+  return sb->slots[sb->back];
+}
+
+int snapshot_publish(struct snapshot_buffer *sb) {
+  unsigned int old;
+
+  /* Release makes the slot contents visible along with the index, acquire
+   * gets the consumer's last reads done before we refill what it gave
+   * back */
+  old = __atomic_exchange_n(
+    &sb->middle,
+    sb->back | SNAPSHOT_FRESH,
+    __ATOMIC_ACQ_REL
+  );
+  sb->back = old & SNAPSHOT_INDEX;
+  return (old & SNAPSHOT_FRESH) != 0;
+}
+
+int snapshot_acquire(struct snapshot_buffer *sb) {
+  if (!snapshot_pending(sb)) return 0;
+  sb->front = __atomic_exchange_n(
+    &sb->middle,
+    sb->front,
+    __ATOMIC_ACQ_REL
+  ) & SNAPSHOT_INDEX;
+  return 1;
+}
+
+void *snapshot_front(struct snapshot_buffer *sb) {
+  return sb->slots[sb->front];
+}
+
+int snapshot_pending(struct snapshot_buffer *sb) {
+  return (__atomic_load_n(&sb->middle, __ATOMIC_RELAXED) & SNAPSHOT_FRESH)
+    != 0;
+}
@@ -0,0 +1,54 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* Lock-free triple buffer for handing whole frames from one producer
+ * thread to one consumer thread. The producer always has a slot to fill
+ * and the consumer always has the newest finished one, neither waits on
+ * the other. Snapshots the consumer was too slow for are skipped */
+struct snapshot_buffer {
+  void *slots[3];
+  /* Owned by the producer */
+  unsigned int back;
+  /* Owned by the consumer */
+  unsigned int front;
+  /* Swapped by both, SNAPSHOT_FRESH is set while it holds an unread
+   * snapshot */
+  unsigned int middle;
+};
+
+/* Slots must not be shared with anything else. Both sides start out
+ * with a zeroed slot if the memory was zeroed */
+void snapshot_init(struct snapshot_buffer *sb, void *a, void *b, void *c);
+/* Producer: the slot to fill next */
+void *snapshot_back(struct snapshot_buffer *sb);
+/* Producer: hands the back slot over. Returns 1 when the previous
+ * snapshot was never read, it is then the new back slot with its
+ * contents intact */
+int snapshot_publish(struct snapshot_buffer *sb);
+/* Consumer: moves to the newest snapshot if there is one since the last
+ * call, returns 1 if so */
+int snapshot_acquire(struct snapshot_buffer *sb);
+/* Consumer: the snapshot being read */
+void *snapshot_front(struct snapshot_buffer *sb);
+/* Either side: a snapshot is waiting for the consumer */
+int snapshot_pending(struct snapshot_buffer *sb);
+
+#endif
@@ -0,0 +1,268 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "soa.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SOA_X86
+#include <immintrin.h>
+#endif
+
+struct soa_kernels {
+  size_t (*add)(size_t, size_t, struct soa3 *, struct soa3 *, struct soa3 *);
+  size_t (*sub)(size_t, size_t, struct soa3 *, struct soa3 *, struct soa3 *);
+  size_t (*scale)(size_t, size_t, struct soa3 *, float, struct soa3 *);
+  size_t (*dot)(size_t, size_t, struct soa3 *, struct soa3 *, float *);
+  size_t (*cross)(size_t, size_t, struct soa3 *, struct soa3 *, struct soa3 *);
+  size_t (*normalize)(size_t, size_t, struct soa3 *, struct soa3 *);
+  size_t (*lerp)(
+    size_t,
+    size_t,
+    struct soa3 *,
+    struct soa3 *,
+    float,
+    struct soa3 *
+  );
+};
+
+/* Scalar instantiation, also used for the tail of every wider kernel */
+#define SOA_ISA scalar
+#define SOA_VEC float
+#define SOA_W 1
+#define SOA_LOAD(p) (*(p))
+#define SOA_STORE(p, v) (*(p) = (v))
+#define SOA_SET1(f) (f)
+#define SOA_ADD(a, b) ((a) + (b))
+#define SOA_SUB(a, b) ((a) - (b))
+#define SOA_MUL(a, b) ((a) * (b))
+#define SOA_DIV(a, b) ((a) / (b))
+#define SOA_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define SOA_SQRT(a) ((float) sqrt(a))
+#include "soa_impl.h"
+
+#ifdef SOA_X86
+
+#define SOA_ISA sse2
+#define SOA_VEC __m128
+#define SOA_W 4
+#define SOA_LOAD(p) _mm_loadu_ps(p)
+#define SOA_STORE(p, v) _mm_storeu_ps((p), (v))
+#define SOA_SET1(f) _mm_set1_ps(f)
+#define SOA_ADD(a, b) _mm_add_ps((a), (b))
+#define SOA_SUB(a, b) _mm_sub_ps((a), (b))
+#define SOA_MUL(a, b) _mm_mul_ps((a), (b))
+#define SOA_DIV(a, b) _mm_div_ps((a), (b))
+#define SOA_MAX(a, b) _mm_max_ps((a), (b))
+#define SOA_SQRT(a) _mm_sqrt_ps(a)
+#include "soa_impl.h"
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define SOA_ISA avx2
+#define SOA_VEC __m256
+#define SOA_W 8
+#define SOA_LOAD(p) _mm256_loadu_ps(p)
+#define SOA_STORE(p, v) _mm256_storeu_ps((p), (v))
+#define SOA_SET1(f) _mm256_set1_ps(f)
+#define SOA_ADD(a, b) _mm256_add_ps((a), (b))
+#define SOA_SUB(a, b) _mm256_sub_ps((a), (b))
+#define SOA_MUL(a, b) _mm256_mul_ps((a), (b))
+#define SOA_DIV(a, b) _mm256_div_ps((a), (b))
+#define SOA_MAX(a, b) _mm256_max_ps((a), (b))
+#define SOA_SQRT(a) _mm256_sqrt_ps(a)
+#include "soa_impl.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define SOA_ISA avx512
+#define SOA_VEC __m512
+#define SOA_W 16
+#define SOA_LOAD(p) _mm512_loadu_ps(p)
+#define SOA_STORE(p, v) _mm512_storeu_ps((p), (v))
+#define SOA_SET1(f) _mm512_set1_ps(f)
+#define SOA_ADD(a, b) _mm512_add_ps((a), (b))
+#define SOA_SUB(a, b) _mm512_sub_ps((a), (b))
+#define SOA_MUL(a, b) _mm512_mul_ps((a), (b))
+#define SOA_DIV(a, b) _mm512_div_ps((a), (b))
+#define SOA_MAX(a, b) _mm512_max_ps((a), (b))
+#define SOA_SQRT(a) _mm512_sqrt_ps(a)
+#include "soa_impl.h"
+#pragma GCC pop_options
+
+#endif  /* SOA_X86 */
+
+static struct soa_kernels kernels[] = {
+  {
+    add_scalar,
+    sub_scalar,
+    scale_scalar,
+    dot_scalar,
+    cross_scalar,
+    normalize_scalar,
+    lerp_scalar
+  }
+#ifdef SOA_X86
+  , {
+    add_sse2,
+    sub_sse2,
+    scale_sse2,
+    dot_sse2,
+    cross_sse2,
+    normalize_sse2,
+    lerp_sse2
+  }, {
+    add_avx2,
+    sub_avx2,
+    scale_avx2,
+    dot_avx2,
+    cross_avx2,
+    normalize_avx2,
+    lerp_avx2
+  }, {
+    add_avx512,
+    sub_avx512,
+    scale_avx512,
+    dot_avx512,
+    cross_avx512,
+    normalize_avx512,
+    lerp_avx512
+  }
+#endif
+};
+
+static int max_isa = -1;
+static int cur_isa = -1;
+
+static enum soa_isa detect_isa(void) {
+#ifdef SOA_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SOA_ISA_AVX512;
+  if (__builtin_cpu_supports("avx2")) return SOA_ISA_AVX2;
+  return SOA_ISA_SSE2;
+#else
+  return SOA_ISA_SCALAR;
+#endif
+}
+
+static struct soa_kernels *select_kernels(void) {
+  if (cur_isa < 0) {
+    max_isa = (int) detect_isa();
+    cur_isa = max_isa;
+  }
+  return &kernels[cur_isa];
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+size_t soa_pad(size_t n) {
+  return (n + SOA_PAD_FLOATS - 1) / SOA_PAD_FLOATS * SOA_PAD_FLOATS;
+}
+
+void *soa_alloc(size_t n_floats) {
+  unsigned char *raw, *aligned;
+  size_t size;
+
+  /* Over-allocate, align by hand and stash the original pointer right
+   * before the aligned block for soa_free */
+  size = soa_pad(n_floats) * sizeof(float) + SOA_ALIGN + sizeof(void *);
+  raw = malloc(size);
+  if (!raw) return NULL;
+  aligned = raw + sizeof(void *);
+  aligned += (SOA_ALIGN - ((size_t) aligned % SOA_ALIGN)) % SOA_ALIGN;
+  memcpy(aligned - sizeof(void *), &raw, sizeof(void *));
+  return aligned;
+}
+
+void soa_free(void *ptr) {
+  void *raw;
+
+  if (!ptr) return;
+  memcpy(&raw, (unsigned char *) ptr - sizeof(void *), sizeof(void *));
+  free(raw);
+}
+
+int soa3_init(struct soa3 *v, size_t n) {
+  size_t stride;
+
+  if (!v) return SOA_ERROR_NULL;
+  /* One block, each stream starting on its own cache line */
+  stride = soa_pad(n);
+  v->x = soa_alloc(stride * 3);
+  if (!v->x) return SOA_ERROR_MEMORY;
+  v->y = v->x + stride;
+  v->z = v->y + stride;
+  return SOA_ERROR_NONE;
+}
+
+void soa3_deinit(struct soa3 *v) {
+  if (!v) return;
+  soa_free(v->x);
+  memset(v, 0, sizeof(struct soa3));
+}
+
+enum soa_isa soa_get_isa(void) {
+  select_kernels();
+  return (enum soa_isa) cur_isa;
+}
+
+enum soa_isa soa_set_isa(enum soa_isa isa) {
+  select_kernels();
+  cur_isa = ((int) isa < max_isa) ? (int) isa : max_isa;
+  return (enum soa_isa) cur_isa;
+}
+
+void soa_add(size_t n, struct soa3 *a, struct soa3 *b, struct soa3 *out) {
+  add_scalar(select_kernels()->add(0, n, a, b, out), n, a, b, out);
+}
+
+void soa_sub(size_t n, struct soa3 *a, struct soa3 *b, struct soa3 *out) {
+  sub_scalar(select_kernels()->sub(0, n, a, b, out), n, a, b, out);
+}
+
+void soa_scale(size_t n, struct soa3 *a, float s, struct soa3 *out) {
+  scale_scalar(select_kernels()->scale(0, n, a, s, out), n, a, s, out);
+}
+
+void soa_dot(size_t n, struct soa3 *a, struct soa3 *b, float *out) {
+  dot_scalar(select_kernels()->dot(0, n, a, b, out), n, a, b, out);
+}
+
+void soa_cross(size_t n, struct soa3 *a, struct soa3 *b, struct soa3 *out) {
+  cross_scalar(select_kernels()->cross(0, n, a, b, out), n, a, b, out);
+}
+
+void soa_normalize(size_t n, struct soa3 *a, struct soa3 *out) {
+  normalize_scalar(select_kernels()->normalize(0, n, a, out), n, a, out);
+}
+
+void soa_lerp(
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  float t,
+  struct soa3 *out
+) {
+  lerp_scalar(select_kernels()->lerp(0, n, a, b, t, out), n, a, b, t, out);
+}
@@ -0,0 +1,74 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOA_H
+#define SOA_H
+
+#include <stddef.h>
+
+#define SOA_ERROR_NONE 0
+#define SOA_ERROR_NULL -1
+#define SOA_ERROR_MEMORY -2
+
+/* Streams are aligned to a cache line and padded to a whole number of
+ * cache lines so the widest kernel never straddles one */
+#define SOA_ALIGN 64
+#define SOA_PAD_FLOATS (SOA_ALIGN / sizeof(float))
+
+enum soa_isa {
+  SOA_ISA_SCALAR = 0,
+  SOA_ISA_SSE2,
+  SOA_ISA_AVX2,
+  SOA_ISA_AVX512
+};
+
+/* Three float streams, one per component */
+struct soa3 {
+  float *x;
+  float *y;
+  float *z;
+};
+
+size_t soa_pad(size_t n);
+void *soa_alloc(size_t n_floats);
+void soa_free(void *ptr);
+int soa3_init(struct soa3 *v, size_t n);
+void soa3_deinit(struct soa3 *v);
+
+/* Kernels are picked from the CPU features on first use. soa_set_isa
+ * lowers (never raises past what the CPU supports) the level used */
+enum soa_isa soa_get_isa(void);
+enum soa_isa soa_set_isa(enum soa_isa isa);
+
+/* All of these run over n elements. out may alias the inputs */
+void soa_add(size_t n, struct soa3 *a, struct soa3 *b, struct soa3 *out);
+void soa_sub(size_t n, struct soa3 *a, struct soa3 *b, struct soa3 *out);
+void soa_scale(size_t n, struct soa3 *a, float s, struct soa3 *out);
+void soa_dot(size_t n, struct soa3 *a, struct soa3 *b, float *out);
+void soa_cross(size_t n, struct soa3 *a, struct soa3 *b, struct soa3 *out);
+/* Zero length vectors stay zero */
+void soa_normalize(size_t n, struct soa3 *a, struct soa3 *out);
+void soa_lerp(
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  float t,
+  struct soa3 *out
+);
+
+#endif
@@ -0,0 +1,199 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Kernel template for soa.c, included once per instruction set. No include
+ * guard on purpose. The includer defines:
+ *
+ *   SOA_ISA                    suffix for the generated function names
+ *   SOA_VEC                    register type
+ *   SOA_W                      lanes per register
+ *   SOA_LOAD(p), SOA_STORE(p, v)
+ *   SOA_SET1(f)
+ *   SOA_ADD, SOA_SUB, SOA_MUL, SOA_DIV, SOA_MAX (binary)
+ *   SOA_SQRT (unary)
+ *
+ * Every kernel starts at element i, stops at the last whole register and
+ * returns where it stopped so the scalar instantiation can finish up */
+
+#define SOA_CAT_(a, b) a##_##b
+#define SOA_CAT(a, b) SOA_CAT_(a, b)
+#define SOA_FN(name) SOA_CAT(name, SOA_ISA)
+
+static size_t SOA_FN(add)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  struct soa3 *out
+) {
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_STORE(out->x + i, SOA_ADD(SOA_LOAD(a->x + i), SOA_LOAD(b->x + i)));
+    SOA_STORE(out->y + i, SOA_ADD(SOA_LOAD(a->y + i), SOA_LOAD(b->y + i)));
+    SOA_STORE(out->z + i, SOA_ADD(SOA_LOAD(a->z + i), SOA_LOAD(b->z + i)));
+  }
+  return i;
+}
+
+static size_t SOA_FN(sub)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  struct soa3 *out
+) {
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_STORE(out->x + i, SOA_SUB(SOA_LOAD(a->x + i), SOA_LOAD(b->x + i)));
+    SOA_STORE(out->y + i, SOA_SUB(SOA_LOAD(a->y + i), SOA_LOAD(b->y + i)));
+    SOA_STORE(out->z + i, SOA_SUB(SOA_LOAD(a->z + i), SOA_LOAD(b->z + i)));
+  }
+  return i;
+}
+
+static size_t SOA_FN(scale)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  float s,
+  struct soa3 *out
+) {
+  SOA_VEC vs = SOA_SET1(s);
+
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_STORE(out->x + i, SOA_MUL(SOA_LOAD(a->x + i), vs));
+    SOA_STORE(out->y + i, SOA_MUL(SOA_LOAD(a->y + i), vs));
+    SOA_STORE(out->z + i, SOA_MUL(SOA_LOAD(a->z + i), vs));
+  }
+  return i;
+}
+
+static size_t SOA_FN(dot)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  float *out
+) {
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_VEC d;
+
+    d = SOA_MUL(SOA_LOAD(a->x + i), SOA_LOAD(b->x + i));
+    d = SOA_ADD(d, SOA_MUL(SOA_LOAD(a->y + i), SOA_LOAD(b->y + i)));
+    d = SOA_ADD(d, SOA_MUL(SOA_LOAD(a->z + i), SOA_LOAD(b->z + i)));
+    SOA_STORE(out + i, d);
+  }
+  return i;
+}
+
+static size_t SOA_FN(cross)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  struct soa3 *out
+) {
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_VEC ax, ay, az, bx, by, bz;
+
+    /* Everything is loaded before the first store so out can alias */
+    ax = SOA_LOAD(a->x + i);
+    ay = SOA_LOAD(a->y + i);
+    az = SOA_LOAD(a->z + i);
+    bx = SOA_LOAD(b->x + i);
+    by = SOA_LOAD(b->y + i);
+    bz = SOA_LOAD(b->z + i);
+    SOA_STORE(out->x + i, SOA_SUB(SOA_MUL(ay, bz), SOA_MUL(az, by)));
+    SOA_STORE(out->y + i, SOA_SUB(SOA_MUL(az, bx), SOA_MUL(ax, bz)));
+    SOA_STORE(out->z + i, SOA_SUB(SOA_MUL(ax, by), SOA_MUL(ay, bx)));
+  }
+  return i;
+}
+
+static size_t SOA_FN(normalize)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *out
+) {
+  SOA_VEC one = SOA_SET1(1.0f);
+  SOA_VEC tiny = SOA_SET1(1e-30f);
+
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_VEC x, y, z, len, inv;
+
+    x = SOA_LOAD(a->x + i);
+    y = SOA_LOAD(a->y + i);
+    z = SOA_LOAD(a->z + i);
+    len = SOA_MUL(x, x);
+    len = SOA_ADD(len, SOA_MUL(y, y));
+    len = SOA_ADD(len, SOA_MUL(z, z));
+    /* Clamping keeps zero vectors at zero instead of NaN */
+    inv = SOA_DIV(one, SOA_MAX(SOA_SQRT(len), tiny));
+    SOA_STORE(out->x + i, SOA_MUL(x, inv));
+    SOA_STORE(out->y + i, SOA_MUL(y, inv));
+    SOA_STORE(out->z + i, SOA_MUL(z, inv));
+  }
+  return i;
+}
+
+static size_t SOA_FN(lerp)(
+  size_t i,
+  size_t n,
+  struct soa3 *a,
+  struct soa3 *b,
+  float t,
+  struct soa3 *out
+) {
+  SOA_VEC vt = SOA_SET1(t);
+
+  for (; i + SOA_W <= n; i += SOA_W) {
+    SOA_VEC ax, ay, az;
+
+    ax = SOA_LOAD(a->x + i);
+    ay = SOA_LOAD(a->y + i);
+    az = SOA_LOAD(a->z + i);
+    SOA_STORE(
+      out->x + i,
+      SOA_ADD(ax, SOA_MUL(SOA_SUB(SOA_LOAD(b->x + i), ax), vt))
+    );
+    SOA_STORE(
+      out->y + i,
+      SOA_ADD(ay, SOA_MUL(SOA_SUB(SOA_LOAD(b->y + i), ay), vt))
+    );
+    SOA_STORE(
+      out->z + i,
+      SOA_ADD(az, SOA_MUL(SOA_SUB(SOA_LOAD(b->z + i), az), vt))
+    );
+  }
+  return i;
+}
+
+#undef SOA_FN
+#undef SOA_CAT
+#undef SOA_CAT_
+#undef SOA_ISA
+#undef SOA_VEC
+#undef SOA_W
+#undef SOA_LOAD
+#undef SOA_STORE
+#undef SOA_SET1
+#undef SOA_ADD
+#undef SOA_SUB
+#undef SOA_MUL
+#undef SOA_DIV
+#undef SOA_MAX
+#undef SOA_SQRT
@@ -0,0 +1,77 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "sized_types.h"
+#include <stdio.h>
+
+#define THREAD_ERROR_NONE 0
+#define THREAD_ERROR_NULL -1
+#define THREAD_ERROR_AFFINITY -2
+#define THREAD_ERROR_POLICY -3
+#define THREAD_ERROR_NAME -4
+
+enum {
+  /* Including the terminator, longer names are cut */
+  THREAD_NAME_MAX = 16
+};
+
+enum thread_policy {
+  THREAD_POLICY_NORMAL,
+  THREAD_POLICY_FIFO,
+  THREAD_POLICY_RR
+};
+
+/* Where and how a thread runs. Zeroed fields other than cpu mean leave it
+ * alone, cpu -1 does */
+struct thread_config {
+  const char *name;
+  int cpu;
+  enum thread_policy policy;
+  /* Real-time priority for FIFO and RR, 1 to 99 */
+  int priority;
+};
+
+/* Totals for the thread since it started, along with what it actually got
+ * out of its thread_config */
+struct thread_stats {
+  uint64_t cpu_ns;
+  long voluntary_switches;
+  long involuntary_switches;
+  /* Where it last ran, -1 if unknown */
+  int cpu;
+  enum thread_policy policy;
+  int priority;
+};
+
+/* **************************************** */
+/* thread_<platform>.c */
+/* Named, anywhere, normal scheduling */
+void thread_config_default(struct thread_config *tc, const char *name);
+/* Applies to the calling thread. Every setting is tried and the first
+ * failure returned, the thread keeps whatever did work. A real-time
+ * policy the system refuses leaves it on normal scheduling */
+int thread_configure(struct thread_config *tc);
+/* Calling thread only, the counters aren't visible from outside it */
+void thread_sample(struct thread_stats *out);
+void thread_print_stats(struct thread_stats *ts, char *name, FILE *out);
+/* **************************************** */
+
+#endif
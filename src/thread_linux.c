@@ -0,0 +1,152 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* pthread_setaffinity_np, pthread_setname_np, RUSAGE_THREAD,
+ * sched_getcpu */
+#define _GNU_SOURCE
+
+#include "thread.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define NS_TO_MS(ns) ((double) (ns) / 1000000.0)
+
+static int set_affinity(int cpu) {
+  cpu_set_t set;
+
+  if (cpu < 0) return THREAD_ERROR_NONE;
+  if (cpu >= CPU_SETSIZE) return THREAD_ERROR_AFFINITY;
+  CPU_ZERO(&set);
+  CPU_SET((size_t) cpu, &set);
+  /* Fails for cores that are offline or outside our cpuset */
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    return THREAD_ERROR_AFFINITY;
+  }
+  return THREAD_ERROR_NONE;
+}
+
+static int set_policy(enum thread_policy policy, int priority) {
+  struct sched_param param = { 0 };
+  int native, lo, hi;
+
+  switch (policy) {
+  case THREAD_POLICY_FIFO:
+    native = SCHED_FIFO;
+    break;
+  case THREAD_POLICY_RR:
+    native = SCHED_RR;
+    break;
+  default:
+    return THREAD_ERROR_NONE;
+  }
+  lo = sched_get_priority_min(native);
+  hi = sched_get_priority_max(native);
+  param.sched_priority = (priority < lo) ? lo : (priority > hi) ? hi
+    : priority;
+  /* Without CAP_SYS_NICE or an RLIMIT_RTPRIO this is EPERM and the thread
+   * stays where it was */
+  if (pthread_setschedparam(pthread_self(), native, &param)) {
+    return THREAD_ERROR_POLICY;
+  }
+  return THREAD_ERROR_NONE;
+}
+
+static int set_name(const char *name) {
+  char buf[THREAD_NAME_MAX];
+
+  if (!name) return THREAD_ERROR_NONE;
+  /* The kernel takes 15 characters and refuses anything longer */
+  strncpy(buf, name, THREAD_NAME_MAX - 1);
+  buf[THREAD_NAME_MAX - 1] = '\0';
+  if (pthread_setname_np(pthread_self(), buf)) return THREAD_ERROR_NAME;
+  return THREAD_ERROR_NONE;
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+void thread_config_default(struct thread_config *tc, const char *name) {
+  /* no null check */
+  memset(tc, 0, sizeof(struct thread_config));
+  tc->name = name;
+  tc->cpu = -1;
+  tc->policy = THREAD_POLICY_NORMAL;
+}
+
+int thread_configure(struct thread_config *tc) {
+  int err, first = THREAD_ERROR_NONE;
+
+  if (!tc) return THREAD_ERROR_NULL;
+  err = set_name(tc->name);
+  if (err && !first) first = err;
+  err = set_affinity(tc->cpu);
+  if (err && !first) first = err;
+  err = set_policy(tc->policy, tc->priority);
+  if (err && !first) first = err;
+  return first;
+}
+
+void thread_sample(struct thread_stats *out) {
+  /* no null check */
+  struct timespec ts;
+  struct rusage ru;
+  struct sched_param param;
+  int native;
+
+  memset(out, 0, sizeof(struct thread_stats));
+  if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+    out->cpu_ns = (uint64_t) ts.tv_sec * 1000000000UL
+      + (uint64_t) ts.tv_nsec;
+  }
+  if (!getrusage(RUSAGE_THREAD, &ru)) {
+    out->voluntary_switches = ru.ru_nvcsw;
+    out->involuntary_switches = ru.ru_nivcsw;
+  }
+  out->cpu = sched_getcpu();
+  if (!pthread_getschedparam(pthread_self(), &native, &param)) {
+    out->policy = (native == SCHED_FIFO) ? THREAD_POLICY_FIFO
+      : (native == SCHED_RR) ? THREAD_POLICY_RR
+      : THREAD_POLICY_NORMAL;
+    out->priority = param.sched_priority;
+  }
+}
+
+void thread_print_stats(struct thread_stats *ts, char *name, FILE *out) {
+  static const char *policy_names[] = { "normal", "fifo", "rr" };
+
+  /* no null check */
+  fprintf(
+    out,
+    "%s: cpu %.1fms, %ld voluntary and %ld involuntary switches, "
+    "last on cpu %d, %s",
+    name,
+    NS_TO_MS(ts->cpu_ns),
+    ts->voluntary_switches,
+    ts->involuntary_switches,
+    ts->cpu,
+    policy_names[ts->policy]
+  );
+  if (ts->policy != THREAD_POLICY_NORMAL) {
+    fprintf(out, " priority %d", ts->priority);
+  }
+  fprintf(out, "\n");
+}
@@ -17,8 +17,15 @@
  */
 
 #include "trig.h"
+#include "sized_types.h"
+#include <stddef.h>
 #include <string.h>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TRIG_X86
+#include <immintrin.h>
+#endif
+
 #define m4xy(m, x, y) m->data[(x * 4) + y]
 
 void v3addv(struct vec3 *lhs, struct vec3 *rhs, struct vec3 *out) {
@@ -72,6 +79,221 @@ void v3cross(struct vec3 *lhs, struct vec3 *rhs, struct vec3 *out) {
   out->z = c;
 }
 
+void v4addv(struct vec4 *lhs, struct vec4 *rhs, struct vec4 *out) {
+  out->x = lhs->x + rhs->x;
+  out->y = lhs->y + rhs->y;
+  out->z = lhs->z + rhs->z;
+  out->w = lhs->w + rhs->w;
+}
+
+void v4subv(struct vec4 *lhs, struct vec4 *rhs, struct vec4 *out) {
+  out->x = lhs->x - rhs->x;
+  out->y = lhs->y - rhs->y;
+  out->z = lhs->z - rhs->z;
+  out->w = lhs->w - rhs->w;
+}
+
+void v4adds(struct vec4 *v, float n, struct vec4 *out) {
+  out->x = v->x + n;
+  out->y = v->y + n;
+  out->z = v->z + n;
+  out->w = v->w + n;
+}
+
+void v4subs(struct vec4 *v, float n, struct vec4 *out) {
+  out->x = v->x - n;
+  out->y = v->y - n;
+  out->z = v->z - n;
+  out->w = v->w - n;
+}
+
+void v4muls(struct vec4 *v, float n, struct vec4 *out) {
+  out->x = v->x * n;
+  out->y = v->y * n;
+  out->z = v->z * n;
+  out->w = v->w * n;
+}
+
+float v4dot(struct vec4 *lhs, struct vec4 *rhs) {
+  float out = 0.0f;
+
+  out += lhs->x * rhs->x;
+  out += lhs->y * rhs->y;
+  out += lhs->z * rhs->z;
+  out += lhs->w * rhs->w;
+  return out;
+}
+
+void v4cross(struct vec4 *lhs, struct vec4 *rhs, struct vec4 *out) {
+  float a, b, c;
+
+  a = (lhs->y * rhs->z) - (lhs->z * rhs->y);
+  b = (lhs->z * rhs->x) - (lhs->x * rhs->z);
+  c = (lhs->x * rhs->y) - (lhs->y * rhs->x);
+  out->x = a;
+  out->y = b;
+  out->z = c;
+  out->w = 0.0f;
+}
+
+#ifdef TRIG_X86
+
+#define SHUFFLE(a, b, x, y, z, w) \
+  _mm_shuffle_ps((a), (b), _MM_SHUFFLE((w), (z), (y), (x)))
+#define SWIZZLE(a, x, y, z, w) SHUFFLE(a, a, x, y, z, w)
+
+static __m128 mulv_sse(
+  __m128 c0,
+  __m128 c1,
+  __m128 c2,
+  __m128 c3,
+  __m128 v
+) {
+  __m128 out;
+
+  out = _mm_mul_ps(c0, SWIZZLE(v, 0, 0, 0, 0));
+  out = _mm_add_ps(out, _mm_mul_ps(c1, SWIZZLE(v, 1, 1, 1, 1)));
+  out = _mm_add_ps(out, _mm_mul_ps(c2, SWIZZLE(v, 2, 2, 2, 2)));
+  out = _mm_add_ps(out, _mm_mul_ps(c3, SWIZZLE(v, 3, 3, 3, 3)));
+  return out;
+}
+
+static void mulm_sse(float *lhs, float *rhs, float *out) {
+  __m128 c0, c1, c2, c3, r0, r1, r2, r3;
+
+  /* Load everything first so out may alias lhs or rhs */
+  c0 = _mm_loadu_ps(lhs);
+  c1 = _mm_loadu_ps(lhs + 4);
+  c2 = _mm_loadu_ps(lhs + 8);
+  c3 = _mm_loadu_ps(lhs + 12);
+  r0 = _mm_loadu_ps(rhs);
+  r1 = _mm_loadu_ps(rhs + 4);
+  r2 = _mm_loadu_ps(rhs + 8);
+  r3 = _mm_loadu_ps(rhs + 12);
+  _mm_storeu_ps(out, mulv_sse(c0, c1, c2, c3, r0));
+  _mm_storeu_ps(out + 4, mulv_sse(c0, c1, c2, c3, r1));
+  _mm_storeu_ps(out + 8, mulv_sse(c0, c1, c2, c3, r2));
+  _mm_storeu_ps(out + 12, mulv_sse(c0, c1, c2, c3, r3));
+}
+
+/* 2x2 helpers for the block inverse below. A 2x2 matrix lives in one
+ * register as (m00, m01, m10, m11) */
+static __m128 mat2_mul(__m128 a, __m128 b) {
+  return _mm_add_ps(
+    _mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)),
+    _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1))
+  );
+}
+
+/* adj(a) * b */
+static __m128 mat2_adj_mul(__m128 a, __m128 b) {
+  return _mm_sub_ps(
+    _mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b),
+    _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1))
+  );
+}
+
+/* a * adj(b) */
+static __m128 mat2_mul_adj(__m128 a, __m128 b) {
+  return _mm_sub_ps(
+    _mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)),
+    _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1))
+  );
+}
+
+__attribute__((target("avx")))
+static void mulv_n_avx(float *m, float *in, float *out, size_t n) {
+  size_t i;
+  __m256 c0, c1, c2, c3;
+
+  /* Each 256-bit register holds two vectors, so every column is
+   * duplicated across both halves */
+  c0 = _mm256_broadcast_ps((__m128 *) m);
+  c1 = _mm256_broadcast_ps((__m128 *) (m + 4));
+  c2 = _mm256_broadcast_ps((__m128 *) (m + 8));
+  c3 = _mm256_broadcast_ps((__m128 *) (m + 12));
+  for (i = 0; i + 2 <= n; i += 2) {
+    __m256 v, r;
+
+    v = _mm256_loadu_ps(in + i * 4);
+    r = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c2, _mm256_permute_ps(v, 0xaa)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xff)));
+    _mm256_storeu_ps(out + i * 4, r);
+  }
+  if (i < n) {
+    _mm_storeu_ps(
+      out + i * 4,
+      mulv_sse(
+        _mm256_castps256_ps128(c0),
+        _mm256_castps256_ps128(c1),
+        _mm256_castps256_ps128(c2),
+        _mm256_castps256_ps128(c3),
+        _mm_loadu_ps(in + i * 4)
+      )
+    );
+  }
+}
+
+__attribute__((target("avx")))
+static void mulm_n_avx(float *lhs, float *rhs, float *out, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    __m256 c0, c1, c2, c3, r01, r23, o01, o23;
+    float *l = lhs + i * 16, *r = rhs + i * 16;
+
+    /* Two output columns per register */
+    c0 = _mm256_broadcast_ps((__m128 *) l);
+    c1 = _mm256_broadcast_ps((__m128 *) (l + 4));
+    c2 = _mm256_broadcast_ps((__m128 *) (l + 8));
+    c3 = _mm256_broadcast_ps((__m128 *) (l + 12));
+    r01 = _mm256_loadu_ps(r);
+    r23 = _mm256_loadu_ps(r + 8);
+    o01 = _mm256_mul_ps(c0, _mm256_permute_ps(r01, 0x00));
+    o01 = _mm256_add_ps(o01, _mm256_mul_ps(c1, _mm256_permute_ps(r01, 0x55)));
+    o01 = _mm256_add_ps(o01, _mm256_mul_ps(c2, _mm256_permute_ps(r01, 0xaa)));
+    o01 = _mm256_add_ps(o01, _mm256_mul_ps(c3, _mm256_permute_ps(r01, 0xff)));
+    o23 = _mm256_mul_ps(c0, _mm256_permute_ps(r23, 0x00));
+    o23 = _mm256_add_ps(o23, _mm256_mul_ps(c1, _mm256_permute_ps(r23, 0x55)));
+    o23 = _mm256_add_ps(o23, _mm256_mul_ps(c2, _mm256_permute_ps(r23, 0xaa)));
+    o23 = _mm256_add_ps(o23, _mm256_mul_ps(c3, _mm256_permute_ps(r23, 0xff)));
+    _mm256_storeu_ps(out + i * 16, o01);
+    _mm256_storeu_ps(out + i * 16 + 8, o23);
+  }
+}
+
+static int have_avx(void) {
+  static int cached = -1;
+
+  if (cached < 0) {
+    __builtin_cpu_init();
+    cached = __builtin_cpu_supports("avx");
+  }
+  return cached;
+}
+
+#else
+
+static void mulm_scalar(float *lhs, float *rhs, float *out) {
+  size_t col, row;
+  float result[16];
+
+  for (col = 0; col < 4; ++col) {
+    for (row = 0; row < 4; ++row) {
+      result[col * 4 + row] =
+        lhs[row] * rhs[col * 4]
+        + lhs[4 + row] * rhs[col * 4 + 1]
+        + lhs[8 + row] * rhs[col * 4 + 2]
+        + lhs[12 + row] * rhs[col * 4 + 3];
+    }
+  }
+  memcpy(out, result, sizeof(result));
+}
+
+#endif  /* TRIG_X86 */
+
 void m4new(float f, struct mat4 *out) {
   size_t i;
 
@@ -88,37 +310,550 @@ void m4ident(struct mat4 *out) {
   m4xy(out, 3, 3) = 1.0f;
 }
 
+void m4add(struct mat4 *lhs, struct mat4 *rhs, struct mat4 *out) {
+  size_t i;
+
+  for (i = 0; i < 16; ++i) {
+    out->data[i] = lhs->data[i] + rhs->data[i];
+  }
+}
+
+void m4sub(struct mat4 *lhs, struct mat4 *rhs, struct mat4 *out) {
+  size_t i;
+
+  for (i = 0; i < 16; ++i) {
+    out->data[i] = lhs->data[i] - rhs->data[i];
+  }
+}
+
+void m4mulm(struct mat4 *lhs, struct mat4 *rhs, struct mat4 *out) {
+#ifdef TRIG_X86
+  mulm_sse(lhs->data, rhs->data, out->data);
+#else
+  mulm_scalar(lhs->data, rhs->data, out->data);
+#endif
+}
+
 void m4mulv(struct mat4 *lhs, struct vec4 *rhs, struct vec4 *out) {
-  float *row1, *row2, *row3, *row4;
+#ifdef TRIG_X86
+  _mm_storeu_ps(
+    &out->x,
+    mulv_sse(
+      _mm_loadu_ps(lhs->data),
+      _mm_loadu_ps(lhs->data + 4),
+      _mm_loadu_ps(lhs->data + 8),
+      _mm_loadu_ps(lhs->data + 12),
+      _mm_loadu_ps(&rhs->x)
+    )
+  );
+#else
   float x, y, z, w;
 
-  row1 = lhs->data;
-  row2 = lhs->data + 4;
-  row3 = lhs->data + 8;
-  row4 = lhs->data + 12;
-  x =
-    (rhs->x * row1[0])
-    + (rhs->y * row1[1])
-    + (rhs->z * row1[2])
-    + (rhs->w * row1[3]);
-  y =
-    (rhs->x * row2[0])
-    + (rhs->y * row2[1])
-    + (rhs->z * row2[2])
-    + (rhs->w * row2[3]);
-  z =
-    (rhs->x * row3[0])
-    + (rhs->y * row3[1])
-    + (rhs->z * row3[2])
-    + (rhs->w * row3[3]);
-  w =
-    (rhs->x * row4[0])
-    + (rhs->y * row4[1])
-    + (rhs->z * row4[2])
-    + (rhs->w * row4[3]);
+  /* Column major, so the vector scales each column */
+  x = rhs->x * m4xy(lhs, 0, 0) + rhs->y * m4xy(lhs, 1, 0)
+    + rhs->z * m4xy(lhs, 2, 0) + rhs->w * m4xy(lhs, 3, 0);
+  y = rhs->x * m4xy(lhs, 0, 1) + rhs->y * m4xy(lhs, 1, 1)
+    + rhs->z * m4xy(lhs, 2, 1) + rhs->w * m4xy(lhs, 3, 1);
+  z = rhs->x * m4xy(lhs, 0, 2) + rhs->y * m4xy(lhs, 1, 2)
+    + rhs->z * m4xy(lhs, 2, 2) + rhs->w * m4xy(lhs, 3, 2);
+  w = rhs->x * m4xy(lhs, 0, 3) + rhs->y * m4xy(lhs, 1, 3)
+    + rhs->z * m4xy(lhs, 2, 3) + rhs->w * m4xy(lhs, 3, 3);
   out->x = x;
   out->y = y;
   out->z = z;
   out->w = w;
+#endif
+}
+
+void m4transpose(struct mat4 *m, struct mat4 *out) {
+#ifdef TRIG_X86
+  __m128 c0, c1, c2, c3;
+
+  c0 = _mm_loadu_ps(m->data);
+  c1 = _mm_loadu_ps(m->data + 4);
+  c2 = _mm_loadu_ps(m->data + 8);
+  c3 = _mm_loadu_ps(m->data + 12);
+  _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+  _mm_storeu_ps(out->data, c0);
+  _mm_storeu_ps(out->data + 4, c1);
+  _mm_storeu_ps(out->data + 8, c2);
+  _mm_storeu_ps(out->data + 12, c3);
+#else
+  size_t x, y;
+  struct mat4 result;
+
+  for (x = 0; x < 4; ++x) {
+    for (y = 0; y < 4; ++y) {
+      result.data[x * 4 + y] = m->data[y * 4 + x];
+    }
+  }
+  *out = result;
+#endif
+}
+
+int m4inverse_affine(struct mat4 *m, struct mat4 *out) {
+  /* For M = | R t |, inv(M) = | inv(R) -inv(R)t |. The rows of inv(R)
+   *         | 0 1 |           |   0        1    |
+   * are the cross products of R's columns divided by det(R) */
+  struct vec3 c0, c1, c2, t, r0, r1, r2;
+  float det, inv_det;
+
+  c0.x = m->data[0]; c0.y = m->data[1]; c0.z = m->data[2];
+  c1.x = m->data[4]; c1.y = m->data[5]; c1.z = m->data[6];
+  c2.x = m->data[8]; c2.y = m->data[9]; c2.z = m->data[10];
+  t.x = m->data[12]; t.y = m->data[13]; t.z = m->data[14];
+  v3cross(&c1, &c2, &r0);
+  v3cross(&c2, &c0, &r1);
+  v3cross(&c0, &c1, &r2);
+  det = v3dot(&c0, &r0);
+  if (det == 0.0f) return TRIG_ERROR_SINGULAR;
+  inv_det = 1.0f / det;
+  v3muls(&r0, inv_det, &r0);
+  v3muls(&r1, inv_det, &r1);
+  v3muls(&r2, inv_det, &r2);
+  out->data[0] = r0.x; out->data[4] = r0.y; out->data[8] = r0.z;
+  out->data[1] = r1.x; out->data[5] = r1.y; out->data[9] = r1.z;
+  out->data[2] = r2.x; out->data[6] = r2.y; out->data[10] = r2.z;
+  out->data[12] = -v3dot(&r0, &t);
+  out->data[13] = -v3dot(&r1, &t);
+  out->data[14] = -v3dot(&r2, &t);
+  out->data[3] = 0.0f;
+  out->data[7] = 0.0f;
+  out->data[11] = 0.0f;
+  out->data[15] = 1.0f;
+  return TRIG_ERROR_NONE;
+}
+
+int m4inverse(struct mat4 *m, struct mat4 *out) {
+#ifdef TRIG_X86
+  /* Block inverse over 2x2 sub matrices:
+   *   M = | A B |   inv(M) = 1/|M| | X Y |
+   *       | C D |                  | Z W |
+   * The algorithm is written against rows, but inv(transpose(M)) is
+   * transpose(inv(M)), so feeding it columns works just as well */
+  __m128 c0, c1, c2, c3, a, b, c, d;
+  __m128 det_sub, det_a, det_b, det_c, det_d, det_m, tr;
+  __m128 d_c, a_b, x, y, z, w, rdet;
+  float det;
+
+  c0 = _mm_loadu_ps(m->data);
+  c1 = _mm_loadu_ps(m->data + 4);
+  c2 = _mm_loadu_ps(m->data + 8);
+  c3 = _mm_loadu_ps(m->data + 12);
+  a = _mm_movelh_ps(c0, c1);
+  b = _mm_movehl_ps(c1, c0);
+  c = _mm_movelh_ps(c2, c3);
+  d = _mm_movehl_ps(c3, c2);
+  /* (|A|, |B|, |C|, |D|) */
+  det_sub = _mm_sub_ps(
+    _mm_mul_ps(SHUFFLE(c0, c2, 0, 2, 0, 2), SHUFFLE(c1, c3, 1, 3, 1, 3)),
+    _mm_mul_ps(SHUFFLE(c0, c2, 1, 3, 1, 3), SHUFFLE(c1, c3, 0, 2, 0, 2))
+  );
+  det_a = SWIZZLE(det_sub, 0, 0, 0, 0);
+  det_b = SWIZZLE(det_sub, 1, 1, 1, 1);
+  det_c = SWIZZLE(det_sub, 2, 2, 2, 2);
+  det_d = SWIZZLE(det_sub, 3, 3, 3, 3);
+  d_c = mat2_adj_mul(d, c);
+  a_b = mat2_adj_mul(a, b);
+  x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+  w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+  y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+  z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+  /* |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C) */
+  tr = _mm_mul_ps(a_b, SWIZZLE(d_c, 0, 2, 1, 3));
+  tr = _mm_add_ps(tr, SWIZZLE(tr, 2, 3, 0, 1));
+  tr = _mm_add_ps(tr, SWIZZLE(tr, 1, 0, 3, 2));
+  det_m = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+  det_m = _mm_sub_ps(det_m, tr);
+  det = _mm_cvtss_f32(det_m);
+  if (det == 0.0f) return TRIG_ERROR_SINGULAR;
+  rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_m);
+  x = _mm_mul_ps(x, rdet);
+  y = _mm_mul_ps(y, rdet);
+  z = _mm_mul_ps(z, rdet);
+  w = _mm_mul_ps(w, rdet);
+  /* Apply the adjugate swizzle while storing */
+  _mm_storeu_ps(out->data, SHUFFLE(x, y, 3, 1, 3, 1));
+  _mm_storeu_ps(out->data + 4, SHUFFLE(x, y, 2, 0, 2, 0));
+  _mm_storeu_ps(out->data + 8, SHUFFLE(z, w, 3, 1, 3, 1));
+  _mm_storeu_ps(out->data + 12, SHUFFLE(z, w, 2, 0, 2, 0));
+  return TRIG_ERROR_NONE;
+#else
+  /* Cofactor expansion over 2x2 sub determinants */
+  float *a = m->data;
+  float s0, s1, s2, s3, s4, s5, c0, c1, c2, c3, c4, c5, det, inv_det;
+  struct mat4 r;
+  size_t i;
+
+  s0 = a[0] * a[5] - a[4] * a[1];
+  s1 = a[0] * a[6] - a[4] * a[2];
+  s2 = a[0] * a[7] - a[4] * a[3];
+  s3 = a[1] * a[6] - a[5] * a[2];
+  s4 = a[1] * a[7] - a[5] * a[3];
+  s5 = a[2] * a[7] - a[6] * a[3];
+  c5 = a[10] * a[15] - a[14] * a[11];
+  c4 = a[9] * a[15] - a[13] * a[11];
+  c3 = a[9] * a[14] - a[13] * a[10];
+  c2 = a[8] * a[15] - a[12] * a[11];
+  c1 = a[8] * a[14] - a[12] * a[10];
+  c0 = a[8] * a[13] - a[12] * a[9];
+  det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+  if (det == 0.0f) return TRIG_ERROR_SINGULAR;
+  inv_det = 1.0f / det;
+  r.data[0] = a[5] * c5 - a[6] * c4 + a[7] * c3;
+  r.data[1] = -a[1] * c5 + a[2] * c4 - a[3] * c3;
+  r.data[2] = a[13] * s5 - a[14] * s4 + a[15] * s3;
+  r.data[3] = -a[9] * s5 + a[10] * s4 - a[11] * s3;
+  r.data[4] = -a[4] * c5 + a[6] * c2 - a[7] * c1;
+  r.data[5] = a[0] * c5 - a[2] * c2 + a[3] * c1;
+  r.data[6] = -a[12] * s5 + a[14] * s2 - a[15] * s1;
+  r.data[7] = a[8] * s5 - a[10] * s2 + a[11] * s1;
+  r.data[8] = a[4] * c4 - a[5] * c2 + a[7] * c0;
+  r.data[9] = -a[0] * c4 + a[1] * c2 - a[3] * c0;
+  r.data[10] = a[12] * s4 - a[13] * s2 + a[15] * s0;
+  r.data[11] = -a[8] * s4 + a[9] * s2 - a[11] * s0;
+  r.data[12] = -a[4] * c3 + a[5] * c1 - a[6] * c0;
+  r.data[13] = a[0] * c3 - a[1] * c1 + a[2] * c0;
+  r.data[14] = -a[12] * s3 + a[13] * s1 - a[14] * s0;
+  r.data[15] = a[8] * s3 - a[9] * s1 + a[10] * s0;
+  for (i = 0; i < 16; ++i) out->data[i] = r.data[i] * inv_det;
+  return TRIG_ERROR_NONE;
+#endif
+}
+
+void m4mulm_n(
+  struct mat4 *lhs,
+  struct mat4 *rhs,
+  struct mat4 *out,
+  size_t n
+) {
+  size_t i;
+
+#ifdef TRIG_X86
+  if (have_avx()) {
+    mulm_n_avx(lhs->data, rhs->data, out->data, n);
+    return;
+  }
+  for (i = 0; i < n; ++i) mulm_sse(lhs[i].data, rhs[i].data, out[i].data);
+#else
+  for (i = 0; i < n; ++i) mulm_scalar(lhs[i].data, rhs[i].data, out[i].data);
+#endif
+}
+
+void m4mulv_n(struct mat4 *m, struct vec4 *in, struct vec4 *out, size_t n) {
+#ifdef TRIG_X86
+  size_t i;
+  __m128 c0, c1, c2, c3;
+
+  if (have_avx()) {
+    mulv_n_avx(m->data, &in->x, &out->x, n);
+    return;
+  }
+  c0 = _mm_loadu_ps(m->data);
+  c1 = _mm_loadu_ps(m->data + 4);
+  c2 = _mm_loadu_ps(m->data + 8);
+  c3 = _mm_loadu_ps(m->data + 12);
+  for (i = 0; i < n; ++i) {
+    _mm_storeu_ps(&out[i].x, mulv_sse(c0, c1, c2, c3, _mm_loadu_ps(&in[i].x)));
+  }
+#else
+  size_t i;
+
+  for (i = 0; i < n; ++i) m4mulv(m, in + i, out + i);
+#endif
+}
+
+/* **************************************** */
+/* Fast approximations */
+/* **************************************** */
+
+/* Cody-Waite split of pi / 2, the first part has few enough bits that
+ * q * FAST_PI_2_A is exact for any quadrant count we expect */
+#define FAST_2_PI 0.63661977236758134f
+#define FAST_PI_2_A 1.5703125f
+#define FAST_PI_2_B 4.837512969970703125e-4f
+#define FAST_PI_2_C 7.54978995489188216e-8f
+#define FAST_PI_2 1.57079632679489662f
+#define FAST_PI 3.14159265358979324f
+/* sin and cos on [-pi / 4, pi / 4] (Cephes) */
+#define FAST_SIN_1 -1.6666654611e-1f
+#define FAST_SIN_2 8.3321608736e-3f
+#define FAST_SIN_3 -1.9515295891e-4f
+#define FAST_COS_1 4.166664568298827e-2f
+#define FAST_COS_2 -1.388731625493765e-3f
+#define FAST_COS_3 2.443315711809948e-5f
+/* atan on [0, 1] (Abramowitz and Stegun 4.4.49) */
+#define FAST_ATAN_1 -0.3333314528f
+#define FAST_ATAN_2 0.1999355085f
+#define FAST_ATAN_3 -0.1420889944f
+#define FAST_ATAN_4 0.1065626393f
+#define FAST_ATAN_5 -0.0752896400f
+#define FAST_ATAN_6 0.0429096138f
+#define FAST_ATAN_7 -0.0161657367f
+#define FAST_ATAN_8 0.0028662257f
+#define FAST_TINY 1.17549435e-38f
+/* 2^f on [-0.5, 0.5] (Cephes) */
+#define FAST_EXP2_MIN -126.0f
+#define FAST_EXP2_MAX 127.0f
+#define FAST_EXP2_1 6.931472028550421e-1f
+#define FAST_EXP2_2 2.402264791363012e-1f
+#define FAST_EXP2_3 5.550332471162809e-2f
+#define FAST_EXP2_4 9.618437357674640e-3f
+#define FAST_EXP2_5 1.339887440266574e-3f
+#define FAST_EXP2_6 1.535336188319500e-4f
+/* log(1 + t) on [sqrt(2) / 2 - 1, sqrt(2) - 1] (Cephes) */
+#define FAST_SQRT2 1.41421356237309505f
+#define FAST_LOG2E 1.44269504088896341f
+#define FAST_LOG_1 3.3333331174e-1f
+#define FAST_LOG_2 -2.4999993993e-1f
+#define FAST_LOG_3 2.0000714765e-1f
+#define FAST_LOG_4 -1.6668057665e-1f
+#define FAST_LOG_5 1.4249322787e-1f
+#define FAST_LOG_6 -1.2420140846e-1f
+#define FAST_LOG_7 1.1676998740e-1f
+#define FAST_LOG_8 -1.1514610310e-1f
+#define FAST_LOG_9 7.0376836292e-2f
+
+#ifdef TRIG_X86
+
+#define TF_ISA sse
+#define TF_VEC __m128
+#define TF_IVEC __m128i
+#define TF_W 4
+#define TF_LOAD(p) _mm_loadu_ps(p)
+#define TF_STORE(p, v) _mm_storeu_ps((p), (v))
+#define TF_SET1(f) _mm_set1_ps(f)
+#define TF_ISET1(i) _mm_set1_epi32(i)
+#define TF_ADD(a, b) _mm_add_ps((a), (b))
+#define TF_SUB(a, b) _mm_sub_ps((a), (b))
+#define TF_MUL(a, b) _mm_mul_ps((a), (b))
+#define TF_DIV(a, b) _mm_div_ps((a), (b))
+#define TF_MIN(a, b) _mm_min_ps((a), (b))
+#define TF_MAX(a, b) _mm_max_ps((a), (b))
+#define TF_AND(a, b) _mm_and_ps((a), (b))
+#define TF_ANDNOT(a, b) _mm_andnot_ps((a), (b))
+#define TF_OR(a, b) _mm_or_ps((a), (b))
+#define TF_XOR(a, b) _mm_xor_ps((a), (b))
+#define TF_CMPGT(a, b) _mm_cmpgt_ps((a), (b))
+#define TF_RSQRT(a) _mm_rsqrt_ps(a)
+#define TF_ROUND(a) _mm_cvtps_epi32(a)
+#define TF_CVTI(a) _mm_cvtepi32_ps(a)
+#define TF_IADD(a, b) _mm_add_epi32((a), (b))
+#define TF_ISUB(a, b) _mm_sub_epi32((a), (b))
+#define TF_IAND(a, b) _mm_and_si128((a), (b))
+#define TF_ICMPEQ(a, b) _mm_cmpeq_epi32((a), (b))
+#define TF_ISLL(a, n) _mm_slli_epi32((a), (n))
+#define TF_ISRL(a, n) _mm_srli_epi32((a), (n))
+#define TF_ASF(a) _mm_castsi128_ps(a)
+#define TF_ASI(a) _mm_castps_si128(a)
+#include "trig_fast_impl.h"
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define TF_ISA avx2
+#define TF_VEC __m256
+#define TF_IVEC __m256i
+#define TF_W 8
+#define TF_LOAD(p) _mm256_loadu_ps(p)
+#define TF_STORE(p, v) _mm256_storeu_ps((p), (v))
+#define TF_SET1(f) _mm256_set1_ps(f)
+#define TF_ISET1(i) _mm256_set1_epi32(i)
+#define TF_ADD(a, b) _mm256_add_ps((a), (b))
+#define TF_SUB(a, b) _mm256_sub_ps((a), (b))
+#define TF_MUL(a, b) _mm256_mul_ps((a), (b))
+#define TF_DIV(a, b) _mm256_div_ps((a), (b))
+#define TF_MIN(a, b) _mm256_min_ps((a), (b))
+#define TF_MAX(a, b) _mm256_max_ps((a), (b))
+#define TF_AND(a, b) _mm256_and_ps((a), (b))
+#define TF_ANDNOT(a, b) _mm256_andnot_ps((a), (b))
+#define TF_OR(a, b) _mm256_or_ps((a), (b))
+#define TF_XOR(a, b) _mm256_xor_ps((a), (b))
+#define TF_CMPGT(a, b) _mm256_cmp_ps((a), (b), _CMP_GT_OQ)
+#define TF_RSQRT(a) _mm256_rsqrt_ps(a)
+#define TF_ROUND(a) _mm256_cvtps_epi32(a)
+#define TF_CVTI(a) _mm256_cvtepi32_ps(a)
+#define TF_IADD(a, b) _mm256_add_epi32((a), (b))
+#define TF_ISUB(a, b) _mm256_sub_epi32((a), (b))
+#define TF_IAND(a, b) _mm256_and_si256((a), (b))
+#define TF_ICMPEQ(a, b) _mm256_cmpeq_epi32((a), (b))
+#define TF_ISLL(a, n) _mm256_slli_epi32((a), (n))
+#define TF_ISRL(a, n) _mm256_srli_epi32((a), (n))
+#define TF_ASF(a) _mm256_castsi256_ps(a)
+#define TF_ASI(a) _mm256_castps_si256(a)
+#include "trig_fast_impl.h"
+#pragma GCC pop_options
+
+static int have_avx2(void) {
+  static int cached = -1;
+
+  if (cached < 0) {
+    __builtin_cpu_init();
+    cached = __builtin_cpu_supports("avx2");
+  }
+  return cached;
+}
+
+#endif  /* TRIG_X86 */
+
+static float fast_asf(uint32_t u) {
+  float f;
+
+  memcpy(&f, &u, sizeof(float));
+  return f;
+}
+
+static uint32_t fast_asi(float f) {
+  uint32_t u;
+
+  memcpy(&u, &f, sizeof(float));
+  return u;
+}
+
+static long fast_round(float f) {
+  return (long) (f >= 0.0f ? f + 0.5f : f - 0.5f);
+}
+
+void fsincos(float x, float *out_sin, float *out_cos) {
+  long q;
+  float r, z, ps, pc, t;
+
+  q = fast_round(x * FAST_2_PI);
+  r = x - (float) q * FAST_PI_2_A;
+  r -= (float) q * FAST_PI_2_B;
+  r -= (float) q * FAST_PI_2_C;
+  z = r * r;
+  ps = ((FAST_SIN_3 * z + FAST_SIN_2) * z + FAST_SIN_1) * z * r + r;
+  pc = ((FAST_COS_3 * z + FAST_COS_2) * z + FAST_COS_1) * z * z;
+  pc = pc - 0.5f * z + 1.0f;
+  if (q & 1) {
+    t = ps;
+    ps = pc;
+    pc = t;
+  }
+  *out_sin = (q & 2) ? -ps : ps;
+  *out_cos = ((q + 1) & 2) ? -pc : pc;
+}
+
+float fatan2(float y, float x) {
+  float ay, ax, a, z, p;
+
+  ay = y < 0.0f ? -y : y;
+  ax = x < 0.0f ? -x : x;
+  a = (ax > ay) ? ay / ax : ax / (ay > FAST_TINY ? ay : FAST_TINY);
+  z = a * a;
+  p = FAST_ATAN_8 * z + FAST_ATAN_7;
+  p = p * z + FAST_ATAN_6;
+  p = p * z + FAST_ATAN_5;
+  p = p * z + FAST_ATAN_4;
+  p = p * z + FAST_ATAN_3;
+  p = p * z + FAST_ATAN_2;
+  p = p * z + FAST_ATAN_1;
+  p = p * z * a + a;
+  if (ay > ax) p = FAST_PI_2 - p;
+  if (fast_asi(x) & 0x80000000UL) p = FAST_PI - p;
+  return fast_asf(fast_asi(p) | (fast_asi(y) & 0x80000000UL));
+}
+
+float fexp2(float x) {
+  long q;
+  float f, p;
+
+  if (x < FAST_EXP2_MIN) x = FAST_EXP2_MIN;
+  if (x > FAST_EXP2_MAX) x = FAST_EXP2_MAX;
+  q = fast_round(x);
+  f = x - (float) q;
+  p = FAST_EXP2_6 * f + FAST_EXP2_5;
+  p = p * f + FAST_EXP2_4;
+  p = p * f + FAST_EXP2_3;
+  p = p * f + FAST_EXP2_2;
+  p = p * f + FAST_EXP2_1;
+  p = p * f + 1.0f;
+  return p * fast_asf((uint32_t) (q + 127) << 23);
 }
 
+float flog2(float x) {
+  uint32_t bits;
+  float e, m, t, z, p;
+
+  bits = fast_asi(x);
+  e = (float) ((long) (bits >> 23) - 127);
+  m = fast_asf((bits & 0x007fffffUL) | 0x3f800000UL);
+  if (m > FAST_SQRT2) {
+    m *= 0.5f;
+    e += 1.0f;
+  }
+  t = m - 1.0f;
+  z = t * t;
+  p = FAST_LOG_9 * t + FAST_LOG_8;
+  p = p * t + FAST_LOG_7;
+  p = p * t + FAST_LOG_6;
+  p = p * t + FAST_LOG_5;
+  p = p * t + FAST_LOG_4;
+  p = p * t + FAST_LOG_3;
+  p = p * t + FAST_LOG_2;
+  p = p * t + FAST_LOG_1;
+  p = p * z * t - 0.5f * z + t;
+  return p * FAST_LOG2E + e;
+}
+
+float frsqrt(float x) {
+  float r;
+
+  /* The bit trick guess is within a few percent, three Newton steps take
+   * that down to float precision */
+  r = fast_asf((uint32_t) 0x5f375a86UL - (fast_asi(x) >> 1));
+  r = r * (1.5f - 0.5f * x * r * r);
+  r = r * (1.5f - 0.5f * x * r * r);
+  r = r * (1.5f - 0.5f * x * r * r);
+  return r;
+}
+
+void fsincos_n(float *x, float *out_sin, float *out_cos, size_t n) {
+  size_t i = 0;
+
+#ifdef TRIG_X86
+  if (have_avx2()) i = sincos_avx2(i, n, x, out_sin, out_cos);
+  i = sincos_sse(i, n, x, out_sin, out_cos);
+#endif
+  for (; i < n; ++i) fsincos(x[i], out_sin + i, out_cos + i);
+}
+
+void fatan2_n(float *y, float *x, float *out, size_t n) {
+  size_t i = 0;
+
+#ifdef TRIG_X86
+  if (have_avx2()) i = atan2_avx2(i, n, y, x, out);
+  i = atan2_sse(i, n, y, x, out);
+#endif
+  for (; i < n; ++i) out[i] = fatan2(y[i], x[i]);
+}
+
+void fexp2_n(float *x, float *out, size_t n) {
+  size_t i = 0;
+
+#ifdef TRIG_X86
+  if (have_avx2()) i = exp2_avx2(i, n, x, out);
+  i = exp2_sse(i, n, x, out);
+#endif
+  for (; i < n; ++i) out[i] = fexp2(x[i]);
+}
+
+void flog2_n(float *x, float *out, size_t n) {
+  size_t i = 0;
+
+#ifdef TRIG_X86
+  if (have_avx2()) i = log2_avx2(i, n, x, out);
+  i = log2_sse(i, n, x, out);
+#endif
+  for (; i < n; ++i) out[i] = flog2(x[i]);
+}
+
+void frsqrt_n(float *x, float *out, size_t n) {
+  size_t i = 0;
+
+#ifdef TRIG_X86
+  if (have_avx2()) i = rsqrt_avx2(i, n, x, out);
+  i = rsqrt_sse(i, n, x, out);
+#endif
+  for (; i < n; ++i) out[i] = frsqrt(x[i]);
+}
@@ -19,6 +19,8 @@
 #ifndef TRIG_H
 #define TRIG_H
 
+#include <stddef.h>
+
 struct vec3 {
   float x, y, z;
 };
@@ -35,12 +37,15 @@ struct mat4 {
   float data[16];
 };
 
+#define TRIG_ERROR_NONE 0
+#define TRIG_ERROR_SINGULAR -1
+
 void v3addv(struct vec3 *lhs, struct vec3 *rhs, struct vec3 *out);
 void v3subv(struct vec3 *lhs, struct vec3 *rhs, struct vec3 *out);
 void v3adds(struct vec3 *v, float n, struct vec3 *out);
 void v3subs(struct vec3 *v, float n, struct vec3 *out);
 void v3muls(struct vec3 *v, float n, struct vec3 *out);
-float v3dot(struct vec3 *rhs, struct vec3 *out);
+float v3dot(struct vec3 *lhs, struct vec3 *rhs);
 void v3cross(struct vec3 *lhs, struct vec3 *rhs, struct vec3 *out);
 
 void v4addv(struct vec4 *lhs, struct vec4 *rhs, struct vec4 *out);
@@ -48,7 +53,8 @@ void v4subv(struct vec4 *lhs, struct vec4 *rhs, struct vec4 *out);
 void v4adds(struct vec4 *v, float n, struct vec4 *out);
 void v4subs(struct vec4 *v, float n, struct vec4 *out);
 void v4muls(struct vec4 *v, float n, struct vec4 *out);
-float v4dot(struct vec4 *rhs, struct vec4 *out);
+float v4dot(struct vec4 *lhs, struct vec4 *rhs);
+/* Cross product of the xyz components, w is set to 0 */
 void v4cross(struct vec4 *lhs, struct vec4 *rhs, struct vec4 *out);
 
 void m4new(float f, struct mat4 *out);
@@ -57,5 +63,47 @@ void m4add(struct mat4 *lhs, struct mat4 *rhs, struct mat4 *out);
 void m4sub(struct mat4 *lhs, struct mat4 *rhs, struct mat4 *out);
 void m4mulm(struct mat4 *lhs, struct mat4 *rhs, struct mat4 *out);
 void m4mulv(struct mat4 *lhs, struct vec4 *rhs, struct vec4 *out);
+void m4transpose(struct mat4 *m, struct mat4 *out);
+/* Only valid when the bottom row is (0, 0, 0, 1) */
+int m4inverse_affine(struct mat4 *m, struct mat4 *out);
+int m4inverse(struct mat4 *m, struct mat4 *out);
+
+/* Batch versions. out[i] = lhs[i] * rhs[i] */
+void m4mulm_n(
+  struct mat4 *lhs,
+  struct mat4 *rhs,
+  struct mat4 *out,
+  size_t n
+);
+/* out[i] = m * in[i] */
+void m4mulv_n(struct mat4 *m, struct vec4 *in, struct vec4 *out, size_t n);
+
+/* Fast approximations. Maximum errors measured against libm, see
+ * `make trig-bench`:
+ *
+ *   fsincos    8e-8 absolute for |x| <= 8192
+ *   fatan2     3e-7 radians
+ *   fexp2      1.1e-7 relative, x is clamped to [-126, 127]
+ *   flog2      8e-8 absolute below |log2(x)| = 1, relative above, x must
+ *              be positive and normal
+ *   frsqrt     3e-7 relative, x must be positive and normal
+ *   frsqrt_n   4e-7 relative, same domain
+ *
+ * The _n versions run over arrays 8 (AVX2) or 4 (SSE) at a time and
+ * finish the tail with the scalar ones. All but frsqrt_n use the same
+ * polynomials as the scalar versions and share their bounds. frsqrt_n
+ * takes one Newton step from the hardware estimate instead, whose error
+ * the ISA only caps at 1.5 * 2^-12, so its bound is looser and the exact
+ * error depends on the CPU (2.5e-7 measured on Intel) */
+void fsincos(float x, float *out_sin, float *out_cos);
+float fatan2(float y, float x);
+float fexp2(float x);
+float flog2(float x);
+float frsqrt(float x);
+void fsincos_n(float *x, float *out_sin, float *out_cos, size_t n);
+void fatan2_n(float *y, float *x, float *out, size_t n);
+void fexp2_n(float *x, float *out, size_t n);
+void flog2_n(float *x, float *out, size_t n);
+void frsqrt_n(float *x, float *out, size_t n);
 
 #endif
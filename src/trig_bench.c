@@ -0,0 +1,363 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Standalone check of the fast approximations in trig.h, built by
+ * `make trig-bench`. Measures the maximum error of the scalar and the
+ * array versions against libm in double precision, fails when either is
+ * over the bound trig.h documents, then times them against libm's float
+ * functions */
+
+/* sinf, cosf, atan2f, exp2f, log2f, sqrtf */
+#define _ISOC99_SOURCE
+
+#include "trig.h"
+#include "timer.h"
+#include "xrand.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+  /* Inputs per accuracy sweep */
+  N_ACCURACY = 1 << 22,
+  /* Small enough to stay in cache while timing */
+  N_TIMING = 1 << 14,
+  TIMING_REPS = 512
+};
+
+/* Keep in step with trig.h */
+#define BOUND_SINCOS 8e-8
+#define BOUND_ATAN2 3e-7
+#define BOUND_EXP2 1.1e-7
+#define BOUND_LOG2 8e-8
+#define BOUND_RSQRT 3e-7
+#define BOUND_RSQRT_N 4e-7
+
+enum error_kind {
+  ERROR_ABSOLUTE,
+  ERROR_RELATIVE,
+  /* absolute below 1, relative above, how flog2 is specified */
+  ERROR_MIXED
+};
+
+struct buffers {
+  float *x;
+  float *y;
+  float *out;
+  float *out2;
+  double *ref;
+  double *ref2;
+};
+
+static int failures = 0;
+/* Timed results are summed in here so the loops aren't optimized out */
+static volatile float sink;
+
+static double error_of(enum error_kind kind, double ref, float got) {
+  double err = (double) got - ref;
+
+  if (err < 0.0) err = -err;
+  if (kind == ERROR_RELATIVE || (kind == ERROR_MIXED && fabs(ref) >= 1.0)) {
+    err /= fabs(ref);
+  }
+  return err;
+}
+
+static double max_error(
+  enum error_kind kind,
+  double *ref,
+  float *got,
+  size_t n
+) {
+  size_t i;
+  double err, max = 0.0;
+
+  for (i = 0; i < n; ++i) {
+    err = error_of(kind, ref[i], got[i]);
+    if (err > max) max = err;
+  }
+  return max;
+}
+
+static void report(const char *name, double err, double bound) {
+  int ok = err <= bound;
+
+  printf(
+    "  %-10s max error %.3e bound %.1e %s\n",
+    name,
+    err,
+    bound,
+    ok ? "ok" : "FAIL"
+  );
+  if (!ok) ++failures;
+}
+
+/* Positive normal floats spread evenly over the exponents */
+static void fill_positive(struct xrand_wide *wide, float *x, size_t n) {
+  size_t i;
+
+  xrand_fill_range(wide, -125.0f, 127.0f, x, n);
+  for (i = 0; i < n; ++i) x[i] = (float) pow(2.0, (double) x[i]);
+}
+
+static void check_sincos(struct xrand_wide *wide, struct buffers *b) {
+  size_t i, n = N_ACCURACY;
+  double es = 0.0, ec = 0.0, e;
+  float s, c;
+
+  xrand_fill_range(wide, -8192.0f, 8192.0f, b->x, n);
+  for (i = 0; i < n; ++i) {
+    b->ref[i] = sin((double) b->x[i]);
+    b->ref2[i] = cos((double) b->x[i]);
+    fsincos(b->x[i], &s, &c);
+    e = error_of(ERROR_ABSOLUTE, b->ref[i], s);
+    if (e > es) es = e;
+    e = error_of(ERROR_ABSOLUTE, b->ref2[i], c);
+    if (e > ec) ec = e;
+  }
+  report("fsincos", es > ec ? es : ec, BOUND_SINCOS);
+  fsincos_n(b->x, b->out, b->out2, n);
+  es = max_error(ERROR_ABSOLUTE, b->ref, b->out, n);
+  ec = max_error(ERROR_ABSOLUTE, b->ref2, b->out2, n);
+  report("fsincos_n", es > ec ? es : ec, BOUND_SINCOS);
+}
+
+static void check_atan2(struct xrand_wide *wide, struct buffers *b) {
+  size_t i, n = N_ACCURACY;
+
+  xrand_fill_range(wide, -1000.0f, 1000.0f, b->y, n);
+  xrand_fill_range(wide, -1000.0f, 1000.0f, b->x, n);
+  for (i = 0; i < n; ++i) {
+    b->ref[i] = atan2((double) b->y[i], (double) b->x[i]);
+    b->out[i] = fatan2(b->y[i], b->x[i]);
+  }
+  report("fatan2", max_error(ERROR_ABSOLUTE, b->ref, b->out, n), BOUND_ATAN2);
+  fatan2_n(b->y, b->x, b->out, n);
+  report(
+    "fatan2_n",
+    max_error(ERROR_ABSOLUTE, b->ref, b->out, n),
+    BOUND_ATAN2
+  );
+}
+
+static void check_exp2(struct xrand_wide *wide, struct buffers *b) {
+  size_t i, n = N_ACCURACY;
+
+  xrand_fill_range(wide, -126.0f, 127.0f, b->x, n);
+  for (i = 0; i < n; ++i) {
+    b->ref[i] = pow(2.0, (double) b->x[i]);
+    b->out[i] = fexp2(b->x[i]);
+  }
+  report("fexp2", max_error(ERROR_RELATIVE, b->ref, b->out, n), BOUND_EXP2);
+  fexp2_n(b->x, b->out, n);
+  report("fexp2_n", max_error(ERROR_RELATIVE, b->ref, b->out, n), BOUND_EXP2);
+}
+
+static void check_log2(struct xrand_wide *wide, struct buffers *b) {
+  size_t i, n = N_ACCURACY;
+
+  fill_positive(wide, b->x, n / 2);
+  /* and densely where the absolute bound applies */
+  xrand_fill_range(wide, 0.5f, 2.0f, b->x + n / 2, n - n / 2);
+  for (i = 0; i < n; ++i) {
+    b->ref[i] = log((double) b->x[i]) / log(2.0);
+    b->out[i] = flog2(b->x[i]);
+  }
+  report("flog2", max_error(ERROR_MIXED, b->ref, b->out, n), BOUND_LOG2);
+  flog2_n(b->x, b->out, n);
+  report("flog2_n", max_error(ERROR_MIXED, b->ref, b->out, n), BOUND_LOG2);
+}
+
+static void check_rsqrt(struct xrand_wide *wide, struct buffers *b) {
+  size_t i, n = N_ACCURACY;
+
+  fill_positive(wide, b->x, n);
+  for (i = 0; i < n; ++i) {
+    b->ref[i] = 1.0 / sqrt((double) b->x[i]);
+    b->out[i] = frsqrt(b->x[i]);
+  }
+  report("frsqrt", max_error(ERROR_RELATIVE, b->ref, b->out, n), BOUND_RSQRT);
+  frsqrt_n(b->x, b->out, n);
+  report(
+    "frsqrt_n",
+    max_error(ERROR_RELATIVE, b->ref, b->out, n),
+    BOUND_RSQRT_N
+  );
+}
+
+static double ns_per(uint64_t start, size_t n_reps) {
+  return (double) (timer_now_ns() - start)
+    / ((double) n_reps * (double) N_TIMING);
+}
+
+static void sum_out(float *out) {
+  size_t i;
+  float sum = 0.0f;
+
+  for (i = 0; i < N_TIMING; ++i) sum += out[i];
+  sink += sum;
+}
+
+static void time_all(struct xrand_wide *wide, struct buffers *b) {
+  size_t i, r;
+  uint64_t start;
+  double fast_n, fast, libm;
+
+  printf("ns per element, array / scalar / libm:\n");
+
+  xrand_fill_range(wide, -8192.0f, 8192.0f, b->x, N_TIMING);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    fsincos_n(b->x, b->out, b->out2, N_TIMING);
+    sum_out(b->out);
+  }
+  fast_n = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) fsincos(b->x[i], b->out + i, b->out2 + i);
+    sum_out(b->out);
+  }
+  fast = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) {
+      b->out[i] = sinf(b->x[i]);
+      b->out2[i] = cosf(b->x[i]);
+    }
+    sum_out(b->out);
+  }
+  libm = ns_per(start, TIMING_REPS);
+  printf("  %-10s %7.2f %7.2f %7.2f\n", "sincos", fast_n, fast, libm);
+
+  xrand_fill_range(wide, -1000.0f, 1000.0f, b->y, N_TIMING);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    fatan2_n(b->y, b->x, b->out, N_TIMING);
+    sum_out(b->out);
+  }
+  fast_n = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = fatan2(b->y[i], b->x[i]);
+    sum_out(b->out);
+  }
+  fast = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = atan2f(b->y[i], b->x[i]);
+    sum_out(b->out);
+  }
+  libm = ns_per(start, TIMING_REPS);
+  printf("  %-10s %7.2f %7.2f %7.2f\n", "atan2", fast_n, fast, libm);
+
+  xrand_fill_range(wide, -126.0f, 127.0f, b->x, N_TIMING);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    fexp2_n(b->x, b->out, N_TIMING);
+    sum_out(b->out);
+  }
+  fast_n = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = fexp2(b->x[i]);
+    sum_out(b->out);
+  }
+  fast = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = exp2f(b->x[i]);
+    sum_out(b->out);
+  }
+  libm = ns_per(start, TIMING_REPS);
+  printf("  %-10s %7.2f %7.2f %7.2f\n", "exp2", fast_n, fast, libm);
+
+  fill_positive(wide, b->x, N_TIMING);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    flog2_n(b->x, b->out, N_TIMING);
+    sum_out(b->out);
+  }
+  fast_n = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = flog2(b->x[i]);
+    sum_out(b->out);
+  }
+  fast = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = log2f(b->x[i]);
+    sum_out(b->out);
+  }
+  libm = ns_per(start, TIMING_REPS);
+  printf("  %-10s %7.2f %7.2f %7.2f\n", "log2", fast_n, fast, libm);
+
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    frsqrt_n(b->x, b->out, N_TIMING);
+    sum_out(b->out);
+  }
+  fast_n = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = frsqrt(b->x[i]);
+    sum_out(b->out);
+  }
+  fast = ns_per(start, TIMING_REPS);
+  start = timer_now_ns();
+  for (r = 0; r < TIMING_REPS; ++r) {
+    for (i = 0; i < N_TIMING; ++i) b->out[i] = 1.0f / sqrtf(b->x[i]);
+    sum_out(b->out);
+  }
+  libm = ns_per(start, TIMING_REPS);
+  printf("  %-10s %7.2f %7.2f %7.2f\n", "rsqrt", fast_n, fast, libm);
+}
+
+int main(void) {
+  struct xrand_state state;
+  struct xrand_wide wide;
+  struct buffers b;
+
+  b.x = malloc(sizeof(float) * N_ACCURACY);
+  b.y = malloc(sizeof(float) * N_ACCURACY);
+  b.out = malloc(sizeof(float) * N_ACCURACY);
+  b.out2 = malloc(sizeof(float) * N_ACCURACY);
+  b.ref = malloc(sizeof(double) * N_ACCURACY);
+  b.ref2 = malloc(sizeof(double) * N_ACCURACY);
+  if (!b.x || !b.y || !b.out || !b.out2 || !b.ref || !b.ref2) {
+    fprintf(stderr, "trig-bench: out of memory\n");
+    return 1;
+  }
+  /* Fixed so a failure reproduces */
+  xrand_seed(&state, 1);
+  xrand_wide_init(&wide, &state);
+  printf("accuracy against libm, %d inputs each:\n", N_ACCURACY);
+  check_sincos(&wide, &b);
+  check_atan2(&wide, &b);
+  check_exp2(&wide, &b);
+  check_log2(&wide, &b);
+  check_rsqrt(&wide, &b);
+  time_all(&wide, &b);
+  free(b.x);
+  free(b.y);
+  free(b.out);
+  free(b.out2);
+  free(b.ref);
+  free(b.ref2);
+  return failures ? 1 : 0;
+}
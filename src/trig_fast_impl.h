@@ -0,0 +1,242 @@
+/* Copyright 2020, Jeffery Stager
+ *
+ * This file is part of Tortuga
+ *
+ * Tortuga is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tortuga is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tortuga.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Fast math kernel template for trig.c, included once per instruction
+ * set. No include guard on purpose. The includer defines:
+ *
+ *   TF_ISA                     suffix for the generated function names
+ *   TF_VEC, TF_IVEC            float and int32 register types
+ *   TF_W                       lanes per register
+ *   TF_LOAD(p), TF_STORE(p, v)
+ *   TF_SET1(f), TF_ISET1(i)
+ *   TF_ADD, TF_SUB, TF_MUL, TF_DIV, TF_MIN, TF_MAX
+ *   TF_AND, TF_ANDNOT (~a & b), TF_OR, TF_XOR
+ *   TF_CMPGT                   all ones lanes where a > b
+ *   TF_RSQRT                   hardware estimate
+ *   TF_ROUND(v)                float to nearest int32
+ *   TF_CVTI(v)                 int32 to float
+ *   TF_IADD, TF_ISUB, TF_IAND, TF_ICMPEQ
+ *   TF_ISLL(v, n), TF_ISRL(v, n)
+ *   TF_ASF(v), TF_ASI(v)       reinterpret between the two register types
+ *
+ * The algorithms and constants mirror the scalar versions in trig.c
+ * except for rsqrt, which refines TF_RSQRT instead of the bit trick. See
+ * trig.h for the error bounds. Every kernel starts at element i, stops at
+ * the last whole register and returns where it stopped */
+
+#define TF_CAT_(a, b) a##_##b
+#define TF_CAT(a, b) TF_CAT_(a, b)
+#define TF_FN(name) TF_CAT(name, TF_ISA)
+#define TF_SELECT(m, a, b) TF_OR(TF_AND((m), (a)), TF_ANDNOT((m), (b)))
+#define TF_SIGN TF_ASF(TF_ISET1((int) 0x80000000UL))
+
+static size_t TF_FN(sincos)(
+  size_t i,
+  size_t n,
+  float *x,
+  float *out_sin,
+  float *out_cos
+) {
+  for (; i + TF_W <= n; i += TF_W) {
+    TF_VEC v, qf, r, z, ps, pc, swap;
+    TF_IVEC q;
+
+    v = TF_LOAD(x + i);
+    q = TF_ROUND(TF_MUL(v, TF_SET1(FAST_2_PI)));
+    qf = TF_CVTI(q);
+    r = TF_SUB(v, TF_MUL(qf, TF_SET1(FAST_PI_2_A)));
+    r = TF_SUB(r, TF_MUL(qf, TF_SET1(FAST_PI_2_B)));
+    r = TF_SUB(r, TF_MUL(qf, TF_SET1(FAST_PI_2_C)));
+    z = TF_MUL(r, r);
+    ps = TF_ADD(TF_MUL(TF_SET1(FAST_SIN_3), z), TF_SET1(FAST_SIN_2));
+    ps = TF_ADD(TF_MUL(ps, z), TF_SET1(FAST_SIN_1));
+    ps = TF_ADD(TF_MUL(TF_MUL(ps, z), r), r);
+    pc = TF_ADD(TF_MUL(TF_SET1(FAST_COS_3), z), TF_SET1(FAST_COS_2));
+    pc = TF_ADD(TF_MUL(pc, z), TF_SET1(FAST_COS_1));
+    pc = TF_MUL(TF_MUL(pc, z), z);
+    pc = TF_ADD(TF_SUB(pc, TF_MUL(z, TF_SET1(0.5f))), TF_SET1(1.0f));
+    /* Odd quadrants swap sin and cos, then the sign comes from bit 1 of
+     * the quadrant for sin and of quadrant + 1 for cos */
+    swap = TF_ASF(
+      TF_ICMPEQ(TF_IAND(q, TF_ISET1(1)), TF_ISET1(1))
+    );
+    TF_STORE(
+      out_sin + i,
+      TF_XOR(
+        TF_SELECT(swap, pc, ps),
+        TF_ASF(TF_ISLL(TF_IAND(q, TF_ISET1(2)), 30))
+      )
+    );
+    TF_STORE(
+      out_cos + i,
+      TF_XOR(
+        TF_SELECT(swap, ps, pc),
+        TF_ASF(TF_ISLL(TF_IAND(TF_IADD(q, TF_ISET1(1)), TF_ISET1(2)), 30))
+      )
+    );
+  }
+  return i;
+}
+
+static size_t TF_FN(atan2)(
+  size_t i,
+  size_t n,
+  float *y,
+  float *x,
+  float *out
+) {
+  for (; i + TF_W <= n; i += TF_W) {
+    TF_VEC vy, vx, ay, ax, a, z, p, neg_x;
+
+    vy = TF_LOAD(y + i);
+    vx = TF_LOAD(x + i);
+    ay = TF_ANDNOT(TF_SIGN, vy);
+    ax = TF_ANDNOT(TF_SIGN, vx);
+    /* The floor on the divisor turns atan2(0, 0) into 0 instead of NaN */
+    a = TF_DIV(
+      TF_MIN(ax, ay),
+      TF_MAX(TF_MAX(ax, ay), TF_SET1(FAST_TINY))
+    );
+    z = TF_MUL(a, a);
+    p = TF_ADD(TF_MUL(TF_SET1(FAST_ATAN_8), z), TF_SET1(FAST_ATAN_7));
+    p = TF_ADD(TF_MUL(p, z), TF_SET1(FAST_ATAN_6));
+    p = TF_ADD(TF_MUL(p, z), TF_SET1(FAST_ATAN_5));
+    p = TF_ADD(TF_MUL(p, z), TF_SET1(FAST_ATAN_4));
+    p = TF_ADD(TF_MUL(p, z), TF_SET1(FAST_ATAN_3));
+    p = TF_ADD(TF_MUL(p, z), TF_SET1(FAST_ATAN_2));
+    p = TF_ADD(TF_MUL(p, z), TF_SET1(FAST_ATAN_1));
+    p = TF_ADD(TF_MUL(TF_MUL(p, z), a), a);
+    p = TF_SELECT(TF_CMPGT(ay, ax), TF_SUB(TF_SET1(FAST_PI_2), p), p);
+    neg_x = TF_ASF(
+      TF_ICMPEQ(TF_ASI(TF_AND(vx, TF_SIGN)), TF_ASI(TF_SIGN))
+    );
+    p = TF_SELECT(neg_x, TF_SUB(TF_SET1(FAST_PI), p), p);
+    TF_STORE(out + i, TF_OR(p, TF_AND(vy, TF_SIGN)));
+  }
+  return i;
+}
+
+static size_t TF_FN(exp2)(size_t i, size_t n, float *x, float *out) {
+  for (; i + TF_W <= n; i += TF_W) {
+    TF_VEC v, f, p;
+    TF_IVEC q;
+
+    v = TF_LOAD(x + i);
+    v = TF_MIN(TF_MAX(v, TF_SET1(FAST_EXP2_MIN)), TF_SET1(FAST_EXP2_MAX));
+    q = TF_ROUND(v);
+    f = TF_SUB(v, TF_CVTI(q));
+    p = TF_ADD(TF_MUL(TF_SET1(FAST_EXP2_6), f), TF_SET1(FAST_EXP2_5));
+    p = TF_ADD(TF_MUL(p, f), TF_SET1(FAST_EXP2_4));
+    p = TF_ADD(TF_MUL(p, f), TF_SET1(FAST_EXP2_3));
+    p = TF_ADD(TF_MUL(p, f), TF_SET1(FAST_EXP2_2));
+    p = TF_ADD(TF_MUL(p, f), TF_SET1(FAST_EXP2_1));
+    p = TF_ADD(TF_MUL(p, f), TF_SET1(1.0f));
+    /* Build 2^q straight in the exponent field */
+    TF_STORE(
+      out + i,
+      TF_MUL(p, TF_ASF(TF_ISLL(TF_IADD(q, TF_ISET1(127)), 23)))
+    );
+  }
+  return i;
+}
+
+static size_t TF_FN(log2)(size_t i, size_t n, float *x, float *out) {
+  for (; i + TF_W <= n; i += TF_W) {
+    TF_VEC m, big, e, t, z, p;
+    TF_IVEC bits;
+
+    bits = TF_ASI(TF_LOAD(x + i));
+    e = TF_CVTI(TF_ISUB(TF_ISRL(bits, 23), TF_ISET1(127)));
+    m = TF_ASF(
+      TF_IADD(TF_IAND(bits, TF_ISET1(0x007fffff)), TF_ISET1(0x3f800000))
+    );
+    /* Keep the mantissa within [sqrt(2) / 2, sqrt(2)] */
+    big = TF_CMPGT(m, TF_SET1(FAST_SQRT2));
+    m = TF_SELECT(big, TF_MUL(m, TF_SET1(0.5f)), m);
+    e = TF_ADD(e, TF_AND(big, TF_SET1(1.0f)));
+    t = TF_SUB(m, TF_SET1(1.0f));
+    z = TF_MUL(t, t);
+    p = TF_ADD(TF_MUL(TF_SET1(FAST_LOG_9), t), TF_SET1(FAST_LOG_8));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_7));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_6));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_5));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_4));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_3));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_2));
+    p = TF_ADD(TF_MUL(p, t), TF_SET1(FAST_LOG_1));
+    p = TF_MUL(TF_MUL(p, z), t);
+    p = TF_ADD(TF_SUB(p, TF_MUL(z, TF_SET1(0.5f))), t);
+    TF_STORE(out + i, TF_ADD(TF_MUL(p, TF_SET1(FAST_LOG2E)), e));
+  }
+  return i;
+}
+
+static size_t TF_FN(rsqrt)(size_t i, size_t n, float *x, float *out) {
+  for (; i + TF_W <= n; i += TF_W) {
+    TF_VEC v, r;
+
+    /* One Newton step on the hardware estimate */
+    v = TF_LOAD(x + i);
+    r = TF_RSQRT(v);
+    r = TF_MUL(
+      r,
+      TF_SUB(
+        TF_SET1(1.5f),
+        TF_MUL(TF_MUL(TF_SET1(0.5f), v), TF_MUL(r, r))
+      )
+    );
+    TF_STORE(out + i, r);
+  }
+  return i;
+}
+
+#undef TF_CAT_
+#undef TF_CAT
+#undef TF_FN
+#undef TF_SELECT
+#undef TF_SIGN
+#undef TF_ISA
+#undef TF_VEC
+#undef TF_IVEC
+#undef TF_W
+#undef TF_LOAD
+#undef TF_STORE
+#undef TF_SET1
+#undef TF_ISET1
+#undef TF_ADD
+#undef TF_SUB
+#undef TF_MUL
+#undef TF_DIV
+#undef TF_MIN
+#undef TF_MAX
+#undef TF_AND
+#undef TF_ANDNOT
+#undef TF_OR
+#undef TF_XOR
+#undef TF_CMPGT
+#undef TF_RSQRT
+#undef TF_ROUND
+#undef TF_CVTI
+#undef TF_IADD
+#undef TF_ISUB
+#undef TF_IAND
+#undef TF_ICMPEQ
+#undef TF_ISLL
+#undef TF_ISRL
+#undef TF_ASF
+#undef TF_ASI
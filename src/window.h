@@ -35,6 +35,8 @@ struct window_os_details {
   xcb_connection_t *cn;
   xcb_window_t wn;
   xcb_atom_t win_delete;
+  unsigned char mapped;
+  unsigned char obscured;
 };
 
 #else
@@ -50,6 +52,13 @@ struct window {
   uint16_t width;
   uint16_t height;
   unsigned char should_close;
+  /* Mapped and not fully covered, nothing drawn is seen otherwise */
+  unsigned char visible;
+  /* Contents were damaged or resized by the last window_update */
+  unsigned char dirty;
+  /* The last window_update changed width or height. A drag sends a burst
+   * of configure events, only the final size is kept */
+  unsigned char resized;
 
   struct window_os_details os;
 };
@@ -58,7 +67,10 @@ struct window {
 /* window_<platform>.c */
 int window_init(struct window *, char *, uint16_t, uint16_t);
 void window_deinit(struct window *);
-void window_update(struct window *);
+/* Returns how many events were handled */
+int window_update(struct window *);
+/* Readable when the display server has events for window_update */
+int window_fd(struct window *);
 void window_close(struct window *);
 void window_dimensions(struct window *, uint16_t *, uint16_t *);
 /* **************************************** */
@@ -52,7 +52,11 @@ static int setup_window(
   xcb_window_t *out_wn
 ) {
   uint32_t mask = XCB_CW_EVENT_MASK;
-  uint32_t values[] = { XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+  uint32_t values[] = {
+    XCB_EVENT_MASK_STRUCTURE_NOTIFY
+    | XCB_EVENT_MASK_EXPOSURE
+    | XCB_EVENT_MASK_VISIBILITY_CHANGE
+  };
 
   *out_wn = xcb_generate_id(cn);
   xcb_create_window(
@@ -183,11 +187,15 @@ void window_deinit(struct window *w) {
   xcb_disconnect(w->os.cn);
 }
 
-void window_update(struct window *w) {
+int window_update(struct window *w) {
+  int n = 0;
   xcb_generic_event_t *event;
 
-  if (!w) return;
+  if (!w) return 0;
+  w->dirty = 0;
+  w->resized = 0;
   while ((event = xcb_poll_for_event(w->os.cn))) {
+    ++n;
     switch (event->response_type & ~0x80) {
     case XCB_CONFIGURE_NOTIFY: {
       /* resize */
@@ -197,10 +205,32 @@ void window_update(struct window *w) {
       if ((e->width != w->width) || (e->height != w->height)) {
         w->width = e->width;
         w->height = e->height;
+        w->dirty = 1;
+        w->resized = 1;
       }
       break;
     }
 
+    /* Window managers unmap minimized windows */
+    case XCB_MAP_NOTIFY:
+      w->os.mapped = 1;
+      w->os.obscured = 0;
+      w->dirty = 1;
+      break;
+    case XCB_UNMAP_NOTIFY:
+      w->os.mapped = 0;
+      break;
+    case XCB_VISIBILITY_NOTIFY: {
+      xcb_visibility_notify_event_t *e;
+
+      e = (xcb_visibility_notify_event_t *) event;
+      w->os.obscured = e->state == XCB_VISIBILITY_FULLY_OBSCURED;
+      break;
+    }
+    case XCB_EXPOSE:
+      w->dirty = 1;
+      break;
+
     case XCB_CLIENT_MESSAGE: {
       /* close window */
       xcb_client_message_event_t *e;
@@ -212,6 +242,15 @@ void window_update(struct window *w) {
     }
     free(event);
   }
+  w->visible = w->os.mapped && !w->os.obscured;
+  /* Anything we sent has to go out before the caller sleeps on the fd */
+  xcb_flush(w->os.cn);
+  return n;
+}
+
+int window_fd(struct window *w) {
+  if (!w) return -1;
+  return xcb_get_file_descriptor(w->os.cn);
 }
 
 void window_dimensions(
@@ -18,12 +18,401 @@
 
 #include "xrand.h"
 #include "sized_types.h"
+#include "trig.h"
+#include <stddef.h>
+#include <string.h>
 
-uint64_t XRAND_SEED;
+#if defined(__GNUC__) && defined(__x86_64__)
+#define XRAND_X86
+#include <immintrin.h>
+#endif
+
+#define rotl(x, k) (((x) << (k)) | ((x) >> (64 - (k))))
+/* 2^-24, turns the top 24 bits of a word into [0, 1) */
+#define XRAND_UNIT (1.0f / 16777216.0f)
+#define XRAND_TAU 6.28318530717958648f
+#define XRAND_LN2 0.69314718055994531f
+/* Keeps rsqrt based square roots finite at zero */
+#define XRAND_TINY 1e-30f
+
+/* splitmix64 output for seed 0 */
+struct xrand_state XRAND_DEFAULT = {
+  {
+    0xe220a8397b1dcdafUL,
+    0x6e789e6aa1b965f4UL,
+    0x06c45d188009454fUL,
+    0xf88bb8a8724c81ecUL
+  }
+};
+
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z;
+
+  z = (*x += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+/* Every kernel produces 8 floats per step, two per lane, from the low
+ * then the high half of each lane's 64 bit output. It stops at the last
+ * whole step and returns where it stopped */
+static size_t fill_scalar(
+  struct xrand_wide *wide,
+  float *out,
+  size_t n,
+  float offset,
+  float scale
+) {
+  size_t i, lane, k;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    for (lane = 0; lane < 4; ++lane) {
+      struct xrand_state state;
+      uint64_t r;
+
+      for (k = 0; k < 4; ++k) state.s[k] = wide->s[k][lane];
+      r = xrand_next(&state);
+      for (k = 0; k < 4; ++k) wide->s[k][lane] = state.s[k];
+      out[i + lane * 2] =
+        offset + ((float) ((r >> 8) & 0xffffffUL) * XRAND_UNIT) * scale;
+      out[i + lane * 2 + 1] =
+        offset + ((float) (r >> 40) * XRAND_UNIT) * scale;
+    }
+  }
+  return i;
+}
+
+#ifdef XRAND_X86
+
+/* One xoshiro256** step over two lanes. The multiplies by 5 and 9 are
+ * shift-adds since SSE2 has no 64 bit multiply */
+static __m128i next_sse(__m128i *s) {
+  __m128i t, r;
+
+  t = _mm_add_epi64(s[1], _mm_slli_epi64(s[1], 2));
+  t = _mm_or_si128(_mm_slli_epi64(t, 7), _mm_srli_epi64(t, 57));
+  r = _mm_add_epi64(t, _mm_slli_epi64(t, 3));
+  t = _mm_slli_epi64(s[1], 17);
+  s[2] = _mm_xor_si128(s[2], s[0]);
+  s[3] = _mm_xor_si128(s[3], s[1]);
+  s[1] = _mm_xor_si128(s[1], s[2]);
+  s[0] = _mm_xor_si128(s[0], s[3]);
+  s[2] = _mm_xor_si128(s[2], t);
+  s[3] = _mm_or_si128(_mm_slli_epi64(s[3], 45), _mm_srli_epi64(s[3], 19));
+  return r;
+}
+
+static size_t fill_sse(
+  struct xrand_wide *wide,
+  float *out,
+  size_t n,
+  float offset,
+  float scale
+) {
+  size_t i, k;
+  __m128i lo[4], hi[4];
+  __m128 vo, vs, vu;
+
+  for (k = 0; k < 4; ++k) {
+    lo[k] = _mm_loadu_si128((__m128i *) wide->s[k]);
+    hi[k] = _mm_loadu_si128((__m128i *) (wide->s[k] + 2));
+  }
+  vo = _mm_set1_ps(offset);
+  vs = _mm_set1_ps(scale);
+  vu = _mm_set1_ps(XRAND_UNIT);
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128 f;
+
+    f = _mm_cvtepi32_ps(_mm_srli_epi32(next_sse(lo), 8));
+    _mm_storeu_ps(out + i, _mm_add_ps(vo, _mm_mul_ps(_mm_mul_ps(f, vu), vs)));
+    f = _mm_cvtepi32_ps(_mm_srli_epi32(next_sse(hi), 8));
+    _mm_storeu_ps(
+      out + i + 4,
+      _mm_add_ps(vo, _mm_mul_ps(_mm_mul_ps(f, vu), vs))
+    );
+  }
+  for (k = 0; k < 4; ++k) {
+    _mm_storeu_si128((__m128i *) wide->s[k], lo[k]);
+    _mm_storeu_si128((__m128i *) (wide->s[k] + 2), hi[k]);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t fill_avx2(
+  struct xrand_wide *wide,
+  float *out,
+  size_t n,
+  float offset,
+  float scale
+) {
+  size_t i;
+  __m256i s0, s1, s2, s3, t, r;
+  __m256 vo, vs, vu;
+
+  s0 = _mm256_loadu_si256((__m256i *) wide->s[0]);
+  s1 = _mm256_loadu_si256((__m256i *) wide->s[1]);
+  s2 = _mm256_loadu_si256((__m256i *) wide->s[2]);
+  s3 = _mm256_loadu_si256((__m256i *) wide->s[3]);
+  vo = _mm256_set1_ps(offset);
+  vs = _mm256_set1_ps(scale);
+  vu = _mm256_set1_ps(XRAND_UNIT);
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256 f;
+
+    t = _mm256_add_epi64(s1, _mm256_slli_epi64(s1, 2));
+    t = _mm256_or_si256(_mm256_slli_epi64(t, 7), _mm256_srli_epi64(t, 57));
+    r = _mm256_add_epi64(t, _mm256_slli_epi64(t, 3));
+    t = _mm256_slli_epi64(s1, 17);
+    s2 = _mm256_xor_si256(s2, s0);
+    s3 = _mm256_xor_si256(s3, s1);
+    s1 = _mm256_xor_si256(s1, s2);
+    s0 = _mm256_xor_si256(s0, s3);
+    s2 = _mm256_xor_si256(s2, t);
+    s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+    f = _mm256_cvtepi32_ps(_mm256_srli_epi32(r, 8));
+    _mm256_storeu_ps(
+      out + i,
+      _mm256_add_ps(vo, _mm256_mul_ps(_mm256_mul_ps(f, vu), vs))
+    );
+  }
+  _mm256_storeu_si256((__m256i *) wide->s[0], s0);
+  _mm256_storeu_si256((__m256i *) wide->s[1], s1);
+  _mm256_storeu_si256((__m256i *) wide->s[2], s2);
+  _mm256_storeu_si256((__m256i *) wide->s[3], s3);
+  return i;
+}
+
+static int have_avx2(void) {
+  static int cached = -1;
+
+  if (cached < 0) {
+    __builtin_cpu_init();
+    cached = __builtin_cpu_supports("avx2");
+  }
+  return cached;
+}
+
+#endif  /* XRAND_X86 */
+
+/* out[i] = offset + u * scale for uniform u in [0, 1). A partial last
+ * step still consumes a whole one */
+static void fill_affine(
+  struct xrand_wide *wide,
+  float *out,
+  size_t n,
+  float offset,
+  float scale
+) {
+  size_t i;
+  float tail[8];
+
+#ifdef XRAND_X86
+  if (have_avx2()) {
+    i = fill_avx2(wide, out, n, offset, scale);
+  } else {
+    i = fill_sse(wide, out, n, offset, scale);
+  }
+#else
+  i = fill_scalar(wide, out, n, offset, scale);
+#endif
+  if (i < n) {
+    fill_scalar(wide, tail, 8, offset, scale);
+    memcpy(out + i, tail, (n - i) * sizeof(float));
+  }
+}
+
+/* out[i] = sqrt(in[i]) for in[i] >= 0, in is clobbered */
+static void sqrt_n(float *in, float *out, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    if (in[i] < XRAND_TINY) in[i] = XRAND_TINY;
+  }
+  frsqrt_n(in, out, n);
+  for (i = 0; i < n; ++i) out[i] *= in[i];
+}
+
+/* **************************************** */
+/* Public */
+/* **************************************** */
+
+void xrand_seed(struct xrand_state *state, uint64_t seed) {
+  size_t i;
+
+  /* splitmix64 never outputs four zeros in a row, so the state is valid
+   * for any seed */
+  for (i = 0; i < 4; ++i) state->s[i] = splitmix64(&seed);
+}
+
+uint64_t xrand_next(struct xrand_state *state) {
+  uint64_t *s = state->s;
+  uint64_t result, t;
+
+  result = rotl(s[1] * 5, 7) * 9;
+  t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+void xrand_jump(struct xrand_state *state) {
+  static const uint64_t jump[4] = {
+    0x180ec6d33cfd0abaUL,
+    0xd5a61266f0c9392cUL,
+    0xa9582618e03fc9aaUL,
+    0x39abdc4529b1661cUL
+  };
+
+  size_t i, b;
+  uint64_t s[4] = { 0 };
+
+  for (i = 0; i < 4; ++i) {
+    for (b = 0; b < 64; ++b) {
+      if (jump[i] & ((uint64_t) 1 << b)) {
+        s[0] ^= state->s[0];
+        s[1] ^= state->s[1];
+        s[2] ^= state->s[2];
+        s[3] ^= state->s[3];
+      }
+      xrand_next(state);
+    }
+  }
+  for (i = 0; i < 4; ++i) state->s[i] = s[i];
+}
+
+void xrand_split(struct xrand_state *state, struct xrand_state *out) {
+  *out = *state;
+  xrand_jump(state);
+}
 
 uint64_t xrand(void) {
-  XRAND_SEED ^= XRAND_SEED << 1;
-  XRAND_SEED ^= XRAND_SEED >> 13;
-  XRAND_SEED ^= XRAND_SEED << 45;
-  return XRAND_SEED;
+  return xrand_next(&XRAND_DEFAULT);
+}
+
+void xrand_wide_init(struct xrand_wide *wide, struct xrand_state *state) {
+  size_t lane, k;
+
+  for (lane = 0; lane < 4; ++lane) {
+    struct xrand_state stream;
+
+    xrand_split(state, &stream);
+    for (k = 0; k < 4; ++k) wide->s[k][lane] = stream.s[k];
+  }
+}
+
+void xrand_fill_float(struct xrand_wide *wide, float *out, size_t n) {
+  fill_affine(wide, out, n, 0.0f, 1.0f);
+}
+
+void xrand_fill_range(
+  struct xrand_wide *wide,
+  float lo,
+  float hi,
+  float *out,
+  size_t n
+) {
+  fill_affine(wide, out, n, lo, hi - lo);
+}
+
+/* The shaped samplers work through stack buffers a chunk at a time */
+enum {
+  XRAND_CHUNK = 128
+};
+
+void xrand_fill_gauss(
+  struct xrand_wide *wide,
+  float mean,
+  float stddev,
+  float *out,
+  size_t n
+) {
+  size_t i, j, m, pairs;
+  float u[XRAND_CHUNK], r[XRAND_CHUNK];
+  float s[XRAND_CHUNK], c[XRAND_CHUNK];
+
+  /* Box-Muller, each pair of uniforms gives two samples */
+  for (i = 0; i < n; i += m) {
+    m = (n - i < XRAND_CHUNK * 2) ? n - i : XRAND_CHUNK * 2;
+    pairs = (m + 1) / 2;
+    /* 1 - u so the log never sees zero */
+    fill_affine(wide, u, pairs, 1.0f, -1.0f);
+    fill_affine(wide, s, pairs, 0.0f, XRAND_TAU);
+    flog2_n(u, u, pairs);
+    for (j = 0; j < pairs; ++j) u[j] *= -2.0f * XRAND_LN2;
+    sqrt_n(u, r, pairs);
+    fsincos_n(s, s, c, pairs);
+    for (j = 0; j < pairs; ++j) {
+      out[i + j * 2] = mean + stddev * r[j] * c[j];
+      if (j * 2 + 1 < m) out[i + j * 2 + 1] = mean + stddev * r[j] * s[j];
+    }
+  }
+}
+
+void xrand_fill_disk(
+  struct xrand_wide *wide,
+  float *out_x,
+  float *out_y,
+  size_t n
+) {
+  size_t i, j, m;
+  float u[XRAND_CHUNK], r[XRAND_CHUNK];
+
+  for (i = 0; i < n; i += m) {
+    m = (n - i < XRAND_CHUNK) ? n - i : XRAND_CHUNK;
+    /* sqrt keeps the density even across the area */
+    fill_affine(wide, u, m, 0.0f, 1.0f);
+    sqrt_n(u, r, m);
+    fill_affine(wide, u, m, 0.0f, XRAND_TAU);
+    fsincos_n(u, out_y + i, out_x + i, m);
+    for (j = 0; j < m; ++j) {
+      out_x[i + j] *= r[j];
+      out_y[i + j] *= r[j];
+    }
+  }
+}
+
+void xrand_fill_sphere(
+  struct xrand_wide *wide,
+  float *out_x,
+  float *out_y,
+  float *out_z,
+  size_t n
+) {
+  size_t i, j, m;
+  float u[XRAND_CHUNK], r[XRAND_CHUNK];
+
+  for (i = 0; i < n; i += m) {
+    m = (n - i < XRAND_CHUNK) ? n - i : XRAND_CHUNK;
+    /* Uniform z and angle is uniform on the sphere (Archimedes) */
+    fill_affine(wide, out_z + i, m, -1.0f, 2.0f);
+    for (j = 0; j < m; ++j) u[j] = 1.0f - out_z[i + j] * out_z[i + j];
+    sqrt_n(u, r, m);
+    fill_affine(wide, u, m, 0.0f, XRAND_TAU);
+    fsincos_n(u, out_y + i, out_x + i, m);
+    for (j = 0; j < m; ++j) {
+      out_x[i + j] *= r[j];
+      out_y[i + j] *= r[j];
+    }
+  }
+}
+
+void xrand_fill_dir(struct xrand_wide *wide, struct vec3 *out, size_t n) {
+  size_t i, j, m;
+  float x[XRAND_CHUNK], y[XRAND_CHUNK], z[XRAND_CHUNK];
+
+  for (i = 0; i < n; i += m) {
+    m = (n - i < XRAND_CHUNK) ? n - i : XRAND_CHUNK;
+    xrand_fill_sphere(wide, x, y, z, m);
+    for (j = 0; j < m; ++j) {
+      out[i + j].x = x[j];
+      out[i + j].y = y[j];
+      out[i + j].z = z[j];
+    }
+  }
 }
@@ -20,9 +20,68 @@
 #define XRAND_H
 
 #include "sized_types.h"
+#include "trig.h"
+#include <stddef.h>
 
-extern uint64_t XRAND_SEED;
+/* xoshiro256** state. Never all zero, use xrand_seed to fill it */
+struct xrand_state {
+  uint64_t s[4];
+};
 
+/* Backs xrand(). Starts out with a fixed seed and is not thread safe;
+ * threads should take their own stream with xrand_split */
+extern struct xrand_state XRAND_DEFAULT;
+
+void xrand_seed(struct xrand_state *state, uint64_t seed);
+uint64_t xrand_next(struct xrand_state *state);
+/* Advances state by 2^128 outputs */
+void xrand_jump(struct xrand_state *state);
+/* Copies state into out then jumps state, so every call hands out a
+ * stream that will not overlap the others for 2^128 outputs */
+void xrand_split(struct xrand_state *state, struct xrand_state *out);
 uint64_t xrand(void);
 
+/* Four xoshiro256** streams side by side, s[word][lane], for the batch
+ * samplers. Output is identical whichever instruction set generates it */
+struct xrand_wide {
+  uint64_t s[4][4];
+};
+
+/* Takes four streams from state with xrand_split */
+void xrand_wide_init(struct xrand_wide *wide, struct xrand_state *state);
+/* Uniform in [0, 1) with 24 bits of precision */
+void xrand_fill_float(struct xrand_wide *wide, float *out, size_t n);
+/* Uniform in [lo, hi), up to float rounding at hi */
+void xrand_fill_range(
+  struct xrand_wide *wide,
+  float lo,
+  float hi,
+  float *out,
+  size_t n
+);
+void xrand_fill_gauss(
+  struct xrand_wide *wide,
+  float mean,
+  float stddev,
+  float *out,
+  size_t n
+);
+/* Uniform over the area of the unit disk */
+void xrand_fill_disk(
+  struct xrand_wide *wide,
+  float *out_x,
+  float *out_y,
+  size_t n
+);
+/* Uniform over the surface of the unit sphere */
+void xrand_fill_sphere(
+  struct xrand_wide *wide,
+  float *out_x,
+  float *out_y,
+  float *out_z,
+  size_t n
+);
+/* Same distribution as xrand_fill_sphere, packed as unit vectors */
+void xrand_fill_dir(struct xrand_wide *wide, struct vec3 *out, size_t n);
+
 #endif